@@ -0,0 +1,129 @@
+/* Frames drawn by editorRefreshScreen() on a 48 by 160 terminal, showing a
+ * highlighted C file: with nothing changed, the cursor moved, a key typed,
+ * a row scrolled and a page scrolled between frames. Times, allocations
+ * and bytes written are per frame, after 200 frames to warm up; writes go
+ * to /dev/null. malloc(), calloc() and realloc() are counted through the
+ * linker's --wrap, see run.sh. Run with
+ *
+ *   bench/run.sh draw
+ */
+#include "kilotest.h"
+
+#include <fcntl.h>
+#include <time.h>
+
+#define BENCH_FRAMES 20000
+
+static long allocs;
+
+void *__real_malloc(size_t n);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t n);
+
+void *__wrap_malloc(size_t n) {
+    allocs++;
+    return __real_malloc(n);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    allocs++;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t n) {
+    allocs++;
+    return __real_realloc(p, n);
+}
+
+enum { STILL, CURSOR, TYPING, ROW, PAGE };
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Change what the next frame shows as 'mode' does. */
+static void step(int mode, int i) {
+    switch (mode) {
+    case CURSOR:
+        E.cy = E.rowoff + i % E.screenrows;
+        E.cx = i % 7;
+        break;
+    case TYPING:
+        if (i % 2)
+            editorDelChar(&E);
+        else
+            editorInsertChar(&E, 'a' + i % 26);
+        break;
+    case ROW:
+        E.cy = E.rowoff + E.screenrows;
+        break;
+    case PAGE:
+        E.cy = E.rowoff + 2 * E.screenrows - 1;
+        break;
+    }
+    if (E.cy >= E.numrows - E.screenrows) {
+        E.cy = E.rowoff = 0;
+        E.cx = 0;
+    }
+}
+
+int main(int argc, char **argv) {
+    static const char *lines[] = {
+        "/* A comment, then code with keywords, strings and numbers. */",
+        "static int draw(struct editorConfig *E, const char *s, int n) {",
+        "\tfor (int i = 0; i < n; i++) {",
+        "\t\tif (s[i] == '\\t' && E->cx > 80) return -1; // tabs",
+        "\t\tprintf(\"%d of %d: %s\\n\", i, n, \"a string of some length\");",
+        "\t}",
+        "\treturn 0x1f + 42;",
+        "}",
+        "",
+    };
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/draw.c", argc > 1 ? argv[1] : ".");
+    FILE *fp = fopen(path, "w");
+    for (int i = 0; i < 200000; i++)
+        fprintf(fp, "%s\n", lines[i % 9]);
+    fclose(fp);
+
+    /* Keep stdout for the results and draw to /dev/null. */
+    FILE *out = fdopen(dup(STDOUT_FILENO), "w");
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    close(null);
+
+    static const char *names[] = { "still", "cursor", "typing", "row", "page" };
+    fprintf(out, "%8s %10s %12s %12s\n", "frame", "us", "allocations", "bytes");
+    for (int mode = STILL; mode <= PAGE; mode++) {
+        initEditor(&E);
+        editorOpen(&E, path);
+        editorIndexFinish(&E);
+        jnClose(&E.journal);
+        E.screenrows = 48;
+        E.screencols = 160;
+        E.cy = E.cx = 0;
+        if (mode == TYPING)
+            E.cy = 3;
+        for (int i = 0; i < 200; i++) {
+            step(mode, i);
+            editorRefreshScreen(&E);
+        }
+        long a0 = allocs;
+        unsigned long long b0 = E.screen.bytes;
+        double t0 = now();
+        for (int i = 0; i < BENCH_FRAMES; i++) {
+            step(mode, i);
+            editorRefreshScreen(&E);
+        }
+        double secs = now() - t0;
+        fprintf(out, "%8s %10.2f %12.2f %12.0f\n", names[mode], secs / BENCH_FRAMES * 1e6,
+            (double)(allocs - a0) / BENCH_FRAMES, (double)(E.screen.bytes - b0) / BENCH_FRAMES);
+        scrFree(&E.screen);
+        editorFreeRows(&E);
+    }
+    remove(path);
+    fclose(out);
+    return 0;
+}
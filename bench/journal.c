@@ -0,0 +1,110 @@
+/* What the journal adds to a keystroke: 200K keys typed into a 100K line
+ * file, a line break every 60, with no journal, with the journal writing
+ * batched records as it does, and with a write per key. Then the time to
+ * open the file again replaying the log, and to compact it. Times are the
+ * best of three. Run with
+ *
+ *   bench/run.sh journal
+ *
+ * $TMPDIR decides the disk written to. */
+#include "kilotest.h"
+
+#include <time.h>
+
+#define BENCH_KEYS 200000
+
+enum { NO_JOURNAL, BATCHED, PER_KEY };
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void openFile(struct editorConfig *e, const char *path) {
+    initEditor(e);
+    editorOpen(e, (char *)path);
+    editorIndexFinish(e);
+}
+
+/* Seconds to type BENCH_KEYS keys in the middle of the file. */
+static double type(const char *path, int mode) {
+    openFile(&E, path);
+    if (mode == NO_JOURNAL)
+        jnClose(&E.journal);
+    E.cy = E.numrows / 2;
+    E.cx = 0;
+    double t0 = now();
+    for (int i = 0; i < BENCH_KEYS; i++) {
+        if (i % 61 == 60)
+            editorInsertNewline(&E);
+        else
+            editorInsertChar(&E, 'a' + i % 26);
+        if (mode == PER_KEY)
+            jnFlush(&E.journal);
+    }
+    jnFlush(&E.journal);
+    return now() - t0;
+}
+
+int main(int argc, char **argv) {
+    static struct editorConfig E2;
+    static const char *modes[] = { "none", "batched", "per key" };
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/journal.txt", argc > 1 ? argv[1] : ".");
+    FILE *fp = fopen(path, "w");
+    for (int i = 0; i < 100000; i++)
+        fprintf(fp, "line %d of a file being typed into, a key at a time\n", i);
+    fclose(fp);
+
+    printf("%8s %10s %10s\n", "journal", "ns/key", "log bytes");
+    for (int mode = NO_JOURNAL; mode <= PER_KEY; mode++) {
+        double best = 1e9;
+        size_t logged = 0;
+        for (int rep = 0; rep < 3; rep++) {
+            double secs = type(path, mode);
+            best = secs < best ? secs : best;
+            logged = E.journal.size;
+            jnRemove(&E.journal);
+            jnClose(&E.journal);
+            editorFreeRows(&E);
+        }
+        printf("%8s %10.0f %10zu\n", modes[mode], best / BENCH_KEYS * 1e9, logged);
+    }
+
+    /* Leave the log of a batched run behind, as a crash would, and put it
+     * back before each open as compaction replaces it. */
+    type(path, BATCHED);
+    size_t logged = E.journal.size;
+    jnClose(&E.journal);
+    editorFreeRows(&E);
+    char *jpath = editorSidePath(path, KILO_JOURNAL_SUFFIX), *log = malloc(logged);
+    fp = fopen(jpath, "r");
+    fread(log, 1, logged, fp);
+    fclose(fp);
+    double replay = 1e9, compact = 1e9;
+    int edits = 0;
+    for (int rep = 0; rep < 3; rep++) {
+        fp = fopen(jpath, "w");
+        fwrite(log, 1, logged, fp);
+        fclose(fp);
+        double t0 = now();
+        openFile(&E2, path);
+        double t1 = now();
+        editorJournalCompact(&E2);
+        double t2 = now();
+        edits = E2.dirty;
+        replay = t1 - t0 < replay ? t1 - t0 : replay;
+        compact = t2 - t1 < compact ? t2 - t1 : compact;
+        jnClose(&E2.journal);
+        editorFreeRows(&E2);
+    }
+    printf("open replaying %d edits, %zu bytes: %.0f ms, %.1fM edits/s\n", edits, logged, replay * 1e3,
+        edits / replay / 1e6);
+    printf("compacting them: %.1f ms\n", compact * 1e3);
+    remove(path);
+    remove(jpath);
+    free(jpath);
+    free(log);
+    return 0;
+}
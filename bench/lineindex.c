@@ -0,0 +1,123 @@
+/* Loading a 256 MB file, in GB/s: the fgets() loop editorOpen() once
+ * split lines with, alone and making rows of them as it did, against the
+ * line index built in one pass, on one thread and by the background
+ * indexer, and editorOpen() as it is. Lines are 60 bytes on average, then
+ * 8, where the cost per line shows most. Times are the best of three, with
+ * the file in the page cache. Run with
+ *
+ *   bench/run.sh lineindex
+ *
+ * $TMPDIR decides the disk written to. */
+#include "kilotest.h"
+
+#include <time.h>
+
+#define BENCH_BYTES (256 << 20)
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned long long seed = 88172645463325252ULL;
+
+static unsigned rnd(unsigned n) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return seed % n;
+}
+
+/* Lines of 0 to 2 * 'avg' bytes of text, some ending in "\r\n". */
+static void writeFile(const char *path, int avg) {
+    static char line[4096];
+    FILE *fp = fopen(path, "w");
+    for (long bytes = 0; bytes < BENCH_BYTES;) {
+        int n = rnd(2 * avg - 1);
+        for (int i = 0; i < n; i++)
+            line[i] = 'a' + i % 26;
+        if (n && rnd(16) == 0)
+            line[n - 1] = '\r';
+        line[n++] = '\n';
+        fwrite(line, 1, n, fp);
+        bytes += n;
+    }
+    fclose(fp);
+}
+
+/* The loop of the old editorOpen(), making rows only if 'rows'. */
+static size_t loadFgets(const char *path, int rows) {
+    char buf[65535];
+    size_t n = 0;
+    FILE *fp = fopen(path, "r");
+    char *line;
+    if (rows)
+        initEditor(&E);
+    while ((line = fgets(buf, sizeof(buf), fp))) {
+        int linelen = strlen(line);
+        while (linelen > 0 && (line[linelen - 1] == '\n' || line[linelen - 1] == '\r'))
+            linelen--;
+        if (rows)
+            editorInsertRow(&E, E.numrows, line, linelen);
+        n++;
+    }
+    fclose(fp);
+    if (rows)
+        editorFreeRows(&E);
+    return n;
+}
+
+int main(int argc, char **argv) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/lineindex.txt", argc > 1 ? argv[1] : ".");
+    const char *names[] = { "fgets", "fgets, rows", "liBuild", "liStart", "editorOpen" };
+    int threads = platformCpuCount();
+
+    printf("%d threads for liStart\n", threads);
+    printf("%6s %12s %8s %8s %10s\n", "line", "loader", "ms", "GB/s", "lines");
+    static const int avgs[] = { 60, 8 };
+    for (int a = 0; a < 2; a++) {
+        int avg = avgs[a];
+        writeFile(path, avg);
+        size_t len;
+        char *map = platformMapFile(path, &len);
+        for (int k = 0; k < 5; k++) {
+            double best = 1e9;
+            size_t lines = 0;
+            for (int rep = 0; rep < 3; rep++) {
+                struct lineindex li = { 0 };
+                /* Fault the mapping in, as reading the file does. */
+                volatile char sum = 0;
+                for (size_t i = 0; i < len; i += 4096)
+                    sum += map[i];
+                double t0 = now();
+                if (k < 2) {
+                    lines = loadFgets(path, k);
+                } else if (k == 2) {
+                    liBuild(&li, map, len);
+                } else if (k == 3) {
+                    liFinish(liStart(map, len, threads, 0), &li);
+                } else {
+                    initEditor(&E);
+                    editorOpen(&E, path);
+                    editorIndexFinish(&E);
+                    lines = E.numrows;
+                }
+                double secs = now() - t0;
+                best = secs < best ? secs : best;
+                if (k == 2 || k == 3)
+                    lines = li.n;
+                liFree(&li);
+                if (k == 4) {
+                    jnClose(&E.journal);
+                    editorFreeRows(&E);
+                }
+            }
+            printf("%6d %12s %8.0f %8.2f %10zu\n", avg, names[k], best * 1e3, len / best / 1e9, lines);
+        }
+        platformUnmapFile(map, len);
+    }
+    remove(path);
+    return 0;
+}
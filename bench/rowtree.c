@@ -0,0 +1,92 @@
+/* Row inserts and deletes in the row tree, 100K of each: at random in
+ * buffers of 1K to 10M rows, then at the top, middle and end of a 10M row
+ * buffer, where they should cost the same. Times are per operation; an
+ * index lookup finds a row by number and then its number from the row.
+ * Run with
+ *
+ *   bench/run.sh rowtree
+ */
+#include "kilotest.h"
+
+#include <time.h>
+
+#define BENCH_OPS 100000
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned long long seed = 88172645463325252ULL;
+
+static long rnd(long n) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return seed % n;
+}
+
+/* Nanoseconds per insert, delete and row index lookup, in that order. */
+static void benchTree(long rows, double *ns) {
+    struct slab mem = { 0 };
+    struct rowtree t = { 0 };
+    t.mem = &mem;
+    for (long i = 0; i < rows; i++)
+        rtInsert(&t, i);
+
+    double t0 = now();
+    for (long i = 0; i < BENCH_OPS; i++)
+        rtInsert(&t, rnd(rows + i + 1));
+    double t1 = now();
+    long sum = 0;
+    for (long i = 0; i < BENCH_OPS; i++)
+        sum += rtIndexOf(rtAt(&t, rnd(rows + BENCH_OPS)));
+    double t2 = now();
+    for (long i = 0; i < BENCH_OPS; i++)
+        rtDelete(&t, rnd(rows + BENCH_OPS - i));
+    double t3 = now();
+
+    ns[0] = (t1 - t0) / BENCH_OPS * 1e9;
+    ns[1] = (t3 - t2) / BENCH_OPS * 1e9;
+    ns[2] = (t2 - t1) / BENCH_OPS * 1e9 + (sum < 0);
+    rtFree(&t);
+    slabReset(&mem);
+}
+
+/* Nanoseconds per insert and delete at 'where', 0 to 1, of a buffer of
+ * 'rows' rows. */
+static void benchAt(struct rowtree *t, long rows, double where, double *ns) {
+    double t0 = now();
+    for (long i = 0; i < BENCH_OPS; i++)
+        rtInsert(t, (long)(where * (rows + i)));
+    double t1 = now();
+    for (long i = 0; i < BENCH_OPS; i++)
+        rtDelete(t, (long)(where * (rows + BENCH_OPS - i - 1)));
+    double t2 = now();
+    ns[0] = (t1 - t0) / BENCH_OPS * 1e9;
+    ns[1] = (t2 - t1) / BENCH_OPS * 1e9;
+}
+
+int main(void) {
+    printf("%10s %8s %8s %8s\n", "rows", "insert", "delete", "index");
+    for (long rows = 1000; rows <= 10000000; rows *= 10) {
+        double ns[3];
+        benchTree(rows, ns);
+        printf("%10ld %8.0f %8.0f %8.0f\n", rows, ns[0], ns[1], ns[2]);
+    }
+
+    struct slab mem = { 0 };
+    struct rowtree t = { 0 };
+    t.mem = &mem;
+    for (long i = 0; i < 10000000; i++)
+        rtInsert(&t, i);
+    printf("\n%10s %8s %8s\n", "at", "insert", "delete");
+    const char *name[] = { "top", "middle", "end" };
+    for (int k = 0; k < 3; k++) {
+        double ns[2];
+        benchAt(&t, 10000000, k / 2.0, ns);
+        printf("%10s %8.0f %8.0f\n", name[k], ns[0], ns[1]);
+    }
+    return 0;
+}
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Build and run the benchmarks in bench/, or those named, as in
+#
+#   bench/run.sh rowtree
+#
+# They are built as the drivers in tests/ are, see tests/run.sh, with
+# optimization and without checks; CFLAGS are added. Files they write go
+# under $TMPDIR.
+set -e
+root=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d "${TMPDIR:-/tmp}/kilo-bench.XXXXXX")
+trap 'rm -rf "$work"' EXIT
+
+cc=${CC:-cc}
+flags="-O2 -DNDEBUG -Wall -Wno-unused-parameter -I$root/tests -I$root/repos/_mod -I$root/repos/taidanh"
+srcs="journal lineindex rowtree screen slab"
+
+# Link flags a benchmark needs besides these.
+ldflags() {
+    case $1 in
+    draw) echo "-Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc" ;;
+    esac
+}
+
+if [ $# -eq 0 ]; then
+    set -- $(cd "$root/bench" && ls *.c | sed 's/\.c$//')
+fi
+for t in "$@"; do
+    $cc $flags $CFLAGS -o "$work/$t" "$root/bench/$t.c" \
+        $(for s in $srcs; do echo "$root/repos/taidanh/$s.c"; done) -lpthread $(ldflags $t)
+    mkdir "$work/$t.d"
+    echo "== $t"
+    "$work/$t" "$work/$t.d" </dev/null
+done
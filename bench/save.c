@@ -0,0 +1,88 @@
+/* A whole file written as a save writes it, through io_uring and then
+ * through writev(), at 64 MB and 512 MB: from one buffer, as a file saved
+ * from runs of its mapping is, and from 64 KB buffers, 256 to a call, as
+ * editorSaveWrite() passes them. Times are the best of three, for the
+ * writes and for the fsync and rename that commit them. Run with
+ *
+ *   bench/run.sh save
+ *
+ * $TMPDIR decides the disk written to. */
+#include "kilotest.h"
+
+#include <time.h>
+
+#define BENCH_PIECE (64 << 10)
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Write 'len' bytes of 'buf' to 'path' in pieces of 'piece' bytes, or one
+ * piece if 0. Stores seconds taken to write and commit at 'secs'. */
+static int save(const char *path, char *buf, size_t len, size_t piece, double *secs) {
+    static struct platformIov iov[PLATFORM_IOV_MAX];
+    double t0 = now();
+    struct platformFile *f = platformCreateReplacement(path);
+    if (f == NULL)
+        return -1;
+    if (piece == 0)
+        piece = len;
+    for (size_t at = 0; at < len;) {
+        int n = 0;
+        for (; n < PLATFORM_IOV_MAX && at < len; n++, at += piece) {
+            iov[n].base = &buf[at];
+            iov[n].len = len - at < piece ? len - at : piece;
+        }
+        if (platformWriteFile(f, iov, n) == -1)
+            return -1;
+    }
+    double t1 = now();
+    if (platformCommitFile(f) == -1)
+        return -1;
+    secs[0] = t1 - t0;
+    secs[1] = now() - t1;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/save.bin", argc > 1 ? argv[1] : ".");
+    size_t most = (size_t)512 << 20;
+    char *buf = malloc(most);
+    for (size_t i = 0; i < most; i++)
+        buf[i] = i % 61 == 60 ? '\n' : 'a' + i % 26;
+
+#ifndef PLATFORM_IO_URING
+    printf("built without io_uring: both rows are writev()\n");
+#endif
+    printf("%6s %8s %9s %8s %8s %8s\n", "MB", "buffers", "backend", "write", "commit", "MB/s");
+    for (size_t len = (size_t)64 << 20; len <= most; len *= 8) {
+        for (int p = 0; p < 2; p++) {
+            for (int ring = 1; ring >= 0; ring--) {
+#ifdef PLATFORM_IO_URING
+                platformRingBroken = !ring;
+#endif
+                double best[2] = { 1e9, 1e9 };
+                for (int rep = 0; rep < 3; rep++) {
+                    double secs[2];
+                    if (save(path, buf, len, p ? BENCH_PIECE : 0, secs) == -1) {
+                        perror(path);
+                        return 1;
+                    }
+                    if (secs[0] + secs[1] < best[0] + best[1]) {
+                        best[0] = secs[0];
+                        best[1] = secs[1];
+                    }
+                }
+                printf("%6zu %8s %9s %6.0fms %6.0fms %8.0f\n", len >> 20, p ? "64K" : "one",
+                    ring ? "io_uring" : "writev", best[0] * 1e3, best[1] * 1e3,
+                    len / 1e6 / (best[0] + best[1]));
+            }
+        }
+    }
+    remove(path);
+    free(buf);
+    return 0;
+}
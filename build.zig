@@ -15,6 +15,10 @@ pub fn build(b: *std.Build) void {
         .root_module = mod,
     });
 
+    // gzip files are read and written with the system's zlib, where there
+    // is one to link.
+    const zlib = target.result.os.tag != .windows;
+
     const flags: []const []const u8 = if (target.result.os.tag == .windows)
         &.{
             // for getline
@@ -22,10 +26,15 @@ pub fn build(b: *std.Build) void {
             // "-D_GNU_SOURCE",
         }
     else
-        &.{};
+        &.{"-DKILO_HAVE_ZLIB"};
 
     const srcs = [_][]const u8{
+        "repos/taidanh/journal.c",
         "repos/taidanh/kilo.c",
+        "repos/taidanh/lineindex.c",
+        "repos/taidanh/rowtree.c",
+        "repos/taidanh/screen.c",
+        "repos/taidanh/slab.c",
     };
     const platform = if (target.result.os.tag == .windows)
         [_][]const u8{
@@ -41,6 +50,13 @@ pub fn build(b: *std.Build) void {
         .files = &(srcs ++ platform),
         .flags = flags,
     });
+    if (zlib) {
+        exe.addCSourceFiles(.{
+            .files = &.{"repos/taidanh/gzfile.c"},
+            .flags = flags,
+        });
+        exe.linkSystemLibrary("z");
+    }
     exe.linkLibC();
     exe.addIncludePath(b.path("repos/_mod"));
     exe.addIncludePath(b.path("repos/taidanh"));
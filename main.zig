@@ -5,23 +5,60 @@ const c = @cImport({
 });
 
 pub fn main() void {
+    // -R pages through the file read-only, keeping about KILO_PAGER_CAP
+    // bytes of it in memory, or as many megabytes as follow, as in -R256.
+    // -F30 draws at most 30 frames a second rather than KILO_FPS.
+    var arg: usize = 1;
+    var pager: usize = 0;
+    var fps: c_int = c.KILO_FPS;
+    while (std.os.argv.len > arg) : (arg += 1) {
+        const opt = std.mem.span(std.os.argv[arg]);
+        if (std.mem.startsWith(u8, opt, "-R")) {
+            pager = if (opt.len == 2) c.KILO_PAGER_CAP else (std.fmt.parseInt(usize, opt[2..], 10) catch 0) << 20;
+            if (pager == 0) {
+                std.debug.print("kilo: -R takes a size in megabytes, such as -R256\n", .{});
+                std.process.exit(1);
+            }
+        } else if (std.mem.startsWith(u8, opt, "-F")) {
+            fps = std.fmt.parseInt(c_int, opt[2..], 10) catch 0;
+            if (fps <= 0 or fps > 1000) {
+                std.debug.print("kilo: -F takes frames a second, such as -F30\n", .{});
+                std.process.exit(1);
+            }
+        } else break;
+    }
+
+    // With "-" the text comes from standard input, and keys from the
+    // terminal instead.
+    var stream: ?*c.struct_platformStream = null;
+    if (std.os.argv.len > arg and std.mem.eql(u8, std.mem.span(std.os.argv[arg]), "-")) {
+        stream = c.platformOpenStdin();
+        if (stream == null) {
+            std.debug.print("kilo: can't read standard input\n", .{});
+            std.process.exit(1);
+        }
+    }
+
     _ = c.enableRawMode(0);
 
     var E = c.editorConfig{};
 
     c.initEditor(&E);
-    if (std.os.argv.len >= 2) {
-        c.editorOpen(&E, std.os.argv[1]);
+    E.pager = pager;
+    E.fps = fps;
+    if (stream) |s| {
+        c.editorOpenStream(&E, s);
+    } else if (std.os.argv.len > arg) {
+        c.editorOpen(&E, std.os.argv[arg]);
     }
 
-    c.editorSetStatusMessage(&E, "HELP: Ctrl-S = save | Ctrl-Q = quit | Ctrl-F = find");
+    // Keep a message from opening the file, such as recovered edits.
+    if (E.statusmsg[0] == 0) {
+        c.editorSetStatusMessage(&E, "HELP: Ctrl-S = save | Ctrl-Q = quit | Ctrl-F = find | Ctrl-G = go to line");
+    }
 
     while (true) {
         c.editorRefreshScreen(&E);
-        if (E.mode == c.MODE_NORMAL) {
-            c.editorNormalProcessKeypress(&E);
-        } else {
-            c.editorProcessKeypress(&E);
-        }
+        c.editorProcessInput(&E);
     }
 }
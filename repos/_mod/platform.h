@@ -1,6 +1,7 @@
 #ifndef PLATFORM_H
 #define PLATFORM_H
 
+#include <stddef.h>
 #include <time.h>
 
 enum KEY_ACTION{
@@ -27,23 +28,45 @@ enum KEY_ACTION{
         HOME_KEY,
         END_KEY,
         PAGE_UP,
-        PAGE_DOWN
+        PAGE_DOWN,
+        PASTE_START         /* Pasted text follows, see editorReadPaste(). */
 };
 
 void editorAtExit(void);
 void handleSigWinCh(int unused __attribute__((unused)));
 
+struct rtNode;
+
+/* A run of rendered columns with a highlight other than HL_NORMAL. */
+typedef struct hlspan {
+    unsigned int start;
+    unsigned int len : 24;
+    unsigned int hl : 8;
+} hlspan;
+
 /* This structure represents a single line of the file we are editing. */
 typedef struct erow {
-    int idx;            /* Row index in the file, zero-based. */
+    struct rtNode *leaf; /* Row tree leaf holding this row. */
     int size;           /* Size of the row, excluding the null term. */
     int rsize;          /* Size of the rendered row. */
     char *chars;        /* Row content. */
+    int gap_at;         /* Offset of the gap in chars while being edited. */
+    int gap;            /* Size of that gap, 0 when chars is compact. */
     char *render;       /* Row content "rendered" for screen (for TABs). */
-    unsigned char *hl;  /* Syntax highlight type for each character in render.*/
+    unsigned char *hl;  /* Highlight type of each character in render, kept
+                           only while the row is being edited. */
+    struct hlspan *spans; /* Highlighted runs of render otherwise. */
+    int nspans;         /* Number of spans. */
+    int rcap;           /* Allocated size of render and hl. */
+    int cslot;          /* Render cache slot + 1, 0 while render is NULL. */
+    int hl_in;          /* Comment state hl was computed from. */
     int hl_oc;          /* Row had open comment at end in last syntax highlight
                            check. */
     int hl_open_comment;
+    int mapped;         /* chars points into the mapped file: read-only and
+                           not terminated. */
+    int cont;           /* No newline follows: the row is a piece of a line
+                           too long for one, see LI_LINE_MAX. */
 } erow;
 
 void initResizeSignal();
@@ -55,9 +78,163 @@ int enableRawMode(int fd);
 
 int getInput(int fd);
 
+/* Wait up to 'ms' milliseconds for a key, or only look with 0. Returns 1 if
+ * one is waiting. */
+int platformKeyWait(int ms);
+
+/* Milliseconds on a clock that never goes back. */
+long long platformClock(void);
+
 /* Try to get the number of columns in the current terminal. If the ioctl()
  * call fails the function will try to query the terminal itself.
  * Returns 0 on success, -1 on error. */
 int getWindowSize(int ifd, int ofd, int *rows, int *cols);
 
+/* Map the file at 'path' read-only and store its size at *len. Returns the
+ * mapping, or NULL with errno set on error. */
+char *platformMapFile(const char *path, size_t *len);
+
+void platformUnmapFile(char *map, size_t len);
+
+/* Turn a mapping from platformMapFile() into memory of its own at the same
+ * address, holding what the mapping showed, so it no longer changes with
+ * the file. Where the file was cut short it holds zeros. The mapping is
+ * still let go with platformUnmapFile(). Returns 0, or -1 if the mapping
+ * is left as it was. */
+int platformMapDetach(char *map, size_t len);
+
+/* Let the pages wholly inside [p, p + len) of a read-only mapping, or of a
+ * spool, go from memory. They are read back in when next touched. */
+void platformDropPages(const char *p, size_t len);
+
+/* Saving: the new contents are written to a temporary file next to the
+ * original, flushed to disk and renamed over it, so a crash leaves either
+ * the old file or the new one. */
+struct platformFile;
+
+#define PLATFORM_IOV_MAX 256 /* Most buffers per platformWriteFile() call. */
+
+struct platformIov {
+    const char *base;
+    size_t len;
+};
+
+/* Start writing a replacement for the file at 'path', keeping its mode.
+ * Returns NULL with errno set on error. */
+struct platformFile *platformCreateReplacement(const char *path);
+
+/* Write all of iov[0, n). On Linux large writes are split over several
+ * kept in flight with io_uring where the kernel allows it. Returns 0, or
+ * -1 with errno set. */
+int platformWriteFile(struct platformFile *f, const struct platformIov *iov, int n);
+
+/* Flush the replacement and move it over the original, releasing 'f'.
+ * Returns 0, or -1 with errno set and the original left alone. */
+int platformCommitFile(struct platformFile *f);
+
+/* Drop the replacement, releasing 'f' without touching errno. */
+void platformAbortFile(struct platformFile *f);
+
+/* Open the file at 'path' for appending, creating it, and emptying it
+ * first with 'truncate' set. Returns NULL with errno set on error. */
+struct platformFile *platformOpenAppend(const char *path, int truncate);
+
+/* Open the existing file at 'path' to write over part of it in place.
+ * Returns NULL with errno set on error. */
+struct platformFile *platformOpenFile(const char *path);
+
+/* Move to byte 'off' of a file opened with platformOpenFile, cut it to
+ * 'len' bytes, or flush it to disk. Each returns 0, or -1 with errno set. */
+int platformSeekFile(struct platformFile *f, long long off);
+int platformTruncateFile(struct platformFile *f, long long len);
+int platformSyncFile(struct platformFile *f);
+
+/* Close a file opened with platformOpenAppend or platformOpenFile. */
+void platformCloseFile(struct platformFile *f);
+
+/* Size and modification time, in nanoseconds, of the file at 'path', to
+ * tell whether it changed. Returns 0, or -1 with errno set. */
+int platformFileStamp(const char *path, long long *size, long long *mtime);
+
+struct platformWatch;
+
+#define PLATFORM_WATCH_CHANGED 1 /* Written to, or its size changed. */
+#define PLATFORM_WATCH_REPLACED 2 /* The path names another file now, or none. */
+
+/* Watch the file at 'path' for changes, with inotify where there is one
+ * and by checking it on every poll otherwise. Returns NULL with errno set
+ * on error. */
+struct platformWatch *platformWatchFile(const char *path);
+
+/* Return what happened to the file since the last poll, without waiting,
+ * along with its size and modification time in nanoseconds. */
+int platformWatchPoll(struct platformWatch *w, long long *size, long long *mtime);
+
+/* Read up to 'len' bytes at 'off' of the file being watched, which stays
+ * the one first opened even if replaced. Returns the bytes read, or -1
+ * with errno set. */
+long long platformWatchRead(struct platformWatch *w, long long off, char *buf, size_t len);
+
+void platformWatchClose(struct platformWatch *w);
+
+/* Text to edit read from standard input, such as a pipe, while keys come
+ * from the terminal. */
+struct platformStream;
+
+/* Take standard input over as a stream of text and point it at the
+ * terminal instead, for keys; call before enableRawMode(). Returns NULL
+ * with errno set, ENOTTY if standard input is the terminal itself. */
+struct platformStream *platformOpenStdin(void);
+
+/* Read up to 'len' bytes of what arrived, without waiting. Returns the
+ * bytes read, 0 at the end of the stream, or -1 with errno set, EAGAIN
+ * when nothing is there yet. */
+long long platformStreamRead(struct platformStream *s, char *buf, size_t len);
+
+/* Wait up to 'ms' milliseconds for more of the stream or for a key.
+ * Returns 1 if a key is waiting. */
+int platformStreamWait(struct platformStream *s, int ms);
+
+/* Closing a stream fed by a thread, see platformStartStream(), waits for
+ * the thread to return. */
+void platformStreamClose(struct platformStream *s);
+
+/* A stream fed from within the process: fn(feed, arg) runs on a thread of
+ * its own and hands text over with platformFeedWrite(). The stream ends
+ * when fn returns; an error number it returns is what the last
+ * platformStreamRead() fails with instead of returning 0. Returns NULL with
+ * errno set, fn never having run, on error. */
+struct platformFeed;
+
+struct platformStream *platformStartStream(int (*fn)(struct platformFeed *, void *), void *arg);
+
+/* Hand 'len' bytes to the stream, waiting while it is full. Returns 0, or
+ * -1 with errno set, EPIPE once the stream was closed. */
+int platformFeedWrite(struct platformFeed *f, const char *p, size_t len);
+
+/* A temporary file that only grows, mapped at a fixed address with room
+ * for 'cap' bytes, so what was written stays where it is and can be
+ * pointed into like a mapped file. Returns NULL with errno set on error,
+ * or the spool with its mapping at *map. */
+struct platformSpool;
+
+struct platformSpool *platformSpoolCreate(size_t cap, char **map);
+
+/* Add 'len' bytes at the end, up to the room reserved. Returns 0, or -1
+ * with errno set. */
+int platformSpoolWrite(struct platformSpool *s, const char *p, size_t len);
+
+void platformSpoolClose(struct platformSpool *s);
+
+struct platformThread;
+
+/* Run fn(arg) on a new thread. Returns NULL on error. */
+struct platformThread *platformStartThread(void (*fn)(void *), void *arg);
+
+/* Wait for a thread to return and release it. */
+void platformJoinThread(struct platformThread *t);
+
+/* Number of CPUs available to the process, at least 1. */
+int platformCpuCount(void);
+
 #endif
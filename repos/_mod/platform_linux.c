@@ -1,12 +1,32 @@
 #include "platform.h"
+#include <sys/inotify.h>
 #include <sys/ioctl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <termios.h>
 #include <errno.h>
+#include <stdint.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <libgen.h>
+
+/* Large writes go through io_uring where the kernel headers have it, and
+ * the kernel lets it be used; define PLATFORM_NO_IO_URING to leave it out. */
+#if !defined(PLATFORM_NO_IO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define PLATFORM_IO_URING
+#endif
+#endif
 
 extern struct editorConfig E;
 
@@ -20,6 +40,7 @@ void initResizeSignal()
 void disableRawMode(int fd) {
   /* Don't even check the return value as it's too late. */
   if (E.rawmode) {
+    write(STDOUT_FILENO, "\x1b[?2004l", 8);
     tcsetattr(fd, TCSAFLUSH, &orig_termios);
     E.rawmode = 0;
   }
@@ -55,6 +76,8 @@ int enableRawMode(int fd) {
   /* put terminal in raw mode after flushing */
   if (tcsetattr(fd, TCSAFLUSH, &raw) < 0)
     goto fatal;
+  /* Have pastes bracketed, so they can go in whole, see editorReadPaste(). */
+  write(STDOUT_FILENO, "\x1b[?2004h", 8);
   E.rawmode = 1;
   return 0;
 fatal:
@@ -129,3 +152,870 @@ int getInput(int fd) {
   }
   return c;
 }
+
+int platformKeyWait(int ms) {
+  struct pollfd fd = { STDIN_FILENO, POLLIN, 0 };
+  return poll(&fd, 1, ms) > 0 && (fd.revents & POLLIN);
+}
+
+long long platformClock(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (long long)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+/* Mappings of files in use. A file truncated under its mapping raises
+ * SIGBUS where the mapping goes past its new end; the handler maps zeros
+ * from there to the end of the mapping, so what was cut off reads as zeros
+ * instead of killing the editor. The editor notices the file changed when
+ * it next polls, see platformMapDetach(). */
+#define PLATFORM_MAPS 16
+
+static struct {
+  char *map;
+  size_t len;
+} maps[PLATFORM_MAPS];
+static uintptr_t mapPage;
+
+static void mapSigBus(int sig, siginfo_t *info, void *ctx) {
+  char *at = info->si_addr;
+  for (int i = 0; i < PLATFORM_MAPS; i++) {
+    char *map = __atomic_load_n(&maps[i].map, __ATOMIC_ACQUIRE);
+    if (map == NULL || at < map || at >= map + maps[i].len)
+      continue;
+    char *from = (char *)((uintptr_t)at & ~(mapPage - 1));
+    if (mmap(from, map + maps[i].len - from, PROT_READ,
+             MAP_PRIVATE | MAP_FIXED | MAP_ANONYMOUS, -1, 0) != MAP_FAILED)
+      return;
+    break;
+  }
+  /* Not a mapping of ours: fault again, and die of it as usual. */
+  signal(SIGBUS, SIG_DFL);
+}
+
+static void mapAdd(char *map, size_t len) {
+  static int installed;
+  if (!installed) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = mapSigBus;
+    sa.sa_flags = SA_SIGINFO;
+    sigemptyset(&sa.sa_mask);
+    mapPage = sysconf(_SC_PAGESIZE);
+    sigaction(SIGBUS, &sa, NULL);
+    installed = 1;
+  }
+  /* Files are only mapped on the main thread, so no two take a slot. */
+  for (int i = 0; i < PLATFORM_MAPS; i++) {
+    if (__atomic_load_n(&maps[i].map, __ATOMIC_ACQUIRE) == NULL) {
+      maps[i].len = len;
+      __atomic_store_n(&maps[i].map, map, __ATOMIC_RELEASE);
+      return;
+    }
+  }
+}
+
+static void mapRemove(char *map) {
+  for (int i = 0; i < PLATFORM_MAPS; i++) {
+    if (__atomic_load_n(&maps[i].map, __ATOMIC_ACQUIRE) == map) {
+      __atomic_store_n(&maps[i].map, NULL, __ATOMIC_RELEASE);
+      return;
+    }
+  }
+}
+
+char *platformMapFile(const char *path, size_t *len) {
+  static char empty[1];
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+  if (fd == -1)
+    return NULL;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return NULL;
+  }
+  *len = st.st_size;
+  /* mmap() refuses empty mappings. */
+  char *map = empty;
+  if (*len) {
+    map = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+      map = NULL;
+    else
+      mapAdd(map, *len);
+  }
+  close(fd);
+  return map;
+}
+
+void platformUnmapFile(char *map, size_t len) {
+  if (len) {
+    mapRemove(map);
+    munmap(map, len);
+  }
+}
+
+int platformMapDetach(char *map, size_t len) {
+  if (len == 0)
+    return 0;
+  char *copy = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (copy == MAP_FAILED)
+    return -1;
+  /* Past the end of a truncated file this reads the handler's zeros. */
+  memcpy(copy, map, len);
+  int ok = mmap(map, len, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_FIXED | MAP_ANONYMOUS, -1, 0) != MAP_FAILED;
+  if (ok) {
+    mapRemove(map);
+    memcpy(map, copy, len);
+    mprotect(map, len, PROT_READ);
+  }
+  munmap(copy, len);
+  return ok ? 0 : -1;
+}
+
+void platformDropPages(const char *p, size_t len) {
+  uintptr_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t lo = ((uintptr_t)p + page - 1) & ~(page - 1);
+  uintptr_t hi = ((uintptr_t)p + len) & ~(page - 1);
+  if (lo < hi)
+    madvise((void *)lo, hi - lo, MADV_DONTNEED);
+}
+
+struct platformRing;
+
+struct platformFile {
+  int fd;
+  char *path; /* File being replaced, symlinks resolved. */
+  char *tmp;
+  int append; /* Opened to append, so writes can't be placed. */
+  struct platformRing *ring; /* Set up on the first large write, or NULL. */
+};
+
+static void platformRingFree(struct platformRing *r);
+
+static void platformFreeFile(struct platformFile *f) {
+  platformRingFree(f->ring);
+  free(f->path);
+  free(f->tmp);
+  free(f);
+}
+
+struct platformFile *platformCreateReplacement(const char *path) {
+  struct platformFile *f = malloc(sizeof(*f));
+  /* Replace what a symlink points to rather than the link. */
+  f->path = realpath(path, NULL);
+  if (f->path == NULL)
+    f->path = strdup(path);
+  f->append = 0;
+  f->ring = NULL;
+  f->tmp = malloc(strlen(f->path) + sizeof(".kilo-XXXXXX"));
+  sprintf(f->tmp, "%s.kilo-XXXXXX", f->path);
+  f->fd = mkstemp(f->tmp);
+  if (f->fd == -1) {
+    int err = errno;
+    platformFreeFile(f);
+    errno = err;
+    return NULL;
+  }
+
+  /* mkstemp() creates the file 0600; give it the mode the original has,
+   * or a new file would get. */
+  struct stat st;
+  mode_t mode;
+  if (stat(f->path, &st) == 0) {
+    mode = st.st_mode & 07777;
+  } else {
+    mode_t mask = umask(0);
+    umask(mask);
+    mode = 0666 & ~mask;
+  }
+  fchmod(f->fd, mode);
+  return f;
+}
+
+#ifdef PLATFORM_IO_URING
+#define PLATFORM_RING_DEPTH 8 /* Writes kept in flight. */
+#define PLATFORM_RING_CHUNK (2 << 20) /* Bytes per write. */
+#define PLATFORM_RING_IOVS 64 /* Buffers per write. */
+#define PLATFORM_RING_MIN (4 << 20) /* Smaller writes are done in one call. */
+#define PLATFORM_RING_FLUSH (1ULL << 63) /* Tags the writeback following a write. */
+
+/* An io_uring instance, driven with the raw system calls. Each slot holds
+ * the buffers of one write in flight. */
+struct platformRing {
+  int fd;
+  void *sq, *cq;
+  size_t sqlen, cqlen;
+  struct io_uring_sqe *sqes;
+  size_t sqeslen;
+  unsigned *sqhead, *sqtail, *sqmask, *sqarray;
+  unsigned *cqhead, *cqtail, *cqmask;
+  struct io_uring_cqe *cqes;
+  struct platformRingSlot {
+    struct iovec v[PLATFORM_RING_IOVS];
+    int n;
+    size_t len;
+    long long off;
+  } slot[PLATFORM_RING_DEPTH];
+  int free[PLATFORM_RING_DEPTH], nfree;
+};
+
+static int platformRingBroken; /* One failed to set up or run; don't try again. */
+
+static struct platformRing *platformRingNew(void) {
+  if (__atomic_load_n(&platformRingBroken, __ATOMIC_RELAXED))
+    return NULL;
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  int fd = syscall(__NR_io_uring_setup, 2 * PLATFORM_RING_DEPTH, &p);
+  if (fd == -1) {
+    __atomic_store_n(&platformRingBroken, 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  struct platformRing *r = calloc(1, sizeof(*r));
+  r->fd = fd;
+  r->sqlen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  r->cqlen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  r->sqeslen = p.sq_entries * sizeof(struct io_uring_sqe);
+  r->sq = mmap(NULL, r->sqlen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  r->cq = mmap(NULL, r->cqlen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+  r->sqes = mmap(NULL, r->sqeslen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (r->sq == MAP_FAILED || r->cq == MAP_FAILED || r->sqes == MAP_FAILED) {
+    platformRingFree(r);
+    __atomic_store_n(&platformRingBroken, 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  r->sqhead = (unsigned *)((char *)r->sq + p.sq_off.head);
+  r->sqtail = (unsigned *)((char *)r->sq + p.sq_off.tail);
+  r->sqmask = (unsigned *)((char *)r->sq + p.sq_off.ring_mask);
+  r->sqarray = (unsigned *)((char *)r->sq + p.sq_off.array);
+  r->cqhead = (unsigned *)((char *)r->cq + p.cq_off.head);
+  r->cqtail = (unsigned *)((char *)r->cq + p.cq_off.tail);
+  r->cqmask = (unsigned *)((char *)r->cq + p.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe *)((char *)r->cq + p.cq_off.cqes);
+  for (int i = 0; i < PLATFORM_RING_DEPTH; i++)
+    r->free[i] = i;
+  r->nfree = PLATFORM_RING_DEPTH;
+  return r;
+}
+
+static void platformRingFree(struct platformRing *r) {
+  if (r == NULL)
+    return;
+  if (r->sq && r->sq != MAP_FAILED)
+    munmap(r->sq, r->sqlen);
+  if (r->cq && r->cq != MAP_FAILED)
+    munmap(r->cq, r->cqlen);
+  if (r->sqes && r->sqes != MAP_FAILED)
+    munmap(r->sqes, r->sqeslen);
+  close(r->fd);
+  free(r);
+}
+
+/* Write all of v[0, n) at 'off', going on after short writes. */
+static int platformPwriteAll(int fd, struct iovec *v, int n, long long off) {
+  while (n > 0) {
+    ssize_t done = pwritev(fd, v, n, off);
+    if (done == -1) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    off += done;
+    while (n > 0 && (size_t)done >= v->iov_len) {
+      done -= v->iov_len;
+      v++;
+      n--;
+    }
+    if (n > 0) {
+      v->iov_base = (char *)v->iov_base + done;
+      v->iov_len -= done;
+    }
+  }
+  return 0;
+}
+
+/* Queue the write in slot 's', followed by starting writeback of what it
+ * wrote, so the disk is busy while later writes are still being copied
+ * and the final fsync has less left to do. Returns the entries queued. */
+static int platformRingQueue(struct platformRing *r, int fd, int s) {
+  unsigned tail = *r->sqtail;
+  struct platformRingSlot *slot = &r->slot[s];
+  for (int k = 0; k < 2; k++) {
+    unsigned at = (tail + k) & *r->sqmask;
+    struct io_uring_sqe *sqe = &r->sqes[at];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = fd;
+    sqe->off = slot->off;
+    if (k == 0) {
+      sqe->opcode = IORING_OP_WRITEV;
+      sqe->flags = IOSQE_IO_LINK;
+      sqe->addr = (unsigned long)slot->v;
+      sqe->len = slot->n;
+      sqe->user_data = s;
+    } else {
+      sqe->opcode = IORING_OP_SYNC_FILE_RANGE;
+      sqe->len = slot->len;
+      sqe->sync_range_flags = SYNC_FILE_RANGE_WRITE;
+      sqe->user_data = PLATFORM_RING_FLUSH;
+    }
+    r->sqarray[at] = at;
+  }
+  __atomic_store_n(r->sqtail, tail + 2, __ATOMIC_RELEASE);
+  return 2;
+}
+
+/* Take the completions posted so far, freeing the slots of the writes.
+ * A write cut short is finished synchronously. The first error is left in
+ * *err. Returns the writes that finished. */
+static int platformRingComplete(struct platformRing *r, int fd, int *err) {
+  int finished = 0;
+  unsigned head = *r->cqhead;
+  unsigned tail = __atomic_load_n(r->cqtail, __ATOMIC_ACQUIRE);
+  for (; head != tail; head++) {
+    struct io_uring_cqe *cqe = &r->cqes[head & *r->cqmask];
+    /* Writeback only hurries the fsync along; how it went is of no
+     * interest. */
+    if (cqe->user_data == PLATFORM_RING_FLUSH)
+      continue;
+    struct platformRingSlot *s = &r->slot[cqe->user_data];
+    if (cqe->res < 0) {
+      if (*err == 0)
+        *err = -cqe->res;
+    } else if ((size_t)cqe->res < s->len) {
+      /* Skip what was written and do the rest here. */
+      struct iovec *v = s->v;
+      int n = s->n;
+      size_t done = cqe->res;
+      while (n > 0 && done >= v->iov_len) {
+        done -= v->iov_len;
+        v++;
+        n--;
+      }
+      v->iov_base = (char *)v->iov_base + done;
+      v->iov_len -= done;
+      if (platformPwriteAll(fd, v, n, s->off + cqe->res) == -1 && *err == 0)
+        *err = errno;
+    }
+    r->free[r->nfree++] = cqe->user_data;
+    finished++;
+  }
+  __atomic_store_n(r->cqhead, head, __ATOMIC_RELEASE);
+  return finished;
+}
+
+/* Submit 'submit' queued entries and wait for at least 'wait' writes to
+ * finish. Returns 0, or -1 with errno set if io_uring_enter() failed,
+ * leaving writes that may be neither submitted nor finished; see
+ * platformRingDrain(). */
+static int platformRingReap(struct platformRing *r, int fd, int submit, int wait, int *err) {
+  while (submit > 0 || wait > 0) {
+    int res = syscall(__NR_io_uring_enter, r->fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (res == -1) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    submit -= res;
+    int done = platformRingComplete(r, fd, err);
+    wait = wait > done ? wait - done : 0;
+  }
+  return 0;
+}
+
+/* After io_uring_enter() failed, make sure no write reads the caller's
+ * buffers any more: entries the kernel has not taken are taken back, and
+ * the writes it did take are waited for. Should waiting fail too, the
+ * completions are polled for, as the kernel posts them either way. */
+static void platformRingDrain(struct platformRing *r, int fd, int *err) {
+  unsigned head = __atomic_load_n(r->sqhead, __ATOMIC_ACQUIRE);
+  for (unsigned t = *r->sqtail; t != head; t--) {
+    struct io_uring_sqe *sqe = &r->sqes[r->sqarray[(t - 1) & *r->sqmask]];
+    if (sqe->user_data != PLATFORM_RING_FLUSH)
+      r->free[r->nfree++] = sqe->user_data;
+  }
+  __atomic_store_n(r->sqtail, head, __ATOMIC_RELEASE);
+  while (r->nfree < PLATFORM_RING_DEPTH) {
+    if (platformRingReap(r, fd, 0, 1, err) == -1 && platformRingComplete(r, fd, err) == 0)
+      usleep(1000);
+  }
+}
+
+/* Write iov[0, n) from the file offset on as several writes in flight at
+ * once, each of up to PLATFORM_RING_CHUNK bytes from up to
+ * PLATFORM_RING_IOVS buffers, and leave the offset past the end. Returns
+ * 0, or -1 with errno set; 1 if the ring could not be used, with the
+ * offset where it was. */
+static int platformRingWrite(struct platformFile *f, const struct platformIov *iov, int n) {
+  struct platformRing *r = f->ring;
+  long long start = lseek(f->fd, 0, SEEK_CUR), off = start;
+  if (off == -1)
+    return 1;
+  int err = 0, queued = 0, failed = 0;
+  int i = 0;
+  size_t skip = 0; /* Bytes of iov[i] already in a write. */
+  while (i < n && err == 0 && !failed) {
+    if (r->nfree == 0) {
+      failed = platformRingReap(r, f->fd, queued, 1, &err) == -1;
+      queued = 0;
+      continue;
+    }
+    int s = r->free[--r->nfree];
+    struct platformRingSlot *slot = &r->slot[s];
+    slot->n = 0;
+    slot->len = 0;
+    slot->off = off;
+    while (i < n && slot->n < PLATFORM_RING_IOVS && slot->len < PLATFORM_RING_CHUNK) {
+      size_t len = iov[i].len - skip;
+      if (len > PLATFORM_RING_CHUNK - slot->len)
+        len = PLATFORM_RING_CHUNK - slot->len;
+      slot->v[slot->n].iov_base = (char *)iov[i].base + skip;
+      slot->v[slot->n].iov_len = len;
+      slot->n++;
+      slot->len += len;
+      skip += len;
+      if (skip == iov[i].len) {
+        i++;
+        skip = 0;
+      }
+    }
+    off += slot->len;
+    queued += platformRingQueue(r, f->fd, s);
+  }
+  /* Wait for every write, as the caller may reuse its buffers. */
+  if (!failed)
+    failed = platformRingReap(r, f->fd, queued, PLATFORM_RING_DEPTH - r->nfree, &err) == -1;
+  if (failed) {
+    /* The ring failed rather than a write: the file is written again
+     * without it, this time and from now on. */
+    platformRingDrain(r, f->fd, &err);
+    platformRingFree(r);
+    f->ring = NULL;
+    __atomic_store_n(&platformRingBroken, 1, __ATOMIC_RELAXED);
+    if (err == 0)
+      return lseek(f->fd, start, SEEK_SET) == -1 ? -1 : 1;
+  }
+  if (err == 0 && lseek(f->fd, off, SEEK_SET) == -1)
+    err = errno;
+  if (err) {
+    errno = err;
+    return -1;
+  }
+  return 0;
+}
+#else
+static void platformRingFree(struct platformRing *r) {
+  (void)r;
+}
+#endif
+
+int platformWriteFile(struct platformFile *f, const struct platformIov *iov, int n) {
+#ifdef PLATFORM_IO_URING
+  size_t total = 0;
+  for (int i = 0; i < n; i++)
+    total += iov[i].len;
+  if (total >= PLATFORM_RING_MIN && !f->append) {
+    if (f->ring == NULL)
+      f->ring = platformRingNew();
+    if (f->ring) {
+      int res = platformRingWrite(f, iov, n);
+      if (res != 1)
+        return res;
+    }
+  }
+#endif
+  struct iovec v[PLATFORM_IOV_MAX];
+  for (int i = 0; i < n; i++) {
+    v[i].iov_base = (void *)iov[i].base;
+    v[i].iov_len = iov[i].len;
+  }
+  struct iovec *p = v;
+  while (n > 0) {
+    ssize_t done = writev(f->fd, p, n);
+    if (done == -1) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    /* Skip what was written and go on from a short write. */
+    while (n > 0 && (size_t)done >= p->iov_len) {
+      done -= p->iov_len;
+      p++;
+      n--;
+    }
+    if (n > 0) {
+      p->iov_base = (char *)p->iov_base + done;
+      p->iov_len -= done;
+    }
+  }
+  return 0;
+}
+
+int platformCommitFile(struct platformFile *f) {
+  int res = fsync(f->fd);
+  if (res == -1) {
+    platformAbortFile(f);
+    return -1;
+  }
+  res = close(f->fd);
+  f->fd = -1;
+  if (res == -1 || rename(f->tmp, f->path) == -1) {
+    platformAbortFile(f);
+    return -1;
+  }
+
+  /* Make the rename itself durable. */
+  char *dir = strdup(f->path);
+  int dfd = open(dirname(dir), O_RDONLY);
+  if (dfd != -1) {
+    fsync(dfd);
+    close(dfd);
+  }
+  free(dir);
+  platformFreeFile(f);
+  return 0;
+}
+
+void platformAbortFile(struct platformFile *f) {
+  int err = errno;
+  if (f->fd != -1)
+    close(f->fd);
+  unlink(f->tmp);
+  platformFreeFile(f);
+  errno = err;
+}
+
+struct platformFile *platformOpenAppend(const char *path, int truncate) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | (truncate ? O_TRUNC : 0), 0600);
+  if (fd == -1)
+    return NULL;
+  struct platformFile *f = malloc(sizeof(*f));
+  f->fd = fd;
+  f->path = strdup(path);
+  f->tmp = NULL;
+  f->append = 1;
+  f->ring = NULL;
+  return f;
+}
+
+struct platformFile *platformOpenFile(const char *path) {
+  int fd = open(path, O_WRONLY);
+  if (fd == -1)
+    return NULL;
+  struct platformFile *f = malloc(sizeof(*f));
+  f->fd = fd;
+  f->path = strdup(path);
+  f->tmp = NULL;
+  f->append = 0;
+  f->ring = NULL;
+  return f;
+}
+
+int platformSeekFile(struct platformFile *f, long long off) {
+  return lseek(f->fd, off, SEEK_SET) == -1 ? -1 : 0;
+}
+
+int platformTruncateFile(struct platformFile *f, long long len) {
+  return ftruncate(f->fd, len);
+}
+
+int platformSyncFile(struct platformFile *f) {
+  return fsync(f->fd);
+}
+
+void platformCloseFile(struct platformFile *f) {
+  close(f->fd);
+  platformFreeFile(f);
+}
+
+int platformFileStamp(const char *path, long long *size, long long *mtime) {
+  struct stat st;
+  if (stat(path, &st) == -1)
+    return -1;
+  *size = st.st_size;
+  *mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+  return 0;
+}
+
+struct platformWatch {
+  int fd; /* The file, open for reading. */
+  int ino; /* inotify instance, or -1 to compare sizes on each poll. */
+  char *path;
+  long long size; /* Size at the last poll. */
+};
+
+struct platformWatch *platformWatchFile(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1)
+    return NULL;
+  struct platformWatch *w = malloc(sizeof(*w));
+  w->fd = fd;
+  w->path = strdup(path);
+  w->size = -1;
+  w->ino = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (w->ino != -1 && inotify_add_watch(w->ino, path, IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF) == -1) {
+    close(w->ino);
+    w->ino = -1;
+  }
+  return w;
+}
+
+int platformWatchPoll(struct platformWatch *w, long long *size, long long *mtime) {
+  int events = 0;
+  if (w->ino != -1) {
+    /* Only whether anything happened matters, not what. */
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (read(w->ino, buf, sizeof(buf)) > 0)
+      events = 1;
+    if (!events && w->size != -1)
+      return 0;
+  }
+
+  struct stat st, now;
+  if (fstat(w->fd, &st) == -1)
+    return 0;
+  *size = st.st_size;
+  *mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+  events = 0;
+  if (st.st_size != w->size)
+    events |= PLATFORM_WATCH_CHANGED;
+  w->size = st.st_size;
+  if (stat(w->path, &now) == -1 || now.st_ino != st.st_ino || now.st_dev != st.st_dev)
+    events |= PLATFORM_WATCH_REPLACED;
+  return events;
+}
+
+long long platformWatchRead(struct platformWatch *w, long long off, char *buf, size_t len) {
+  ssize_t n;
+  do
+    n = pread(w->fd, buf, len, off);
+  while (n == -1 && errno == EINTR);
+  return n;
+}
+
+void platformWatchClose(struct platformWatch *w) {
+  close(w->fd);
+  if (w->ino != -1)
+    close(w->ino);
+  free(w->path);
+  free(w);
+}
+
+struct platformStream {
+  int fd;
+  struct platformFeed *feed; /* Set for a stream fed by a thread. */
+};
+
+struct platformFeed {
+  int fd;
+  int err; /* What fn returned, set before fd is closed. */
+  int (*fn)(struct platformFeed *, void *);
+  void *arg;
+  struct platformThread *thread;
+};
+
+struct platformStream *platformOpenStdin(void) {
+  if (isatty(STDIN_FILENO)) {
+    errno = ENOTTY;
+    return NULL;
+  }
+  int tty = open("/dev/tty", O_RDWR | O_CLOEXEC);
+  if (tty == -1)
+    return NULL;
+  int fd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0);
+  if (fd == -1 || dup2(tty, STDIN_FILENO) == -1) {
+    int err = errno;
+    close(tty);
+    if (fd != -1)
+      close(fd);
+    errno = err;
+    return NULL;
+  }
+  close(tty);
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  struct platformStream *s = malloc(sizeof(*s));
+  s->fd = fd;
+  s->feed = NULL;
+  return s;
+}
+
+long long platformStreamRead(struct platformStream *s, char *buf, size_t len) {
+  ssize_t n;
+  do
+    n = read(s->fd, buf, len);
+  while (n == -1 && errno == EINTR);
+  if (n == -1 && errno == EWOULDBLOCK)
+    errno = EAGAIN;
+  /* A fed stream ends with the error its thread returned, if any. */
+  if (n == 0 && s->feed) {
+    int err = __atomic_load_n(&s->feed->err, __ATOMIC_ACQUIRE);
+    if (err) {
+      errno = err;
+      return -1;
+    }
+  }
+  return n;
+}
+
+int platformStreamWait(struct platformStream *s, int ms) {
+  struct pollfd fds[2] = { { STDIN_FILENO, POLLIN, 0 }, { s->fd, POLLIN, 0 } };
+  if (poll(fds, 2, ms) <= 0)
+    return 0;
+  return (fds[0].revents & POLLIN) != 0;
+}
+
+void platformStreamClose(struct platformStream *s) {
+  close(s->fd);
+  if (s->feed) {
+    platformJoinThread(s->feed->thread);
+    free(s->feed);
+  }
+  free(s);
+}
+
+static void platformFeedMain(void *p) {
+  struct platformFeed *f = p;
+  int err = f->fn(f, f->arg);
+  __atomic_store_n(&f->err, err, __ATOMIC_RELEASE);
+  close(f->fd);
+}
+
+/* A socket rather than a pipe, so writing once the reader is gone fails
+ * with EPIPE instead of raising SIGPIPE. */
+struct platformStream *platformStartStream(int (*fn)(struct platformFeed *, void *), void *arg) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1)
+    return NULL;
+  int buf = 1 << 20;
+  setsockopt(fds[1], SOL_SOCKET, SO_SNDBUF, &buf, sizeof(buf));
+  fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+  struct platformFeed *f = malloc(sizeof(*f));
+  f->fd = fds[1];
+  f->err = 0;
+  f->fn = fn;
+  f->arg = arg;
+  f->thread = platformStartThread(platformFeedMain, f);
+  if (f->thread == NULL) {
+    close(fds[0]);
+    close(fds[1]);
+    free(f);
+    errno = EAGAIN;
+    return NULL;
+  }
+  struct platformStream *s = malloc(sizeof(*s));
+  s->fd = fds[0];
+  s->feed = f;
+  return s;
+}
+
+int platformFeedWrite(struct platformFeed *f, const char *p, size_t len) {
+  while (len) {
+    ssize_t n = send(f->fd, p, len, MSG_NOSIGNAL);
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+/* The file is unlinked as soon as it is made. Pages past its end are
+ * mapped too but never touched, as only what was written is looked at. */
+struct platformSpool {
+  int fd;
+  char *map;
+  size_t cap, len;
+};
+
+struct platformSpool *platformSpoolCreate(size_t cap, char **map) {
+  const char *dir = getenv("TMPDIR");
+  if (dir == NULL || *dir == '\0')
+    dir = "/tmp";
+  char *path = malloc(strlen(dir) + sizeof("/kilo-XXXXXX"));
+  sprintf(path, "%s/kilo-XXXXXX", dir);
+  int fd = mkstemp(path);
+  if (fd == -1) {
+    free(path);
+    return NULL;
+  }
+  unlink(path);
+  free(path);
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+  char *p = mmap(NULL, cap, PROT_READ, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) {
+    int err = errno;
+    close(fd);
+    errno = err;
+    return NULL;
+  }
+  struct platformSpool *s = malloc(sizeof(*s));
+  s->fd = fd;
+  s->map = *map = p;
+  s->cap = cap;
+  s->len = 0;
+  return s;
+}
+
+int platformSpoolWrite(struct platformSpool *s, const char *p, size_t len) {
+  if (len > s->cap - s->len) {
+    errno = EFBIG;
+    return -1;
+  }
+  while (len) {
+    ssize_t n = write(s->fd, p, len);
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    p += n;
+    len -= n;
+    s->len += n;
+  }
+  return 0;
+}
+
+void platformSpoolClose(struct platformSpool *s) {
+  munmap(s->map, s->cap);
+  close(s->fd);
+  free(s);
+}
+
+struct platformThread {
+  pthread_t tid;
+  void (*fn)(void *);
+  void *arg;
+};
+
+static void *platformThreadMain(void *p) {
+  struct platformThread *t = p;
+  t->fn(t->arg);
+  return NULL;
+}
+
+struct platformThread *platformStartThread(void (*fn)(void *), void *arg) {
+  struct platformThread *t = malloc(sizeof(*t));
+  t->fn = fn;
+  t->arg = arg;
+  if (pthread_create(&t->tid, NULL, platformThreadMain, t) != 0) {
+    free(t);
+    return NULL;
+  }
+  return t;
+}
+
+void platformJoinThread(struct platformThread *t) {
+  pthread_join(t->tid, NULL);
+  free(t);
+}
+
+int platformCpuCount(void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? n : 1;
+}
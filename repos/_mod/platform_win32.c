@@ -1,6 +1,10 @@
 #include "platform.h"
 #include <Windows.h>
+#include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 
 void initResizeSignal() {}
@@ -90,3 +94,489 @@ int getInput(int _) {
 
   return 0;
 }
+
+int platformKeyWait(int ms) {
+  return WaitForSingleObject(GetStdHandle(STD_INPUT_HANDLE), ms) == WAIT_OBJECT_0;
+}
+
+long long platformClock(void) { return (long long)GetTickCount64(); }
+
+char *platformMapFile(const char *path, size_t *len) {
+  static char empty[1];
+  HANDLE file = CreateFileA(path, GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return NULL;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    return NULL;
+  }
+  *len = (size_t)size.QuadPart;
+  if (*len == 0) {
+    CloseHandle(file);
+    return empty;
+  }
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle(file);
+  if (mapping == NULL)
+    return NULL;
+  /* The view keeps the mapping alive. */
+  char *map = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  return map;
+}
+
+void platformUnmapFile(char *map, size_t len) {
+  if (len)
+    UnmapViewOfFile(map);
+}
+
+/* A file with a view of it open can't be truncated here, so the view never
+ * goes past the end of the file; a rewrite in place still shows through. */
+int platformMapDetach(char *map, size_t len) {
+  (void)map;
+  return len ? -1 : 0;
+}
+
+/* Unlocking pages that are not locked takes them out of the working set. */
+void platformDropPages(const char *p, size_t len) {
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  uintptr_t page = info.dwPageSize;
+  uintptr_t lo = ((uintptr_t)p + page - 1) & ~(page - 1);
+  uintptr_t hi = ((uintptr_t)p + len) & ~(page - 1);
+  if (lo < hi)
+    VirtualUnlock((void *)lo, hi - lo);
+}
+
+struct platformFile {
+  HANDLE handle;
+  char *path;
+  char *tmp;
+};
+
+static void platformFreeFile(struct platformFile *f) {
+  free(f->path);
+  free(f->tmp);
+  free(f);
+}
+
+struct platformFile *platformCreateReplacement(const char *path) {
+  struct platformFile *f = malloc(sizeof(*f));
+  f->path = _strdup(path);
+  f->tmp = malloc(strlen(path) + 32);
+  sprintf(f->tmp, "%s.kilo-%lu", path, (unsigned long)GetCurrentProcessId());
+  DWORD attrs = GetFileAttributesA(path);
+  f->handle = CreateFileA(f->tmp, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                          attrs == INVALID_FILE_ATTRIBUTES ? FILE_ATTRIBUTE_NORMAL : attrs, NULL);
+  if (f->handle == INVALID_HANDLE_VALUE) {
+    platformFreeFile(f);
+    errno = EACCES;
+    return NULL;
+  }
+  return f;
+}
+
+int platformWriteFile(struct platformFile *f, const struct platformIov *iov, int n) {
+  for (int i = 0; i < n; i++) {
+    const char *p = iov[i].base;
+    size_t left = iov[i].len;
+    while (left > 0) {
+      DWORD chunk = left > 0x40000000 ? 0x40000000 : (DWORD)left;
+      DWORD done;
+      if (!WriteFile(f->handle, p, chunk, &done, NULL)) {
+        errno = EIO;
+        return -1;
+      }
+      p += done;
+      left -= done;
+    }
+  }
+  return 0;
+}
+
+int platformCommitFile(struct platformFile *f) {
+  BOOL ok = FlushFileBuffers(f->handle);
+  CloseHandle(f->handle);
+  f->handle = INVALID_HANDLE_VALUE;
+  if (!ok || !MoveFileExA(f->tmp, f->path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+    errno = EIO;
+    platformAbortFile(f);
+    return -1;
+  }
+  platformFreeFile(f);
+  return 0;
+}
+
+void platformAbortFile(struct platformFile *f) {
+  int err = errno;
+  if (f->handle != INVALID_HANDLE_VALUE)
+    CloseHandle(f->handle);
+  DeleteFileA(f->tmp);
+  platformFreeFile(f);
+  errno = err;
+}
+
+struct platformFile *platformOpenAppend(const char *path, int truncate) {
+  HANDLE h = CreateFileA(path, FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                         truncate ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (h == INVALID_HANDLE_VALUE) {
+    errno = EACCES;
+    return NULL;
+  }
+  struct platformFile *f = malloc(sizeof(*f));
+  f->handle = h;
+  f->path = _strdup(path);
+  f->tmp = NULL;
+  return f;
+}
+
+struct platformFile *platformOpenFile(const char *path) {
+  HANDLE h = CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                         NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (h == INVALID_HANDLE_VALUE) {
+    errno = EACCES;
+    return NULL;
+  }
+  struct platformFile *f = malloc(sizeof(*f));
+  f->handle = h;
+  f->path = _strdup(path);
+  f->tmp = NULL;
+  return f;
+}
+
+int platformSeekFile(struct platformFile *f, long long off) {
+  LARGE_INTEGER to;
+  to.QuadPart = off;
+  if (!SetFilePointerEx(f->handle, to, NULL, FILE_BEGIN)) {
+    errno = EIO;
+    return -1;
+  }
+  return 0;
+}
+
+/* Fails while the file is mapped and would shrink below the view, which
+ * the caller handles as any other write error. */
+int platformTruncateFile(struct platformFile *f, long long len) {
+  if (platformSeekFile(f, len) == -1 || !SetEndOfFile(f->handle)) {
+    errno = EIO;
+    return -1;
+  }
+  return 0;
+}
+
+int platformSyncFile(struct platformFile *f) {
+  if (!FlushFileBuffers(f->handle)) {
+    errno = EIO;
+    return -1;
+  }
+  return 0;
+}
+
+void platformCloseFile(struct platformFile *f) {
+  CloseHandle(f->handle);
+  platformFreeFile(f);
+}
+
+int platformFileStamp(const char *path, long long *size, long long *mtime) {
+  WIN32_FILE_ATTRIBUTE_DATA data;
+  if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data)) {
+    errno = ENOENT;
+    return -1;
+  }
+  *size = ((long long)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+  /* FILETIME counts 100ns intervals. */
+  *mtime = (((long long)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime) * 100;
+  return 0;
+}
+
+/* There is nothing like inotify for a single file, so every poll looks
+ * at the file. */
+struct platformWatch {
+  HANDLE handle; /* The file, open for reading. */
+  char *path;
+  long long size; /* Size at the last poll. */
+};
+
+static HANDLE platformOpenRead(const char *path, DWORD access) {
+  return CreateFileA(path, access, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                     NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+}
+
+struct platformWatch *platformWatchFile(const char *path) {
+  HANDLE h = platformOpenRead(path, GENERIC_READ);
+  if (h == INVALID_HANDLE_VALUE) {
+    errno = ENOENT;
+    return NULL;
+  }
+  struct platformWatch *w = malloc(sizeof(*w));
+  w->handle = h;
+  w->path = _strdup(path);
+  w->size = -1;
+  return w;
+}
+
+int platformWatchPoll(struct platformWatch *w, long long *size, long long *mtime) {
+  BY_HANDLE_FILE_INFORMATION info, now;
+  if (!GetFileInformationByHandle(w->handle, &info))
+    return 0;
+  *size = ((long long)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+  *mtime = (((long long)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime) * 100;
+  int events = 0;
+  if (*size != w->size)
+    events |= PLATFORM_WATCH_CHANGED;
+  w->size = *size;
+
+  HANDLE h = platformOpenRead(w->path, 0);
+  int same = h != INVALID_HANDLE_VALUE && GetFileInformationByHandle(h, &now)
+      && now.dwVolumeSerialNumber == info.dwVolumeSerialNumber
+      && now.nFileIndexHigh == info.nFileIndexHigh && now.nFileIndexLow == info.nFileIndexLow;
+  if (h != INVALID_HANDLE_VALUE)
+    CloseHandle(h);
+  if (!same)
+    events |= PLATFORM_WATCH_REPLACED;
+  return events;
+}
+
+long long platformWatchRead(struct platformWatch *w, long long off, char *buf, size_t len) {
+  OVERLAPPED at = { 0 };
+  at.Offset = (DWORD)off;
+  at.OffsetHigh = (DWORD)(off >> 32);
+  DWORD done;
+  if (!ReadFile(w->handle, buf, len > 0x40000000 ? 0x40000000 : (DWORD)len, &done, &at)) {
+    if (GetLastError() == ERROR_HANDLE_EOF)
+      return 0;
+    errno = EIO;
+    return -1;
+  }
+  return done;
+}
+
+void platformWatchClose(struct platformWatch *w) {
+  CloseHandle(w->handle);
+  free(w->path);
+  free(w);
+}
+
+struct platformStream {
+  HANDLE handle;
+  int pipe; /* Checked for data before reading, as pipes can't be waited on. */
+  struct platformFeed *feed; /* Set for a stream fed by a thread. */
+};
+
+struct platformFeed {
+  HANDLE handle;
+  volatile LONG err; /* What fn returned, set before handle is closed. */
+  int (*fn)(struct platformFeed *, void *);
+  void *arg;
+  struct platformThread *thread;
+};
+
+/* The end of the stream, with the error a feeding thread returned. */
+static long long platformStreamEnd(struct platformStream *s) {
+  LONG err = s->feed ? InterlockedCompareExchange(&s->feed->err, 0, 0) : 0;
+  if (err) {
+    errno = err;
+    return -1;
+  }
+  return 0;
+}
+
+struct platformStream *platformOpenStdin(void) {
+  HANDLE in = GetStdHandle(STD_INPUT_HANDLE);
+  DWORD mode;
+  if (in == INVALID_HANDLE_VALUE || GetConsoleMode(in, &mode)) {
+    errno = ENOTTY;
+    return NULL;
+  }
+  HANDLE con = CreateFileA("CONIN$", GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                           NULL, OPEN_EXISTING, 0, NULL);
+  if (con == INVALID_HANDLE_VALUE || !SetStdHandle(STD_INPUT_HANDLE, con)) {
+    if (con != INVALID_HANDLE_VALUE)
+      CloseHandle(con);
+    errno = ENOTTY;
+    return NULL;
+  }
+  struct platformStream *s = malloc(sizeof(*s));
+  s->handle = in;
+  s->pipe = GetFileType(in) == FILE_TYPE_PIPE;
+  s->feed = NULL;
+  return s;
+}
+
+long long platformStreamRead(struct platformStream *s, char *buf, size_t len) {
+  DWORD avail = 0, done;
+  if (len > 0x40000000)
+    len = 0x40000000;
+  if (s->pipe) {
+    if (!PeekNamedPipe(s->handle, NULL, 0, NULL, &avail, NULL))
+      return GetLastError() == ERROR_BROKEN_PIPE ? platformStreamEnd(s) : (errno = EIO, -1);
+    if (avail == 0) {
+      errno = EAGAIN;
+      return -1;
+    }
+    if (len > avail)
+      len = avail;
+  }
+  if (!ReadFile(s->handle, buf, (DWORD)len, &done, NULL)) {
+    if (GetLastError() == ERROR_BROKEN_PIPE)
+      return platformStreamEnd(s);
+    errno = EIO;
+    return -1;
+  }
+  return done;
+}
+
+int platformStreamWait(struct platformStream *s, int ms) {
+  DWORD avail;
+  /* Only the console can be waited on; a pipe is looked at in between. */
+  for (int waited = 0; waited < ms; waited += 10) {
+    if (WaitForSingleObject(GetStdHandle(STD_INPUT_HANDLE), 0) == WAIT_OBJECT_0)
+      return 1;
+    if (!s->pipe || !PeekNamedPipe(s->handle, NULL, 0, NULL, &avail, NULL) || avail)
+      return 0;
+    Sleep(10);
+  }
+  return 0;
+}
+
+void platformStreamClose(struct platformStream *s) {
+  CloseHandle(s->handle);
+  if (s->feed) {
+    platformJoinThread(s->feed->thread);
+    free(s->feed);
+  }
+  free(s);
+}
+
+static void platformFeedMain(void *p) {
+  struct platformFeed *f = p;
+  InterlockedExchange(&f->err, f->fn(f, f->arg));
+  CloseHandle(f->handle);
+}
+
+struct platformStream *platformStartStream(int (*fn)(struct platformFeed *, void *), void *arg) {
+  HANDLE r, w;
+  if (!CreatePipe(&r, &w, NULL, 1 << 20)) {
+    errno = EIO;
+    return NULL;
+  }
+  struct platformFeed *f = malloc(sizeof(*f));
+  f->handle = w;
+  f->err = 0;
+  f->fn = fn;
+  f->arg = arg;
+  f->thread = platformStartThread(platformFeedMain, f);
+  if (f->thread == NULL) {
+    CloseHandle(r);
+    CloseHandle(w);
+    free(f);
+    errno = EAGAIN;
+    return NULL;
+  }
+  struct platformStream *s = malloc(sizeof(*s));
+  s->handle = r;
+  s->pipe = 1;
+  s->feed = f;
+  return s;
+}
+
+/* A write waiting for room fails once the reading end is closed. */
+int platformFeedWrite(struct platformFeed *f, const char *p, size_t len) {
+  while (len) {
+    DWORD done, k = len > 0x40000000 ? 0x40000000 : (DWORD)len;
+    if (!WriteFile(f->handle, p, k, &done, NULL)) {
+      errno = GetLastError() == ERROR_NO_DATA || GetLastError() == ERROR_BROKEN_PIPE ? EPIPE : EIO;
+      return -1;
+    }
+    p += done;
+    len -= done;
+  }
+  return 0;
+}
+
+/* Pages are reserved up front and committed as text is added, so they are
+ * backed by the page file rather than a file of their own. */
+struct platformSpool {
+  char *map;
+  size_t cap, len;
+  size_t committed;
+};
+
+struct platformSpool *platformSpoolCreate(size_t cap, char **map) {
+  char *p = VirtualAlloc(NULL, cap, MEM_RESERVE, PAGE_NOACCESS);
+  if (p == NULL) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  struct platformSpool *s = malloc(sizeof(*s));
+  s->map = *map = p;
+  s->cap = cap;
+  s->len = 0;
+  s->committed = 0;
+  return s;
+}
+
+int platformSpoolWrite(struct platformSpool *s, const char *p, size_t len) {
+  if (len > s->cap - s->len) {
+    errno = EFBIG;
+    return -1;
+  }
+  if (s->len + len > s->committed) {
+    size_t grow = s->len + len - s->committed;
+    grow = (grow + (1 << 20) - 1) & ~(size_t)((1 << 20) - 1);
+    if (grow > s->cap - s->committed)
+      grow = s->cap - s->committed;
+    if (VirtualAlloc(s->map + s->committed, grow, MEM_COMMIT, PAGE_READWRITE) == NULL) {
+      errno = ENOMEM;
+      return -1;
+    }
+    s->committed += grow;
+  }
+  memcpy(s->map + s->len, p, len);
+  s->len += len;
+  return 0;
+}
+
+void platformSpoolClose(struct platformSpool *s) {
+  VirtualFree(s->map, 0, MEM_RELEASE);
+  free(s);
+}
+
+struct platformThread {
+  HANDLE handle;
+  void (*fn)(void *);
+  void *arg;
+};
+
+static DWORD WINAPI platformThreadMain(LPVOID p) {
+  struct platformThread *t = p;
+  t->fn(t->arg);
+  return 0;
+}
+
+struct platformThread *platformStartThread(void (*fn)(void *), void *arg) {
+  struct platformThread *t = malloc(sizeof(*t));
+  t->fn = fn;
+  t->arg = arg;
+  t->handle = CreateThread(NULL, 0, platformThreadMain, t, 0, NULL);
+  if (t->handle == NULL) {
+    free(t);
+    return NULL;
+  }
+  return t;
+}
+
+void platformJoinThread(struct platformThread *t) {
+  WaitForSingleObject(t->handle, INFINITE);
+  CloseHandle(t->handle);
+  free(t);
+}
+
+int platformCpuCount(void) {
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
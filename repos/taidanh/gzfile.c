@@ -0,0 +1,119 @@
+#include "gzfile.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define GZF_IN_MAX (1u << 30) /* Most input given zlib at once, as avail_in is 32 bits. */
+
+struct gzfReader {
+    char *map;
+    size_t len;
+};
+
+int gzfDetect(const char *p, size_t len) {
+    return len >= 2 && (unsigned char)p[0] == 0x1f && (unsigned char)p[1] == 0x8b;
+}
+
+static int gzfInflateMain(struct platformFeed *feed, void *arg) {
+    struct gzfReader *r = arg;
+    const unsigned char *end = (const unsigned char *)r->map + r->len;
+    unsigned char *out = malloc(GZF_CHUNK);
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    z.next_in = (unsigned char *)r->map;
+    int err = out && inflateInit2(&z, 16 + MAX_WBITS) == Z_OK ? 0 : ENOMEM;
+    int ready = err == 0;
+
+    while (err == 0) {
+        if (z.avail_in == 0)
+            z.avail_in = end - z.next_in < GZF_IN_MAX ? end - z.next_in : GZF_IN_MAX;
+        z.next_out = out;
+        z.avail_out = GZF_CHUNK;
+        int rc = inflate(&z, Z_NO_FLUSH);
+        if (rc == Z_MEM_ERROR)
+            err = ENOMEM;
+        else if (rc == Z_DATA_ERROR || rc == Z_NEED_DICT || (rc == Z_BUF_ERROR && z.avail_in == 0))
+            err = EIO;
+        /* What came before an error is still handed over. */
+        if (z.avail_out < GZF_CHUNK
+            && platformFeedWrite(feed, (char *)out, GZF_CHUNK - z.avail_out) == -1)
+            break;
+        if (rc == Z_STREAM_END) {
+            /* Anything after the last member, such as padding, is ignored. */
+            if (!gzfDetect((const char *)z.next_in, end - z.next_in))
+                break;
+            inflateReset(&z);
+        }
+    }
+
+    if (ready)
+        inflateEnd(&z);
+    free(out);
+    platformUnmapFile(r->map, r->len);
+    free(r);
+    return err;
+}
+
+struct platformStream *gzfInflate(char *map, size_t len) {
+    struct gzfReader *r = malloc(sizeof(*r));
+    r->map = map;
+    r->len = len;
+    struct platformStream *s = platformStartStream(gzfInflateMain, r);
+    if (s == NULL)
+        free(r);
+    return s;
+}
+
+/* Deflate what is at next_in and write out what comes of it, all of it
+ * with Z_FINISH. */
+static int gzfDeflate(z_stream *z, struct platformFile *f, unsigned char *out, int flush,
+    long long *written) {
+    int rc;
+    do {
+        z->next_out = out;
+        z->avail_out = GZF_CHUNK;
+        rc = deflate(z, flush);
+        struct platformIov v = { (const char *)out, GZF_CHUNK - z->avail_out };
+        if (v.len && platformWriteFile(f, &v, 1) == -1)
+            return -1;
+        *written += v.len;
+    } while (z->avail_out == 0 || (flush == Z_FINISH && rc != Z_STREAM_END));
+    return 0;
+}
+
+long long gzfWrite(struct platformFile *f, const struct platformIov *iov, int n) {
+    unsigned char *out = malloc(GZF_CHUNK);
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    if (out == NULL
+        || deflateInit2(&z, GZF_LEVEL, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        free(out);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    long long written = 0;
+    int ok = 1;
+    for (int i = 0; i < n && ok; i++) {
+        const char *p = iov[i].base;
+        size_t len = iov[i].len;
+        while (len && ok) {
+            size_t k = len < GZF_IN_MAX ? len : GZF_IN_MAX;
+            z.next_in = (unsigned char *)p;
+            z.avail_in = k;
+            ok = gzfDeflate(&z, f, out, Z_NO_FLUSH, &written) == 0;
+            p += k;
+            len -= k;
+        }
+    }
+    if (ok)
+        ok = gzfDeflate(&z, f, out, Z_FINISH, &written) == 0;
+
+    int err = errno;
+    deflateEnd(&z);
+    free(out);
+    errno = err;
+    return ok ? written : -1;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <stddef.h>
+#include "../_mod/platform.h"
+
+/* Gzip files read and written with zlib, so one can be edited as the text
+ * it holds. Inflating runs on a thread of its own and feeds a stream, read
+ * like standard input is, so the start of the text shows while the rest is
+ * still being inflated. Only built with KILO_HAVE_ZLIB. */
+
+#define GZF_CHUNK (256 * 1024) /* Bytes inflated or deflated at a time. */
+#define GZF_LEVEL 6 /* Compression level, gzip's own default. */
+
+/* 1 if the 'len' bytes at 'p' start like a gzip file. */
+int gzfDetect(const char *p, size_t len);
+
+/* Inflate the gzip file mapped at 'map', the text arriving on the stream
+ * returned. Members following one another are read as one, as gunzip does;
+ * corrupt or cut short data ends the stream with EIO. The stream takes the
+ * mapping over and unmaps it once done. Returns NULL with errno set on
+ * error, the mapping left to the caller. */
+struct platformStream *gzfInflate(char *map, size_t len);
+
+/* Write iov[0, n) to 'f' as one gzip member. Returns the bytes written,
+ * or -1 with errno set. */
+long long gzfWrite(struct platformFile *f, const struct platformIov *iov, int n);
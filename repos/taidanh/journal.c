@@ -0,0 +1,201 @@
+#include "journal.h"
+#include "../_mod/platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define JN_MAGIC "KILOJNL1"
+#define JN_HEADER (8 + 2 * 8) /* Magic, then the base file's stamp. */
+#define JN_RECORD (1 + 3 * 4) /* Op, row, at and length, then the text. */
+
+static void jnReserve(struct jnBuf *b, size_t more) {
+    if (b->len + more > b->cap) {
+        b->cap = b->cap ? b->cap * 2 : 4096;
+        while (b->len + more > b->cap)
+            b->cap *= 2;
+        b->p = realloc(b->p, b->cap);
+    }
+}
+
+static void jnPut(struct jnBuf *b, const void *p, size_t len) {
+    memcpy(&b->p[b->len], p, len);
+    b->len += len;
+}
+
+/* Add one record to 'b'. Records are in host byte order, as a log is only
+ * ever read back on the machine that wrote it. */
+void jnEncode(struct jnBuf *b, int op, uint32_t row, uint32_t at, const char *s, uint32_t len) {
+    jnReserve(b, JN_RECORD + len);
+    unsigned char c = op;
+    jnPut(b, &c, 1);
+    jnPut(b, &row, 4);
+    jnPut(b, &at, 4);
+    jnPut(b, &len, 4);
+    if (len)
+        jnPut(b, s, len);
+}
+
+void jnBufFree(struct jnBuf *b) {
+    free(b->p);
+    memset(b, 0, sizeof(*b));
+}
+
+static void jnHeader(struct jnBuf *b, struct jnStamp base) {
+    jnReserve(b, JN_HEADER);
+    jnPut(b, JN_MAGIC, 8);
+    jnPut(b, &base.size, 8);
+    jnPut(b, &base.mtime, 8);
+}
+
+/* Log to 'path' the edits made to the file stamped 'base'. A log that
+ * holds 'size' bytes already is appended to; otherwise it is created on
+ * the first record. */
+void jnSetup(struct journal *j, const char *path, struct jnStamp base, size_t size) {
+    jnClose(j);
+    j->path = strdup(path);
+    j->base = base;
+    j->size = size;
+    j->compacted = size;
+}
+
+void jnAdd(struct journal *j, int op, uint32_t row, uint32_t at, const char *s, uint32_t len) {
+    if (j->path == NULL || j->error)
+        return;
+    if (j->pending.len == 0)
+        j->oldest = time(NULL);
+    jnEncode(&j->pending, op, row, at, s, len);
+    if (j->keep)
+        jnEncode(&j->kept, op, row, at, s, len);
+    if (j->pending.len >= JN_FLUSH_BYTES || time(NULL) - j->oldest >= JN_FLUSH_SECS)
+        jnFlush(j);
+}
+
+/* Write the pending records in one go. Returns 0, or -1 with errno set,
+ * after which logging stops. */
+int jnFlush(struct journal *j) {
+    if (j->pending.len == 0 || j->error)
+        return 0;
+    if (j->file == NULL) {
+        j->file = platformOpenAppend(j->path, j->size == 0);
+        if (j->file == NULL) {
+            j->error = 1;
+            return -1;
+        }
+        if (j->size == 0) {
+            struct jnBuf h = { 0 };
+            jnHeader(&h, j->base);
+            struct platformIov iov = { h.p, h.len };
+            int res = platformWriteFile(j->file, &iov, 1);
+            jnBufFree(&h);
+            if (res == -1) {
+                j->error = 1;
+                return -1;
+            }
+            j->size = JN_HEADER;
+        }
+    }
+    struct platformIov iov = { j->pending.p, j->pending.len };
+    if (platformWriteFile(j->file, &iov, 1) == -1) {
+        j->error = 1;
+        return -1;
+    }
+    j->size += j->pending.len;
+    j->pending.len = 0;
+    return 0;
+}
+
+/* While set, records are also kept in memory, to carry the edits made
+ * during a save over to the log of the saved file. */
+void jnKeep(struct journal *j, int keep) {
+    j->keep = keep;
+    j->kept.len = 0;
+}
+
+/* Replace the log, in one step, with one for 'base' holding just 'recs'.
+ * Pending records are dropped, as 'recs' is meant to supersede them.
+ * Returns 0, or -1 with errno set. */
+int jnReplace(struct journal *j, struct jnStamp base, struct jnBuf *recs) {
+    if (j->path == NULL)
+        return 0;
+    /* Appending resumes on the old log should this fail. */
+    if (j->file)
+        platformCloseFile(j->file);
+    j->file = NULL;
+    struct jnBuf h = { 0 };
+    jnHeader(&h, base);
+    struct platformIov iov[2] = { { h.p, h.len }, { recs->p, recs->len } };
+
+    struct platformFile *f = platformCreateReplacement(j->path);
+    int res = -1;
+    if (f) {
+        if (platformWriteFile(f, iov, 2) == -1)
+            platformAbortFile(f);
+        else
+            res = platformCommitFile(f);
+    }
+    jnBufFree(&h);
+    if (res == -1)
+        return -1;
+
+    j->base = base;
+    j->size = JN_HEADER + recs->len;
+    j->compacted = j->size;
+    j->pending.len = 0;
+    j->error = 0;
+    return 0;
+}
+
+/* Delete the log, once the file it applies to holds all the edits. A log
+ * found stale on opening goes too. */
+void jnRemove(struct journal *j) {
+    if (j->file)
+        platformCloseFile(j->file);
+    j->file = NULL;
+    if (j->path)
+        remove(j->path);
+    j->size = 0;
+    j->compacted = 0;
+    j->pending.len = 0;
+    j->error = 0;
+}
+
+/* Write what is pending and stop logging. */
+void jnClose(struct journal *j) {
+    jnFlush(j);
+    if (j->file)
+        platformCloseFile(j->file);
+    free(j->path);
+    jnBufFree(&j->pending);
+    jnBufFree(&j->kept);
+    memset(j, 0, sizeof(*j));
+}
+
+/* Return the first record of 'log' if it applies to the file stamped
+ * 'base', or NULL. */
+const char *jnCheck(const char *log, size_t len, struct jnStamp base) {
+    struct jnStamp stamp;
+    if (len < JN_HEADER || memcmp(log, JN_MAGIC, 8))
+        return NULL;
+    memcpy(&stamp.size, &log[8], 8);
+    memcpy(&stamp.mtime, &log[16], 8);
+    if (stamp.size != base.size || stamp.mtime != base.mtime)
+        return NULL;
+    return &log[JN_HEADER];
+}
+
+/* Decode the record at '*p' and move past it. Returns 0 at the end of the
+ * log or at a record cut short by a crash. */
+int jnNext(const char **p, const char *end, struct jnRecord *r) {
+    if (end - *p < JN_RECORD)
+        return 0;
+    r->op = (unsigned char)**p;
+    memcpy(&r->row, *p + 1, 4);
+    memcpy(&r->at, *p + 5, 4);
+    memcpy(&r->len, *p + 9, 4);
+    if ((size_t)(end - *p - JN_RECORD) < r->len)
+        return 0;
+    r->s = *p + JN_RECORD;
+    *p += JN_RECORD + r->len;
+    return 1;
+}
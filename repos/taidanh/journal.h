@@ -0,0 +1,70 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Append-only log of the edits made to a file since it was last saved, so
+ * they can be replayed on top of it after a crash. The log starts with the
+ * size and modification time of the file it applies to and is ignored if
+ * the file no longer matches. Records are collected in memory and written
+ * in groups, once JN_FLUSH_BYTES have piled up, the oldest is JN_FLUSH_SECS
+ * old, or the editor is idle; a crash loses at most that much. */
+
+#define JN_FLUSH_BYTES (64 * 1024)
+#define JN_FLUSH_SECS 1
+#define JN_COMPACT (16 * 1024 * 1024) /* Log size worth compacting. */
+
+enum jnOp {
+    JN_INSERT_ROW = 1, /* Row 'row' inserted with text s. */
+    JN_DEL_ROW, /* Row 'row' deleted. */
+    JN_INSERT_CHAR, /* s[0] inserted in row 'row' at 'at'. */
+    JN_DEL_CHAR, /* Character 'at' of row 'row' deleted. */
+    JN_APPEND, /* Text s appended to row 'row'. */
+    JN_TRUNCATE, /* Row 'row' cut to 'at' characters. */
+    JN_CLEAR, /* All rows dropped; a compacted log starts with this. */
+    JN_LINES, /* Lines 'row' to 'row' + 'at' of the file appended. */
+    JN_CONTINUED, /* Row 'row' runs on into the next if 'at', else ends. */
+};
+
+struct jnStamp {
+    long long size;
+    long long mtime;
+};
+
+struct jnBuf {
+    char *p;
+    size_t len, cap;
+};
+
+struct jnRecord {
+    int op;
+    uint32_t row, at;
+    const char *s;
+    uint32_t len;
+};
+
+struct journal {
+    char *path; /* NULL while there is nothing to log to. */
+    struct jnStamp base; /* File the records apply to. */
+    struct platformFile *file; /* Opened on the first record. */
+    struct jnBuf pending; /* Records not written yet. */
+    time_t oldest; /* When the first pending record was added. */
+    size_t size; /* Bytes in the file. */
+    size_t compacted; /* Size right after the last compaction. */
+    int keep; /* Also copy records to 'kept', see jnKeep(). */
+    struct jnBuf kept;
+    int error; /* Writing failed; records are dropped. */
+};
+
+void jnSetup(struct journal *j, const char *path, struct jnStamp base, size_t size);
+void jnAdd(struct journal *j, int op, uint32_t row, uint32_t at, const char *s, uint32_t len);
+int jnFlush(struct journal *j);
+void jnKeep(struct journal *j, int keep);
+int jnReplace(struct journal *j, struct jnStamp base, struct jnBuf *recs);
+void jnRemove(struct journal *j);
+void jnClose(struct journal *j);
+
+void jnEncode(struct jnBuf *b, int op, uint32_t row, uint32_t at, const char *s, uint32_t len);
+void jnBufFree(struct jnBuf *b);
+const char *jnCheck(const char *log, size_t len, struct jnStamp base);
+int jnNext(const char **p, const char *end, struct jnRecord *r);
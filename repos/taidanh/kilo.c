@@ -11,13 +11,16 @@
 
 #include <ctype.h>
 #include <errno.h>
-#include <fcntl.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
+#ifdef KILO_HAVE_ZLIB
+#include "gzfile.h"
+#endif
 
 /*************\
   * defines *
@@ -26,6 +29,17 @@
 #define KILO_VERSION "0.0.1"
 #define KILO_TAB_STOP 4
 #define KILO_QUIT_TIMES 3
+#define KILO_GAP_MIN 64
+#define KILO_RENDER_CACHE 4096 /* Rows kept with render and hl built. */
+#define KILO_INDEX_BACKGROUND (4 * LI_UNIT) /* Files this large are indexed
+                                                  while already shown. */
+#define KILO_JOURNAL_SUFFIX ".kilo-journal"
+#define KILO_REDO_SUFFIX ".kilo-redo"
+#define KILO_SAVE_IN_PLACE LI_UNIT /* Longest tail rewritten in place. */
+#define KILO_FOLLOW_CHUNK (64 * 1024) /* Bytes read at a time when following. */
+#define KILO_STREAM_READ (256 * 1024) /* Bytes read from a stream at a time. */
+#define KILO_STREAM_CHUNK (16 << 20) /* Most bytes taken from a stream between keys. */
+#define KILO_STREAM_MAX (sizeof(size_t) > 4 ? (size_t)1 << 40 : (size_t)1 << 30)
 
 #define CTRL_KEY(k) ((k) & 0x1f)
 
@@ -42,6 +56,7 @@ enum editorHighlight {
 
 #define HL_HIGHLIGHT_NUMBERS (1 << 0)
 #define HL_HIGHLIGHT_STRINGS (1 << 1)
+#define HL_SPAN_MAX ((1 << 24) - 1) /* Longest run one hlspan holds. */
 
 /**********\
   * data *
@@ -87,6 +102,32 @@ struct editorSyntax HLDB[] = {
 typedef void (*EditorPromptFunc)(struct editorConfig *, char *, int);
 char *editorPrompt(struct editorConfig *E, char *prompt, EditorPromptFunc callback);
 void editorMoveCursor(struct editorConfig *E, int key);
+erow *editorRow(struct editorConfig *E, int at);
+void editorUpdateSyntax(struct editorConfig *E, erow *row, int in);
+void editorSyntaxInvalidate(struct editorConfig *E, int at);
+void editorDropRenderCache(struct editorConfig *E);
+void editorSetEditRow(struct editorConfig *E, erow *row);
+void editorMemoryStats(struct editorConfig *E);
+void editorScreenStats(struct editorConfig *E);
+int editorTermScroll(void);
+int editorIndexPoll(struct editorConfig *E);
+int editorSavePoll(struct editorConfig *E);
+void editorSaveWait(struct editorConfig *E);
+void editorSaveRecut(struct editorConfig *E);
+void editorIndexFinish(struct editorConfig *E);
+void editorJournalOpen(struct editorConfig *E);
+void editorJournalIdle(struct editorConfig *E);
+void editorIndexDone(struct editorConfig *E);
+void editorSaveRecover(struct editorConfig *E);
+int editorFollowPoll(struct editorConfig *E);
+int editorDiskPoll(struct editorConfig *E);
+void editorStreamStart(struct editorConfig *E, struct platformStream *s);
+int editorStreamPoll(struct editorConfig *E);
+void editorToggleFollow(struct editorConfig *E);
+void editorToggleGzip(struct editorConfig *E);
+void editorEvictRow(struct editorConfig *E, erow *row);
+void editorPagerShrink(struct editorConfig *E, erow *keep);
+void editorPagerRead(struct editorConfig *E, size_t len);
 
 /**************\
   * terminal *
@@ -100,26 +141,67 @@ void die(const char *s) {
     exit(1);
 }
 
-int editorReadKey() {
+/* Take the next byte typed, reading all there is when none are left; the
+ * read waits up to 100ms, see enableRawMode(). Returns 1, 0 if nothing
+ * came, or -1 with errno set. */
+static int editorReadByte(struct editorConfig *E, char *c) {
+    if (E->keyat == E->keylen) {
+        int nread = read(STDIN_FILENO, E->keys, sizeof(E->keys));
+        if (nread <= 0)
+            return nread;
+        E->keyat = 0;
+        E->keylen = nread;
+    }
+    *c = E->keys[E->keyat++];
+    return 1;
+}
+
+/* Wait for a key. The read times out every 100ms; lines indexed in the
+ * background meanwhile are added and shown, finished saves reported, lines
+ * appended to a followed file or arriving on a stream read, and the
+ * journal written while waiting. */
+int editorReadKey(struct editorConfig *E) {
     int nread;
     char c;
-    while ((nread = read(STDIN_FILENO, &c, 1)) != 1) {
+    while (1) {
+        /* A stream being read wakes the wait up too. */
+        if (E->keyat == E->keylen && E->stream && !platformStreamWait(E->stream, 100))
+            nread = 0;
+        else
+            nread = editorReadByte(E, &c);
+        if (nread == 1)
+            break;
         if (nread == -1 && errno != EAGAIN)
             die("read");
+        int changed = editorIndexPoll(E) | editorSavePoll(E) | editorStreamPoll(E);
+        /* After the save, so the file it wrote is not taken for news. */
+        changed |= editorFollowPoll(E) | editorDiskPoll(E);
+        if (changed)
+            editorRefreshScreen(E);
+        editorJournalIdle(E);
     }
 
     if (c == '\x1b') {
         char seq[3];
 
-        if (read(STDIN_FILENO, &seq[0], 1) != 1)
+        if (editorReadByte(E, &seq[0]) != 1)
             return '\x1b';
-        if (read(STDIN_FILENO, &seq[1], 1) != 1)
+        if (editorReadByte(E, &seq[1]) != 1)
             return '\x1b';
 
         if (seq[0] == '[') {
             if (seq[1] >= '0' && seq[1] <= '9') {
-                if (read(STDIN_FILENO, &seq[2], 1) != 1)
+                if (editorReadByte(E, &seq[2]) != 1)
                     return '\x1b';
+                if (seq[2] >= '0' && seq[2] <= '9') {
+                    /* More digits, as in the "\x1b[200~" a paste starts with. */
+                    int n = (seq[1] - '0') * 10 + seq[2] - '0';
+                    char d = 0;
+                    int got;
+                    while ((got = editorReadByte(E, &d)) == 1 && d >= '0' && d <= '9')
+                        n = n * 10 + d - '0';
+                    return got == 1 && n == 200 && d == '~' ? PASTE_START : '\x1b';
+                }
                 if (seq[2] == '~') {
                     switch (seq[1]) {
                     case '1':
@@ -193,6 +275,69 @@ int getCursorPosition(int *rows, int *cols) {
     return 0;
 }
 
+/* Read the text of a bracketed paste, up to the "\x1b[201~" the terminal
+ * ends it with, into a buffer of its own, returned with its length at
+ * *len. The end is taken as read after a second without input. */
+char *editorReadPaste(struct editorConfig *E, size_t *len) {
+    static const char end[] = "\x1b[201~";
+    size_t cap = 4096, n = 0;
+    char *buf = malloc(cap);
+    int idle = 0;
+    while (1) {
+        if (E->keyat == E->keylen) {
+            int nread = read(STDIN_FILENO, E->keys, sizeof(E->keys));
+            if (nread == -1 && errno != EAGAIN)
+                die("read");
+            if (nread <= 0) {
+                if (++idle == 10)
+                    break;
+                continue;
+            }
+            idle = 0;
+            E->keyat = 0;
+            E->keylen = nread;
+        }
+        size_t take = E->keylen - E->keyat;
+        if (n + take > cap) {
+            while (cap < n + take)
+                cap *= 2;
+            buf = realloc(buf, cap);
+        }
+        memcpy(&buf[n], &E->keys[E->keyat], take);
+        E->keyat = E->keylen;
+
+        /* The end may have begun in what was taken before. */
+        size_t from = n > sizeof(end) - 2 ? n - (sizeof(end) - 2) : 0;
+        n += take;
+        char *at = &buf[from];
+        while ((at = memchr(at, '\x1b', &buf[n] - at)) != NULL) {
+            if ((size_t)(&buf[n] - at) >= sizeof(end) - 1 && memcmp(at, end, sizeof(end) - 1) == 0)
+                break;
+            at++;
+        }
+        if (at) {
+            /* Give back the keys that came after it. */
+            E->keyat = E->keylen - (&buf[n] - at - (sizeof(end) - 1));
+            n = at - buf;
+            break;
+        }
+    }
+    *len = n;
+    return buf;
+}
+
+/* How the terminal scrolls a region, going by $TERM: the Linux console
+ * and VT220 and older lack scroll up and down, and "dumb" scrolls nothing. */
+int editorTermScroll(void) {
+    const char *term = getenv("TERM");
+    if (term == NULL || *term == '\0' || strcmp(term, "dumb") == 0)
+        return SCR_SCROLL_NONE;
+    if (strncmp(term, "linux", 5) == 0 || strncmp(term, "vt1", 3) == 0 ||
+        strncmp(term, "vt2", 3) == 0)
+        return SCR_SCROLL_INDEX;
+    return SCR_SCROLL_SU;
+}
+
 /*************************\
   * syntax highlighting *
 \*************************/
@@ -201,13 +346,19 @@ int is_separator(int c) {
     return isspace(c) || c == '\0' || strchr(",.()+-/*=~%<>[];", c) != NULL;
 }
 
-void editorUpdateSyntax(struct editorConfig *E, erow *row) {
-    row->hl = realloc(row->hl, row->size);
-    memset(row->hl, HL_NORMAL, row->rsize);
-
-    if (E->syntax == NULL)
-        return;
+/* Does 'chars' hold 'pat' at offset 'at'? Unlike strncmp this stops at
+ * 'size', as mapped text is not terminated. */
+static int editorMatchAt(char *chars, int size, int at, char *pat, int len) {
+    return at + len <= size && !memcmp(&chars[at], pat, len);
+}
 
+/* Highlight 'row' into 'hl', one byte per rendered column, from render
+ * offset 'from', which must be 0 or just past a separator highlighted
+ * HL_NORMAL, where the scanner is back in its initial state. Once past
+ * 'stop' the scan ends early at the first such separator that was plain
+ * before the call too: the rest of the row is then the same text scanned
+ * from the same state, so its highlight is already right. */
+void editorHighlightRow(struct editorConfig *E, erow *row, unsigned char *hl, int from, int stop) {
     char **keywords = E->syntax->keywords;
 
     char *scs = E->syntax->singleline_comment_start;
@@ -220,25 +371,34 @@ void editorUpdateSyntax(struct editorConfig *E, erow *row) {
 
     int prev_sep = 1;
     int in_string = 0;
-    int in_comment = (row->idx > 0 && E->row[row->idx - 1].hl_open_comment);
+    int in_comment = (from == 0 && row->hl_in);
 
-    int i = 0;
+    int old_at = -1;
+    unsigned char old_hl = HL_NORMAL;
+
+    int i = from;
     while (i < row->rsize) {
         char c = row->render[i];
-        unsigned char prev_hl = (i > 0) ? row->hl[i - 1] : HL_NORMAL;
+        unsigned char prev_hl = (i > 0) ? hl[i - 1] : HL_NORMAL;
+
+        if (i >= stop && old_at == i - 1 && old_hl == HL_NORMAL && prev_hl == HL_NORMAL
+            && prev_sep && !in_string && !in_comment && is_separator(row->render[i - 1]))
+            return;
+        old_at = i;
+        old_hl = hl[i];
 
         if (scs_len && !in_string && !in_comment) {
-            if (!strncmp(&row->render[i], scs, scs_len)) {
-                memset(&row->hl[i], HL_COMMENT, row->size - 1);
+            if (editorMatchAt(row->render, row->rsize, i, scs, scs_len)) {
+                memset(&hl[i], HL_COMMENT, row->rsize - i);
                 break;
             }
         }
 
         if (mcs_len && mce_len && !in_string) {
             if (in_comment) {
-                row->hl[i] = HL_MLCOMMENT;
-                if (!strncmp(&row->render[i], mce, mce_len)) {
-                    memset(&row->hl[i], HL_MLCOMMENT, mce_len);
+                hl[i] = HL_MLCOMMENT;
+                if (editorMatchAt(row->render, row->rsize, i, mce, mce_len)) {
+                    memset(&hl[i], HL_MLCOMMENT, mce_len);
                     i += mce_len;
                     in_comment = 0;
                     prev_sep = 1;
@@ -247,8 +407,8 @@ void editorUpdateSyntax(struct editorConfig *E, erow *row) {
                     i++;
                     continue;
                 }
-            } else if (!strncmp(&row->render[i], mcs, mcs_len)) {
-                memset(&row->hl[i], HL_MLCOMMENT, mcs_len);
+            } else if (editorMatchAt(row->render, row->rsize, i, mcs, mcs_len)) {
+                memset(&hl[i], HL_MLCOMMENT, mcs_len);
                 i += mcs_len;
                 in_comment = 1;
                 continue;
@@ -257,9 +417,9 @@ void editorUpdateSyntax(struct editorConfig *E, erow *row) {
 
         if (E->syntax->flags & HL_HIGHLIGHT_STRINGS) {
             if (in_string) {
-                row->hl[i] = HL_STRING;
+                hl[i] = HL_STRING;
                 if (c == '\\' && i + 1 < row->rsize) {
-                    row->hl[i + 1] = HL_STRING;
+                    hl[i + 1] = HL_STRING;
                     i += 2;
                     continue;
                 }
@@ -271,7 +431,7 @@ void editorUpdateSyntax(struct editorConfig *E, erow *row) {
             } else {
                 if (c == '"' || c == '\'') {
                     in_string = c;
-                    row->hl[i] = HL_STRING;
+                    hl[i] = HL_STRING;
                     i++;
                     continue;
                 }
@@ -280,7 +440,7 @@ void editorUpdateSyntax(struct editorConfig *E, erow *row) {
 
         if (E->syntax->flags & HL_HIGHLIGHT_NUMBERS) {
             if ((isdigit(c) && (prev_sep || prev_hl == HL_NUMBER)) || (c == '.' && prev_hl == HL_NUMBER)) {
-                row->hl[i] = HL_NUMBER;
+                hl[i] = HL_NUMBER;
                 i++;
                 prev_sep = 0;
                 continue;
@@ -295,8 +455,9 @@ void editorUpdateSyntax(struct editorConfig *E, erow *row) {
                 if (kw2)
                     klen--;
 
-                if (!strncmp(&row->render[i], keywords[j], klen) && is_separator(row->render[i + klen])) {
-                    memset(&row->hl[i], kw2 ? HL_KEYWORD2 : HL_KEYWORD1, klen);
+                if (editorMatchAt(row->render, row->rsize, i, keywords[j], klen)
+                    && (i + klen == row->rsize || is_separator(row->render[i + klen]))) {
+                    memset(&hl[i], kw2 ? HL_KEYWORD2 : HL_KEYWORD1, klen);
                     i += klen;
                     break;
                 }
@@ -307,14 +468,187 @@ void editorUpdateSyntax(struct editorConfig *E, erow *row) {
             }
         }
 
+        hl[i] = HL_NORMAL;
         prev_sep = is_separator(c);
         i++;
     }
-    int changed = (row->hl_open_comment != in_comment);
-    row->hl_open_comment = in_comment;
-    if (changed && row->idx + 1 < E->numrows) {
-        editorUpdateSyntax(E, &E->row[row->idx + 1]);
+    if (row->hl_open_comment != in_comment) {
+        row->hl_open_comment = in_comment;
+        editorSyntaxInvalidate(E, rtIndexOf(row) + 1);
+    }
+}
+
+/* Return the comment state the row with text 'chars' ends in when it
+ * starts in 'in_comment'. This follows editorHighlightRow over chars, minus
+ * the highlighting: keywords and numbers never hold a quote or comment
+ * delimiter, and tabs only widen the text, so strings and comments open and
+ * close at the same places. */
+int editorSyntaxScan(struct editorConfig *E, char *chars, int size, int in_comment) {
+    char *scs = E->syntax->singleline_comment_start;
+    char *mcs = E->syntax->multiline_comment_start;
+    char *mce = E->syntax->multiline_comment_end;
+
+    int scs_len = scs ? strlen(scs) : 0;
+    int mcs_len = mcs ? strlen(mcs) : 0;
+    int mce_len = mce ? strlen(mce) : 0;
+
+    int in_string = 0;
+    int i = 0;
+    while (i < size) {
+        if (scs_len && !in_string && !in_comment && editorMatchAt(chars, size, i, scs, scs_len))
+            break;
+
+        if (mcs_len && mce_len && !in_string) {
+            if (in_comment) {
+                if (editorMatchAt(chars, size, i, mce, mce_len)) {
+                    i += mce_len;
+                    in_comment = 0;
+                } else {
+                    i++;
+                }
+                continue;
+            } else if (editorMatchAt(chars, size, i, mcs, mcs_len)) {
+                i += mcs_len;
+                in_comment = 1;
+                continue;
+            }
+        }
+
+        if (E->syntax->flags & HL_HIGHLIGHT_STRINGS) {
+            if (in_string) {
+                if (chars[i] == '\\' && i + 1 < size) {
+                    i += 2;
+                    continue;
+                }
+                if (chars[i] == in_string)
+                    in_string = 0;
+            } else if (chars[i] == '"' || chars[i] == '\'') {
+                in_string = chars[i];
+            }
+        }
+        i++;
+    }
+    return in_comment;
+}
+
+/* Forget the comment state of rows from 'at' on, after an edit there. */
+void editorSyntaxInvalidate(struct editorConfig *E, int at) {
+    if (E->hlfrontier > at)
+        E->hlfrontier = at;
+}
+
+/* Return the comment state row 'at' starts in. The state of rows up to the
+ * frontier is known; past it, rows are brought up to date in order, those
+ * without render through editorSyntaxScan. Lines of the file that have no
+ * row yet are scanned in the mapping and keep their state in the tree. */
+int editorSyntaxStart(struct editorConfig *E, int at) {
+    if (E->syntax == NULL || E->syntax->multiline_comment_start == NULL || at == 0)
+        return 0;
+
+    struct rtIter it;
+    if (E->hlfrontier >= at) {
+        rtIterAt(&E->rows, at - 1, &it);
+        return rtIterOpenComment(&it);
+    }
+
+    int in = 0;
+    if (E->hlfrontier) {
+        rtIterAt(&E->rows, E->hlfrontier - 1, &it);
+        in = rtIterOpenComment(&it);
+        rtIterNext(&it);
+    } else {
+        rtIterAt(&E->rows, 0, &it);
+    }
+    for (; E->hlfrontier < at; E->hlfrontier++, rtIterNext(&it)) {
+        erow *row = rtIterRow(&it);
+        if (row == NULL || row->render == NULL) {
+            int len;
+            char *text = rtIterText(&it, &len);
+            rtIterSetOpenComment(&it, editorSyntaxScan(E, text, len, in));
+            if (E->pager)
+                editorPagerRead(E, len);
+        } else if (row->hl_in != in) {
+            editorUpdateSyntax(E, row, in);
+        }
+        in = rtIterOpenComment(&it);
+    }
+    return in;
+}
+
+/* Can highlighting of 'row' restart at render offset 'at'? It can right
+ * after a plain separator that is not part of any comment delimiter, as
+ * nothing scanned before it looked at the text from 'at' on. */
+int editorHighlightRestart(struct editorConfig *E, erow *row, int at) {
+    if (at == 0)
+        return 1;
+    char c = row->render[at - 1];
+    if (row->hl[at - 1] != HL_NORMAL || !is_separator(c))
+        return 0;
+
+    char *delims[] = {
+        E->syntax->singleline_comment_start,
+        E->syntax->multiline_comment_start,
+        E->syntax->multiline_comment_end,
+    };
+    for (unsigned int j = 0; j < sizeof(delims) / sizeof(delims[0]); j++) {
+        if (delims[j] && strchr(delims[j], c))
+            return 0;
+    }
+    return 1;
+}
+
+/* Store the highlight bytes 'hl' of 'row' as its span list. */
+void editorSetSpans(struct editorConfig *E, erow *row, unsigned char *hl) {
+    int n = 0;
+    int i, j;
+    for (i = 0; i < row->rsize; i = j) {
+        for (j = i + 1; j < row->rsize && hl[j] == hl[i] && j - i < HL_SPAN_MAX; j++)
+            ;
+        if (hl[i] != HL_NORMAL)
+            n++;
+    }
+
+    slabFree(&E->mem, row->spans, sizeof(hlspan) * row->nspans);
+    row->spans = n ? slabAlloc(&E->mem, sizeof(hlspan) * n) : NULL;
+    row->nspans = n;
+
+    n = 0;
+    for (i = 0; i < row->rsize; i = j) {
+        for (j = i + 1; j < row->rsize && hl[j] == hl[i] && j - i < HL_SPAN_MAX; j++)
+            ;
+        if (hl[i] != HL_NORMAL) {
+            hlspan span = { i, j - i, hl[i] };
+            row->spans[n++] = span;
+        }
+    }
+}
+
+/* Expand the span list of 'row' into one highlight byte per column. */
+void editorSpansToBytes(erow *row, unsigned char *hl) {
+    memset(hl, HL_NORMAL, row->rsize);
+    for (int j = 0; j < row->nspans; j++)
+        memset(&hl[row->spans[j].start], row->spans[j].hl, row->spans[j].len);
+}
+
+/* Highlight all of 'row', starting in comment state 'in'. The row being
+ * edited keeps its highlight as bytes, which edits patch; other rows are
+ * highlighted in a scratch buffer and keep only the spans. */
+void editorUpdateSyntax(struct editorConfig *E, erow *row, int in) {
+    unsigned char *hl = row->hl;
+    if (hl == NULL) {
+        if (E->hlbufcap < row->rsize + 1) {
+            E->hlbufcap = row->rsize + 1;
+            E->hlbuf = realloc(E->hlbuf, E->hlbufcap);
+        }
+        hl = E->hlbuf;
     }
+    memset(hl, HL_NORMAL, row->rsize);
+    row->hl_in = in;
+
+    if (E->syntax)
+        editorHighlightRow(E, row, hl, 0, row->rsize + 1);
+    if (row->hl == NULL)
+        editorSetSpans(E, row, hl);
 }
 
 int editorSyntaxToColor(int hl) {
@@ -339,6 +673,7 @@ int editorSyntaxToColor(int hl) {
 
 void editorSelectSyntaxHighlight(struct editorConfig *E) {
     E->syntax = NULL;
+    editorDropRenderCache(E);
     if (E->filename == NULL)
         return;
 
@@ -349,14 +684,9 @@ void editorSelectSyntaxHighlight(struct editorConfig *E) {
         unsigned int i = 0;
         while (s->filematch[i]) {
             int is_ext = (s->filematch[i][0] == '.');
-            if ((is_ext && ext && !strcmp(ext, s->filematch[i])) || (!is_ext && strstr(E->filename, s->filematch[i]))) {
+            if ((is_ext && ext && !strcmp(ext, s->filematch[i])) ||
+                (!is_ext && strstr(E->filename, s->filematch[i]))) {
                 E->syntax = s;
-
-                int filerow;
-                for (filerow = 0; filerow < E->numrows; filerow++) {
-                    editorUpdateSyntax(E, &E->row[filerow]);
-                }
-
                 return;
             }
             i++;
@@ -368,14 +698,37 @@ void editorSelectSyntaxHighlight(struct editorConfig *E) {
   * row operations *
 \********************/
 
+/* Return the row at index 'at', or NULL past the end of the buffer. */
+erow *editorRow(struct editorConfig *E, int at) {
+    return rtAt(&E->rows, at);
+}
+
+/* Character 'at' of a row, skipping the gap while the row is being edited. */
+char editorRowChar(erow *row, int at) {
+    return row->chars[at < row->gap_at ? at : at + row->gap];
+}
+
+/* Render columns taken by 'c' when it starts at column 'rx'. */
+int editorCharWidth(char c, int rx) {
+    return c == '\t' ? KILO_TAB_STOP - rx % KILO_TAB_STOP : 1;
+}
+
 int editorRowCxToRx(erow *row, int cx) {
     int rx = 0;
-    int j;
-    for (j = 0; j < cx; j++) {
-        if (row->chars[j] == '\t') {
-            rx += (KILO_TAB_STOP - 1) - (rx % KILO_TAB_STOP);
+    int j = 0;
+    while (j < cx) {
+        /* Skip from tab to tab within the part before or after the gap. */
+        int end = (j < row->gap_at && cx > row->gap_at) ? row->gap_at : cx;
+        char *seg = &row->chars[j < row->gap_at ? j : j + row->gap];
+        char *tab = memchr(seg, '\t', end - j);
+        if (tab == NULL) {
+            rx += end - j;
+            j = end;
+        } else {
+            rx += tab - seg;
+            j += tab - seg + 1;
+            rx += editorCharWidth('\t', rx);
         }
-        rx++;
     }
     return rx;
 }
@@ -384,10 +737,7 @@ int editorRowRxToCx(erow *row, int rx) {
     int cur_rx = 0;
     int cx;
     for (cx = 0; cx < row->size; cx++) {
-        if (row->chars[cx] == '\t') {
-            cur_rx += (KILO_TAB_STOP - 1) - (cur_rx % KILO_TAB_STOP);
-        }
-        cur_rx++;
+        cur_rx += editorCharWidth(editorRowChar(row, cx), cur_rx);
 
         if (cur_rx > rx)
             return cx;
@@ -395,71 +745,399 @@ int editorRowRxToCx(erow *row, int rx) {
     return cx;
 }
 
+/* Build render of 'row', leaving highlighting to the caller. A compact
+ * row without tabs renders as itself, so render then points at chars
+ * instead of holding a copy, in the mapped file too. Render is only
+ * terminated when it is a copy, so it is read up to rsize. */
 void editorUpdateRow(struct editorConfig *E, erow *row) {
     int tabs = 0;
     int j;
     for (j = 0; j < row->size; j++)
-        if (row->chars[j] == '\t')
+        if (editorRowChar(row, j) == '\t')
             tabs++;
 
-    free(row->render);
-    row->render = malloc(row->size + tabs * (KILO_TAB_STOP - 1) + 1);
+    row->rcap = row->size + tabs * (KILO_TAB_STOP - 1) + 1;
+    if (tabs == 0 && row->gap == 0) {
+        row->render = row->chars;
+        row->rsize = row->size;
+        return;
+    }
+    row->render = slabAlloc(&E->mem, row->rcap);
 
     int idx = 0;
     for (j = 0; j < row->size; j++) {
-        if (row->chars[j] == '\t') {
+        char c = editorRowChar(row, j);
+        if (c == '\t') {
             row->render[idx++] = ' ';
             while (idx % KILO_TAB_STOP != 0)
                 row->render[idx++] = ' ';
         } else {
-            row->render[idx++] = row->chars[j];
+            row->render[idx++] = c;
         }
     }
     row->render[idx] = '\0';
     row->rsize = idx;
+}
 
-    editorUpdateSyntax(E, row);
+/* Release render and hl of 'row' and its render cache slot. */
+void editorDropRender(struct editorConfig *E, erow *row) {
+    if (row->render == NULL)
+        return;
+    if (row->render != row->chars)
+        slabFree(&E->mem, row->render, row->rcap);
+    slabFree(&E->mem, row->hl, row->rcap);
+    slabFree(&E->mem, row->spans, sizeof(hlspan) * row->nspans);
+    row->render = NULL;
+    row->hl = NULL;
+    row->spans = NULL;
+    row->nspans = 0;
+    row->rcap = 0;
+    E->rcache[row->cslot - 1] = NULL;
+    row->cslot = 0;
 }
 
-void editorInsertRow(struct editorConfig *E, int at, char *s, size_t len) {
-    if (at < 0 || at > E->numrows)
+void editorDropRenderCache(struct editorConfig *E) {
+    editorSetEditRow(E, NULL);
+    for (int j = 0; j < KILO_RENDER_CACHE; j++) {
+        if (E->rcache[j])
+            editorDropRender(E, E->rcache[j]);
+    }
+    E->hlfrontier = 0;
+}
+
+/* Give 'row' a render cache slot. The clock hand sweeps the slots, giving
+ * rows used since it last passed a second chance, and evicts the first row
+ * that was not. The row being edited is never evicted. */
+void editorCacheRow(struct editorConfig *E, erow *row) {
+    for (;;) {
+        int h = E->rcache_hand;
+        erow *old = E->rcache[h];
+        E->rcache_hand = (h + 1) % KILO_RENDER_CACHE;
+        if (old && (E->rcache_ref[h] || old == E->editrow)) {
+            E->rcache_ref[h] = 0;
+            continue;
+        }
+        if (old)
+            editorEvictRow(E, old);
+        E->rcache[h] = row;
+        E->rcache_ref[h] = 1;
+        row->cslot = h + 1;
+        if (E->pager)
+            editorPagerShrink(E, row);
+        return;
+    }
+}
+
+/* Drop render and hl of a row leaving the render cache. A pager frees the
+ * row as well, but for the search match, which E->match points to. */
+void editorEvictRow(struct editorConfig *E, erow *row) {
+    editorDropRender(E, row);
+    if (E->pager && row != E->match)
+        rtForget(&E->rows, row);
+}
+
+/* Pager mode keeps what it holds bounded whatever the size of the file,
+ * but for the line index: rows are freed as they leave the render cache,
+ * which is held to a quarter of E->pager, and the pages of the file that
+ * were scrolled past or read by a pass over it are let go. */
+
+/* Evict the rows the clock hand comes to until rows take a quarter of
+ * E->pager at most, sparing 'keep', the row just cached. A second sweep
+ * takes rows whose second chance the first one used up, so rows on screen
+ * go too when they alone are over; they are built again when drawn. */
+void editorPagerShrink(struct editorConfig *E, erow *keep) {
+    for (int i = 0; i < 2 * KILO_RENDER_CACHE && E->mem.inuse > E->pager / 4; i++) {
+        int h = E->rcache_hand;
+        erow *old = E->rcache[h];
+        E->rcache_hand = (h + 1) % KILO_RENDER_CACHE;
+        if (old == NULL || old == keep)
+            continue;
+        if (E->rcache_ref[h]) {
+            E->rcache_ref[h] = 0;
+            continue;
+        }
+        editorEvictRow(E, old);
+    }
+}
+
+/* Bytes of map the rows on screen take. */
+void editorPagerWindow(struct editorConfig *E, size_t *lo, size_t *hi) {
+    size_t n = E->lines.n;
+    size_t top = (size_t)E->rowoff < n ? (size_t)E->rowoff : n;
+    size_t end = top + E->screenrows < n ? top + E->screenrows : n;
+    *lo = E->lines.off[top];
+    *hi = E->lines.off[end];
+}
+
+/* Let the pages of map in [lo, hi) go, but those of the rows on screen. */
+void editorPagerDrop(struct editorConfig *E, size_t lo, size_t hi) {
+    if (E->lines.off == NULL)
+        return;
+    if (hi > E->maplen)
+        hi = E->maplen;
+    size_t wlo, whi;
+    editorPagerWindow(E, &wlo, &whi);
+    if (lo < wlo)
+        platformDropPages(E->map + lo, (hi < wlo ? hi : wlo) - lo);
+    if (lo < whi)
+        lo = whi;
+    if (lo < hi)
+        platformDropPages(E->map + lo, hi - lo);
+}
+
+/* Count 'len' bytes of map read by a pass over the file, such as a search,
+ * and let all but the screen go each time half of E->pager was read. */
+void editorPagerRead(struct editorConfig *E, size_t len) {
+    E->pagerread += len;
+    if (E->pagerread >= E->pager / 2) {
+        editorPagerDrop(E, 0, E->maplen);
+        E->pagerread = 0;
+    }
+}
+
+/* Let the pages of rows scrolled off screen go. */
+void editorPagerScrolled(struct editorConfig *E) {
+    size_t lo = E->pagerlo, hi = E->pagerhi;
+    if (E->lines.off == NULL)
+        return;
+    editorPagerWindow(E, &E->pagerlo, &E->pagerhi);
+    if (lo != E->pagerlo || hi != E->pagerhi)
+        editorPagerDrop(E, lo, hi);
+}
+
+/* Make sure render and hl of 'row' are built and highlighted from the
+ * state the rows above leave it in. Rows are loaded without either; they
+ * are built here when first drawn, searched or edited, and kept in a
+ * bounded cache. */
+void editorRenderRow(struct editorConfig *E, erow *row) {
+    int in = editorSyntaxStart(E, rtIndexOf(row));
+    if (row->render == NULL) {
+        editorUpdateRow(E, row);
+        editorCacheRow(E, row);
+        editorUpdateSyntax(E, row, in);
+        return;
+    }
+    E->rcache_ref[row->cslot - 1] = 1;
+    if (row->hl_in != in)
+        editorUpdateSyntax(E, row, in);
+}
+
+/* Drop render and hl of 'row' after its text changed. */
+void editorInvalidateRow(struct editorConfig *E, erow *row) {
+    editorDropRender(E, row);
+    editorSyntaxInvalidate(E, rtIndexOf(row));
+}
+
+/* Move the gap of 'row' to 'at', growing it to at least 'need' bytes. The
+ * first call turns a compact row into gap form. The gap is sized after the
+ * row, so typing on a long line reallocs only every so many keys. */
+void editorRowMoveGap(struct editorConfig *E, erow *row, int at, int need) {
+    if (row->gap < need) {
+        int gap = row->size > KILO_GAP_MIN ? row->size : KILO_GAP_MIN;
+        if (gap < need)
+            gap = need;
+        memmove(&row->chars[row->gap_at], &row->chars[row->gap_at + row->gap],
+            row->size - row->gap_at + 1);
+        char *chars = slabAlloc(&E->mem, row->size + gap + 1);
+        memcpy(chars, row->chars, at);
+        memcpy(&chars[at + gap], &row->chars[at], row->size - at + 1);
+        slabFree(&E->mem, row->chars, row->size + row->gap + 1);
+        row->chars = chars;
+        row->gap = gap;
+    } else if (at < row->gap_at) {
+        memmove(&row->chars[at + row->gap], &row->chars[at], row->gap_at - at);
+    } else if (at > row->gap_at) {
+        memmove(&row->chars[row->gap_at], &row->chars[row->gap_at + row->gap], at - row->gap_at);
+    }
+    row->gap_at = at;
+}
+
+/* Close the gap of a row and shrink its buffers back to the compact form. */
+void editorRowFlatten(struct editorConfig *E, erow *row) {
+    if (row->gap) {
+        memmove(&row->chars[row->gap_at], &row->chars[row->gap_at + row->gap],
+            row->size - row->gap_at + 1);
+        row->chars = slabRealloc(&E->mem, row->chars, row->size + row->gap + 1, row->size + 1);
+        row->gap = 0;
+    }
+    row->gap_at = 0;
+
+    if (row->hl) {
+        editorSetSpans(E, row, row->hl);
+        slabFree(&E->mem, row->hl, row->rcap);
+        row->hl = NULL;
+    }
+    if (row->render == NULL || row->render == row->chars)
+        return;
+    if (memchr(row->chars, '\t', row->size) == NULL) {
+        slabFree(&E->mem, row->render, row->rcap);
+        row->render = row->chars;
+    } else {
+        row->render = slabRealloc(&E->mem, row->render, row->rcap, row->rsize + 1);
+    }
+    row->rcap = row->rsize + 1;
+}
+
+/* Copy a row that still points into the file mapping to memory of its own,
+ * before its text is changed for the first time. Render goes along if it
+ * was the mapped text. */
+void editorRowOwn(struct editorConfig *E, erow *row) {
+    if (!row->mapped)
         return;
+    char *chars = slabAlloc(&E->mem, row->size + 1);
+    memcpy(chars, row->chars, row->size);
+    chars[row->size] = '\0';
+    if (row->render == row->chars)
+        row->render = chars;
+    row->chars = chars;
+    row->mapped = 0;
+}
+
+/* Make 'row' the one being edited, flattening the previous one. Edits
+ * patch render and hl in place, so render gets its own copy if it shared
+ * chars and the spans are expanded back to one byte per column. */
+void editorSetEditRow(struct editorConfig *E, erow *row) {
+    if (E->editrow && E->editrow != row)
+        editorRowFlatten(E, E->editrow);
+    E->editrow = row;
+    if (row == NULL)
+        return;
+    editorRowOwn(E, row);
+    editorRenderRow(E, row);
+    if (row->render == row->chars) {
+        row->render = slabAlloc(&E->mem, row->rcap);
+        memcpy(row->render, row->chars, row->rsize + 1);
+    }
+    if (row->hl == NULL) {
+        row->hl = slabAlloc(&E->mem, row->rcap);
+        editorSpansToBytes(row, row->hl);
+        slabFree(&E->mem, row->spans, sizeof(hlspan) * row->nspans);
+        row->spans = NULL;
+        row->nspans = 0;
+    }
+}
+
+/* Patch render and hl of a row after chars [cx, cx + ins) replaced what
+ * used to render as columns [a, b). The gap must sit at cx + ins. Only the
+ * edited columns are rendered again; the text after them is shifted in
+ * place, and highlighting restarts at the token holding the edit and stops
+ * as soon as it agrees with the old highlight again. */
+void editorRowPatch(struct editorConfig *E, erow *row, int cx, int ins, int a, int b) {
+    int bn = a;
+    int j;
+    for (j = cx; j < cx + ins; j++)
+        bn += editorCharWidth(editorRowChar(row, j), bn);
+
+    /* The text after the edit renders the same up to the next tab, which
+     * absorbs the shift unless the edit moved it across a tab stop. */
+    char *tail = &row->chars[cx + ins + row->gap];
+    char *tab = memchr(tail, '\t', row->size - cx - ins);
+    int run = tab ? tab - tail : row->size - cx - ins;
+    int ob = b + run, nb = bn + run;
+    int oe = ob, ne = nb;
+    if (tab) {
+        oe = (ob / KILO_TAB_STOP + 1) * KILO_TAB_STOP;
+        ne = (nb / KILO_TAB_STOP + 1) * KILO_TAB_STOP;
+    }
 
-    E->row = realloc(E->row, sizeof(erow) * (E->numrows + 1));
-    memmove(&E->row[at + 1], &E->row[at], sizeof(erow) * (E->numrows - at));
-    for (int j = at + 1; j <= E->numrows; j++)
-        E->row[j].idx++;
+    int oldsize = row->rsize;
+    unsigned char tabhl = tab ? row->hl[ob] : HL_NORMAL;
+    row->rsize += ne - oe;
+    if (row->rsize + 1 > row->rcap) {
+        int rcap = row->rcap * 2 > row->rsize + 1 ? row->rcap * 2 : row->rsize + 1;
+        row->render = slabRealloc(&E->mem, row->render, row->rcap, rcap);
+        row->hl = slabRealloc(&E->mem, row->hl, row->rcap, rcap);
+        row->rcap = rcap;
+    }
 
-    E->row[at].idx = at;
+    /* Shift the unchanged run and the rest of the row, moving whichever
+     * lies further in the direction of the shift first. */
+    if (bn > b) {
+        memmove(&row->render[ne], &row->render[oe], oldsize - oe + 1);
+        memmove(&row->hl[ne], &row->hl[oe], oldsize - oe);
+    }
+    memmove(&row->render[bn], &row->render[b], run);
+    memmove(&row->hl[bn], &row->hl[b], run);
+    if (bn < b) {
+        memmove(&row->render[ne], &row->render[oe], oldsize - oe + 1);
+        memmove(&row->hl[ne], &row->hl[oe], oldsize - oe);
+    }
 
-    E->row[at].size = len;
-    E->row[at].chars = malloc(len + 1);
-    memcpy(E->row[at].chars, s, len);
-    E->row[at].chars[len] = '\0';
+    int idx = a;
+    for (j = cx; j < cx + ins; j++) {
+        char c = editorRowChar(row, j);
+        int w = editorCharWidth(c, idx);
+        memset(&row->render[idx], c == '\t' ? ' ' : c, w);
+        idx += w;
+    }
+    memset(&row->render[nb], ' ', ne - nb);
+    memset(&row->hl[a], HL_NORMAL, bn - a);
+    memset(&row->hl[nb], tabhl, ne - nb);
 
-    E->row[at].rsize = 0;
-    E->row[at].render = NULL;
-    E->row[at].hl = NULL;
-    E->row[at].hl_open_comment = 0;
-    editorUpdateRow(E, &E->row[at]);
+    if (E->syntax == NULL)
+        return;
+    int from = a;
+    while (!editorHighlightRestart(E, row, from))
+        from--;
+    editorHighlightRow(E, row, row->hl, from, bn + 1);
+}
+
+/* Note an edit of row 'row': log it, and record that the file on disk
+ * differs from the buffer from that row on. */
+void editorEdited(struct editorConfig *E, int op, int row, int at, const char *s, size_t len) {
+    if (row < E->ondisk)
+        E->ondisk = row;
+    if (row < E->maprows)
+        E->maprows = row;
+    if (row < E->touched)
+        E->touched = row;
+    jnAdd(&E->journal, op, row, at, s, len);
+}
+
+/* Fill a freshly allocated row slot with a copy of 's'. */
+void editorSetRow(struct editorConfig *E, erow *row, char *s, size_t len) {
+    row->size = len;
+    row->chars = slabAlloc(&E->mem, len + 1);
+    memcpy(row->chars, s, len);
+    row->chars[len] = '\0';
+
+    row->rsize = 0;
+    row->render = NULL;
+    row->hl = NULL;
+    row->spans = NULL;
+    row->nspans = 0;
+    row->hl_open_comment = 0;
+    row->cont = 0;
+}
+
+void editorInsertRow(struct editorConfig *E, int at, char *s, size_t len) {
+    if (at < 0 || at > E->numrows)
+        return;
+
+    editorSetRow(E, rtInsert(&E->rows, at), s, len);
+    editorSyntaxInvalidate(E, at);
+    editorEdited(E, JN_INSERT_ROW, at, 0, s, len);
 
     E->numrows++;
     E->dirty++;
 }
 
-void editorFreeRow(erow *row) {
-    free(row->render);
-    free(row->chars);
-    free(row->hl);
+void editorFreeRow(struct editorConfig *E, erow *row) {
+    editorDropRender(E, row);
+    if (!row->mapped)
+        slabFree(&E->mem, row->chars, row->size + row->gap + 1);
 }
 
 void editorDelRow(struct editorConfig *E, int at) {
     if (at < 0 || at >= E->numrows)
         return;
-    editorFreeRow(&E->row[at]);
-    memmove(&E->row[at], &E->row[at + 1], sizeof(erow) * (E->numrows - at - 1));
-    for (int j = at; j < E->numrows - 1; j++)
-        E->row[j].idx--;
+    erow *row = editorRow(E, at);
+    if (row == E->editrow)
+        E->editrow = NULL;
+    editorFreeRow(E, row);
+    rtDelete(&E->rows, at);
+    editorSyntaxInvalidate(E, at);
+    editorEdited(E, JN_DEL_ROW, at, 0, NULL, 0);
     E->numrows--;
     E->dirty++;
 }
@@ -467,29 +1145,70 @@ void editorDelRow(struct editorConfig *E, int at) {
 void editorRowInsertChar(struct editorConfig *E, erow *row, int at, int c) {
     if (at < 0 || at > row->size)
         at = row->size;
-    row->chars = realloc(row->chars, row->size + 2);
-    memmove(&row->chars[at + 1], &row->chars[at], row->size - at + 1);
+    editorSetEditRow(E, row);
+    int rx = editorRowCxToRx(row, at);
+    editorRowMoveGap(E, row, at, 1);
+    row->chars[row->gap_at++] = c;
+    row->gap--;
     row->size++;
-    row->chars[at] = c;
-    editorUpdateRow(E, row);
+    editorRowPatch(E, row, at, 1, rx, rx);
+    char ch = c;
+    editorEdited(E, JN_INSERT_CHAR, rtIndexOf(row), at, &ch, 1);
     E->dirty++;
 }
 
-void editorRowAppendString(struct editorConfig *E, erow *row, char *s, size_t len) {
-    row->chars = realloc(row->chars, row->size + len + 1);
+/* Add 's' to the end of 'row', without noting it as an edit. */
+void editorRowAppend(struct editorConfig *E, erow *row, const char *s, size_t len) {
+    editorRowOwn(E, row);
+    editorRowFlatten(E, row);
+    editorInvalidateRow(E, row);
+    row->chars = slabRealloc(&E->mem, row->chars, row->size + 1, row->size + len + 1);
     memcpy(&row->chars[row->size], s, len);
     row->size += len;
     row->chars[row->size] = '\0';
-    editorUpdateRow(E, row);
+}
+
+void editorRowAppendString(struct editorConfig *E, erow *row, char *s, size_t len) {
+    editorRowAppend(E, row, s, len);
+    editorEdited(E, JN_APPEND, rtIndexOf(row), 0, s, len);
+    E->dirty++;
+}
+
+/* Cut 'row' to its first 'len' characters. */
+void editorRowTruncate(struct editorConfig *E, erow *row, int len) {
+    if (len < 0 || len >= row->size)
+        return;
+    editorRowOwn(E, row);
+    editorRowFlatten(E, row);
+    editorInvalidateRow(E, row);
+    row->chars = slabRealloc(&E->mem, row->chars, row->size + 1, len + 1);
+    row->size = len;
+    row->chars[row->size] = '\0';
+    editorEdited(E, JN_TRUNCATE, rtIndexOf(row), len, NULL, 0);
+    E->dirty++;
+}
+
+/* Make 'row' run on into the next row without a newline, or end it. */
+void editorRowSetContinued(struct editorConfig *E, erow *row, int cont) {
+    if (row->cont == cont)
+        return;
+    row->cont = cont;
+    editorEdited(E, JN_CONTINUED, rtIndexOf(row), cont, NULL, 0);
     E->dirty++;
 }
 
 void editorRowDelChar(struct editorConfig *E, erow *row, int at) {
     if (at < 0 || at >= row->size)
         return;
-    memmove(&row->chars[at], &row->chars[at + 1], row->size - at);
+    editorSetEditRow(E, row);
+    int rx = editorRowCxToRx(row, at);
+    int width = editorCharWidth(editorRowChar(row, at), rx);
+    editorRowMoveGap(E, row, at + 1, 0);
+    row->gap_at--;
+    row->gap++;
     row->size--;
-    editorUpdateRow(E, row);
+    editorRowPatch(E, row, at, 0, rx, rx + width);
+    editorEdited(E, JN_DEL_CHAR, rtIndexOf(row), at, NULL, 0);
     E->dirty++;
 }
 
@@ -501,38 +1220,115 @@ void editorInsertChar(struct editorConfig *E, int c) {
     if (E->cy == E->numrows) {
         editorInsertRow(E, E->numrows, "", 0);
     }
-    editorRowInsertChar(E, &E->row[E->cy], E->cx, c);
+    editorRowInsertChar(E, editorRow(E, E->cy), E->cx, c);
     E->cx++;
 }
 
 void editorInsertNewline(struct editorConfig *E) {
+    int at = E->cx == 0 ? E->cy : E->cy + 1; /* Where the new row goes. */
     if (E->cx == 0) {
         editorInsertRow(E, E->cy, "", 0);
     } else {
-        erow *row = &E->row[E->cy];
+        erow *row = editorRow(E, E->cy);
+        editorRowFlatten(E, row);
         editorInsertRow(E, E->cy + 1, &row->chars[E->cx], row->size - E->cx);
-        row = &E->row[E->cy];
-        row->size = E->cx;
-        row->chars[row->size] = '\0';
-        editorUpdateRow(E, row);
+        editorRowTruncate(E, row, E->cx);
+    }
+    /* Breaking a piece of a long line: the newline ends the row before,
+     * and the new row runs on to the next piece instead. */
+    erow *prev = at > 0 ? editorRow(E, at - 1) : NULL;
+    if (prev && prev->cont) {
+        editorRowSetContinued(E, editorRow(E, at), 1);
+        editorRowSetContinued(E, prev, 0);
     }
     E->cy++;
     E->cx = 0;
 }
 
+/* Returns the first '\r' or '\n' in [s, end), or end. */
+static const char *editorLineBreak(const char *s, const char *end) {
+    while (s < end && *s != '\r' && *s != '\n')
+        s++;
+    return s;
+}
+
+/* Insert 's' at the cursor as if typed, with '\r', '\n' and "\r\n" each
+ * breaking the line, and leave the cursor after it. The row under the
+ * cursor is cut and added to once and every further line goes in as a row
+ * of its own, rather than the text going in a key at a time. */
+void editorInsertText(struct editorConfig *E, const char *s, size_t len) {
+    const char *end = s + len;
+    const char *br = editorLineBreak(s, end);
+    if (len == 0)
+        return;
+    if (E->cy == E->numrows)
+        editorInsertRow(E, E->numrows, "", 0);
+    editorSetEditRow(E, NULL);
+    erow *row = editorRow(E, E->cy);
+
+    /* What follows the cursor goes after the text. */
+    size_t taillen = row->size - E->cx;
+    char *tail = malloc(taillen + len + 1);
+    memcpy(tail, &row->chars[E->cx], taillen);
+    editorRowTruncate(E, row, E->cx);
+    if (br == end) {
+        memmove(&tail[len], tail, taillen);
+        memcpy(tail, s, len);
+        editorRowAppendString(E, row, tail, len + taillen);
+        E->cx += len;
+        free(tail);
+        return;
+    }
+    if (br > s)
+        editorRowAppendString(E, row, (char *)s, br - s);
+
+    /* A piece of a long line ends at the first break, and the last line
+     * runs on to the next piece instead, as in editorInsertNewline(). */
+    int cont = row->cont, at = E->cy;
+    if (cont)
+        editorRowSetContinued(E, row, 0);
+    while (br < end) {
+        s = br + (br[0] == '\r' && br + 1 < end && br[1] == '\n' ? 2 : 1);
+        br = editorLineBreak(s, end);
+        at++;
+        if (br < end)
+            editorInsertRow(E, at, (char *)s, br - s);
+    }
+    memmove(&tail[end - s], tail, taillen);
+    memcpy(tail, s, end - s);
+    editorInsertRow(E, at, tail, (end - s) + taillen);
+    if (cont)
+        editorRowSetContinued(E, editorRow(E, at), 1);
+    E->cy = at;
+    E->cx = end - s;
+    free(tail);
+}
+
 void editorDelChar(struct editorConfig *E) {
     if (E->cy == E->numrows)
         return;
     if (E->cx == 0 && E->cy == 0)
         return;
 
-    erow *row = &E->row[E->cy];
+    erow *row = editorRow(E, E->cy);
+    if (E->cx == 0 && editorRow(E, E->cy - 1)->cont) {
+        /* No newline to delete after a piece of a long line, so the
+         * character before the cursor is the last of that piece. */
+        E->cy--;
+        E->cx = editorRow(E, E->cy)->size;
+        row = editorRow(E, E->cy);
+        if (E->cx == 0)
+            return;
+    }
     if (E->cx > 0) {
         editorRowDelChar(E, row, E->cx - 1);
         E->cx--;
     } else {
-        E->cx = E->row[E->cy - 1].size;
-        editorRowAppendString(E, &E->row[E->cy - 1], row->chars, row->size);
+        erow *prev = editorRow(E, E->cy - 1);
+        E->cx = prev->size;
+        editorRowFlatten(E, row);
+        editorRowAppendString(E, prev, row->chars, row->size);
+        editorRowSetContinued(E, prev, row->cont);
         editorDelRow(E, E->cy);
         E->cy--;
     }
@@ -542,50 +1338,874 @@ void editorDelChar(struct editorConfig *E) {
   * file i/o *
 \**************/
 
-char *editorRowsToString(struct editorConfig *E, int *buflen) {
-    int totlen = 0;
-    int j;
-    for (j = 0; j < E->numrows; j++) {
-        totlen += E->row[j].size + 1;
-    }
-    *buflen = totlen;
-
-    char *buf = malloc(totlen);
-    char *p = buf;
-    for (j = 0; j < E->numrows; j++) {
-        memcpy(p, E->row[j].chars, E->row[j].size);
-        p += E->row[j].size;
-        *p = '\n';
-        p++;
-    }
+/* Drop every row of the buffer. Rows and their contents all live in the
+ * slab, so this is a handful of frees however large the file was. */
+void editorClearRows(struct editorConfig *E) {
+    rtFree(&E->rows);
+    slabReset(&E->mem);
+    E->numrows = 0;
+    E->editrow = NULL;
+    E->match = NULL;
+    memset(E->rcache, 0, sizeof(erow *) * KILO_RENDER_CACHE);
+    E->rcache_hand = 0;
+    E->hlfrontier = 0;
+    E->cx = E->cy = E->rx = 0;
+    E->rowoff = E->coloff = 0;
+    E->ondisk = E->maprows = 0;
+}
 
-    return buf;
+/* Drop the buffer along with the file it was read from. */
+void editorFreeRows(struct editorConfig *E) {
+    editorSaveWait(E);
+    jnClose(&E->journal);
+    editorClearRows(E);
+    if (E->indexer)
+        liStop(E->indexer);
+    E->indexer = NULL;
+    if (E->watch)
+        platformWatchClose(E->watch);
+    E->watch = NULL;
+    if (E->stream)
+        platformStreamClose(E->stream);
+    E->stream = NULL;
+    if (E->spool)
+        platformSpoolClose(E->spool);
+    else if (E->map)
+        platformUnmapFile(E->map, E->maplen);
+    E->spool = NULL;
+    E->map = NULL;
+    E->maplen = 0;
+    E->pagerlo = E->pagerhi = E->pagerread = 0;
+    E->rows.map = NULL;
+    liFree(&E->lines);
 }
 
 void editorOpen(struct editorConfig *E, char *filename) {
+    editorFreeRows(E);
     free(E->filename);
     E->filename = strdup(filename);
+    E->gzip = 0;
 
     editorSelectSyntaxHighlight(E);
+    if (!E->pager)
+        editorSaveRecover(E);
+
+    /* Rows point straight into the mapped file until they are edited. The
+     * file is indexed in one pass and lines get a row only once they are
+     * looked at, so a large file costs little more than its line index. */
+    E->map = platformMapFile(filename, &E->maplen);
+    if (E->map == NULL || platformFileStamp(filename, &E->disk.size, &E->disk.mtime) == -1)
+        die("open");
+    /* A file still being written to may have grown since it was mapped.
+     * The buffer holds what was mapped, so it matches no stamp taken. */
+    if (E->disk.size != (long long)E->maplen) {
+        E->disk.size = E->maplen;
+        E->disk.mtime = -1;
+    }
+
+#ifdef KILO_HAVE_ZLIB
+    /* A gzip file is inflated on a thread of its own and read like standard
+     * input, so the first screen shows before the rest is inflated. It gets
+     * no journal, which is replayed on every row of the file at once. */
+    if (gzfDetect(E->map, E->maplen)) {
+        struct platformStream *s = gzfInflate(E->map, E->maplen);
+        if (s == NULL)
+            die("inflate");
+        E->map = NULL;
+        E->maplen = 0;
+        E->gzip = 1;
+        editorStreamStart(E, s);
+        return;
+    }
+#endif
+
+    E->rows.map = E->map;
+    E->mapondisk = 1;
+    E->partial = E->maplen && E->map[E->maplen - 1] != '\n';
+    E->ondisk = E->maprows = INT_MAX;
+    E->touched = INT_MAX;
+    if (E->maplen >= KILO_INDEX_BACKGROUND) {
+        /* A pager runs only as many workers as half its cap has units for. */
+        int threads = platformCpuCount();
+        if (E->pager && (size_t)threads > E->pager / 2 / LI_UNIT)
+            threads = E->pager / 2 / LI_UNIT > 1 ? E->pager / 2 / LI_UNIT : 1;
+        E->indexer = liStart(E->map, E->maplen, threads, E->pager != 0);
+        editorIndexPoll(E);
+    } else {
+        liBuild(&E->lines, E->map, E->maplen);
+        if (E->pager)
+            platformDropPages(E->map, E->maplen);
+        rtAppendLines(&E->rows, 0, E->lines.n);
+        E->numrows = E->lines.n;
+        editorIndexDone(E);
+    }
+    E->dirty = 0;
+    if (!E->pager)
+        editorJournalOpen(E);
+}
+
+/* Read the file again into a buffer with no unsaved edits. The cursor
+ * stays where it was, as far as the file still goes, or goes to the last
+ * row if 'toend'. */
+void editorReload(struct editorConfig *E, int toend) {
+    int cy = E->cy, cx = E->cx, rowoff = E->rowoff;
+    char *filename = strdup(E->filename);
+    editorOpen(E, filename);
+    free(filename);
+    editorIndexFinish(E);
+
+    if (toend || cy >= E->numrows)
+        cy = E->numrows ? E->numrows - 1 : 0;
+    E->cy = cy;
+    E->cx = (toend || E->numrows == 0 || cx > editorRow(E, cy)->size) ? 0 : cx;
+    E->rowoff = rowoff <= cy ? rowoff : cy;
+}
 
-    FILE *fp = fopen(filename, "r");
-    if (!fp)
-        die("fopen");
+/* Stop rows not edited changing with the file, which no longer is what the
+ * buffer was read from: they keep what they showed in memory of their
+ * own, and the next save writes the file whole. */
+void editorDiskDetach(struct editorConfig *E) {
+    if (E->mapondisk)
+        platformMapDetach(E->map, E->maplen);
+    E->mapondisk = 0;
+    E->ondisk = 0;
+    E->jmapped = 0;
+    E->disk.size = E->disk.mtime = -1;
+}
 
-    char *line = NULL;
-    char buf[65535];
-    while ((line = fgets(buf, sizeof(buf), fp))) {
-        int linelen = strlen(line);
-        while (linelen > 0 && (line[linelen - 1] == '\n' || line[linelen - 1] == '\r'))
-            linelen--;
-        editorInsertRow(E, E->numrows, line, linelen);
+/* Notice the file changing under its mapping. Rows not edited point into
+ * the mapping, which shows a rewrite in place as it happens and raises
+ * SIGBUS past the end of a file cut short, see platformMapDetach(). A
+ * buffer with no unsaved edits is read again; one with edits keeps what it
+ * showed in memory of its own, less what was cut off, and is saved whole.
+ * A file whose stamp was not known on opening, as it grew while mapped,
+ * is only checked for being cut short. Returns 1 if the buffer changed. */
+int editorDiskPoll(struct editorConfig *E) {
+    struct jnStamp now;
+    if (E->map == NULL || !E->mapondisk || E->follow || E->indexer || E->save || E->filename == NULL)
+        return 0;
+    if (platformFileStamp(E->filename, &now.size, &now.mtime) == -1)
+        return 0;
+    if (E->disk.mtime == -1 ? now.size >= (long long)E->maplen
+                            : now.size == E->disk.size && now.mtime == E->disk.mtime)
+        return 0;
+
+    if (!E->dirty) {
+        editorReload(E, 0);
+        editorSetStatusMessage(E, "File changed on disk, read again");
+        return 1;
     }
-    free(line);
-    fclose(fp);
+    editorDiskDetach(E);
+    if (now.size < (long long)E->maplen)
+        editorSetStatusMessage(E, "File cut short on disk: past byte %lld is zeros now, save to keep edits",
+            now.size);
+    else
+        editorSetStatusMessage(E, "File changed on disk: keeping the buffer as it was, save to keep edits");
+    return 1;
+}
+
+/* Edit what arrives on a stream, such as a pipe, shown as it comes. The
+ * text goes to a spool file and rows point into it as they do into a
+ * mapped file, so however much arrives it costs memory for its line index
+ * only. There is no file to save to until one is named. */
+void editorOpenStream(struct editorConfig *E, struct platformStream *s) {
+    editorFreeRows(E);
+    free(E->filename);
+    E->filename = NULL;
+    E->gzip = 0;
+    editorSelectSyntaxHighlight(E);
+    editorStreamStart(E, s);
+}
+
+/* Read the buffer from 's' into a spool, with no rows yet. */
+void editorStreamStart(struct editorConfig *E, struct platformStream *s) {
+    E->spool = platformSpoolCreate(KILO_STREAM_MAX, &E->map);
+    if (E->spool == NULL)
+        die("spool");
+    E->maplen = 0;
+    E->rows.map = E->map;
+    liScan(&E->lines, E->map, 0, 0);
+    E->stream = s;
+    E->mapondisk = 0;
+    E->partial = 0;
+    E->ondisk = E->maprows = 0;
+    E->touched = INT_MAX;
     E->dirty = 0;
+    editorStreamPoll(E);
+}
+
+/* Take what arrived on the stream, KILO_STREAM_CHUNK bytes at most so keys
+ * are not held up, and add a row for each line it completes. At the end of
+ * the stream the last line is added even without a newline. Returns 1 if
+ * anything arrived. */
+int editorStreamPoll(struct editorConfig *E) {
+    static char buf[KILO_STREAM_READ];
+    if (E->stream == NULL)
+        return 0;
+    size_t from = E->lines.n;
+    size_t got = 0;
+    long long n = -1;
+    while (got < KILO_STREAM_CHUNK) {
+        n = platformStreamRead(E->stream, buf, sizeof(buf));
+        if (n <= 0)
+            break;
+        if (platformSpoolWrite(E->spool, buf, n) == -1) {
+            n = -1;
+            break;
+        }
+        if (E->pager)
+            platformDropPages(E->map + E->maplen, n);
+        liScan(&E->lines, buf, n, E->maplen);
+        E->maplen += n;
+        got += n;
+    }
+    int end = n == 0 || (n == -1 && errno != EAGAIN);
+    if (n == -1 && end)
+        editorSetStatusMessage(E, "Stopped reading input: %s", strerror(errno));
+    if (end) {
+        liEnd(&E->lines, E->maplen);
+        platformStreamClose(E->stream);
+        E->stream = NULL;
+    }
+
+    rtAppendLines(&E->rows, from, E->lines.n - from);
+    E->numrows += E->lines.n - from;
+    return got || end;
+}
+
+/* Name of a file kept next to 'filename', such as its journal. */
+char *editorSidePath(const char *filename, const char *suffix) {
+    char *path = malloc(strlen(filename) + strlen(suffix) + 1);
+    strcpy(path, filename);
+    strcat(path, suffix);
+    return path;
+}
+
+/* Apply the edits logged in a journal, through the same primitives that
+ * logged them. Records that do not fit the buffer, which a journal only
+ * holds if it was damaged, are skipped. '*p' is left past the last whole
+ * record. Returns the number applied. */
+int editorReplay(struct editorConfig *E, const char **p, const char *end) {
+    struct jnRecord r;
+    int applied = 0;
+    while (jnNext(p, end, &r)) {
+        int row = r.row;
+        erow *target = (r.row < (uint32_t)E->numrows) ? editorRow(E, row) : NULL;
+        switch (r.op) {
+        case JN_INSERT_ROW:
+            if (r.row > (uint32_t)E->numrows)
+                continue;
+            editorInsertRow(E, row, (char *)r.s, r.len);
+            break;
+        case JN_DEL_ROW:
+            if (target == NULL)
+                continue;
+            editorDelRow(E, row);
+            break;
+        case JN_INSERT_CHAR:
+            if (target == NULL || r.len != 1)
+                continue;
+            editorRowInsertChar(E, target, r.at, r.s[0]);
+            break;
+        case JN_DEL_CHAR:
+            if (target == NULL)
+                continue;
+            editorRowDelChar(E, target, r.at);
+            break;
+        case JN_APPEND:
+            if (target == NULL)
+                continue;
+            editorRowAppendString(E, target, (char *)r.s, r.len);
+            break;
+        case JN_TRUNCATE:
+            if (target == NULL)
+                continue;
+            editorRowTruncate(E, target, r.at);
+            break;
+        case JN_CONTINUED:
+            if (target == NULL)
+                continue;
+            editorRowSetContinued(E, target, r.at != 0);
+            break;
+        case JN_CLEAR:
+            editorClearRows(E);
+            break;
+        case JN_LINES:
+            if (r.row > E->lines.n || r.at > E->lines.n - r.row)
+                continue;
+            rtAppendLines(&E->rows, r.row, r.at);
+            E->numrows += r.at;
+            break;
+        default:
+            continue;
+        }
+        applied++;
+    }
+    editorSetEditRow(E, NULL);
+    E->cx = E->cy = 0;
+    return applied;
+}
+
+/* Start logging edits to the file just opened. A journal left behind for
+ * the file as it is now, by an editor that did not get to save or quit, is
+ * replayed first and then added to. */
+void editorJournalOpen(struct editorConfig *E) {
+    char *path = editorSidePath(E->filename, KILO_JOURNAL_SUFFIX);
+    struct jnStamp base = E->disk;
+    size_t len = 0;
+    char *log = platformMapFile(path, &len);
+    const char *first = log ? jnCheck(log, len, base) : NULL;
+    const char *p = first;
+    if (first) {
+        /* Replaying needs every line. Nothing is logged yet meanwhile. */
+        editorIndexFinish(E);
+        int n = editorReplay(E, &p, log + len);
+        E->dirty = n;
+        if (n)
+            editorSetStatusMessage(E, "Recovered %d edits", n);
+    }
+    jnSetup(&E->journal, path, base, first ? len : 0);
+    E->jmapped = 1;
+    free(path);
+    /* Drop a last record cut short by the crash before adding more. */
+    struct jnBuf recs = { 0 };
+    if (first && p < log + len) {
+        recs.p = malloc(p - first + 1);
+        recs.len = p - first;
+        memcpy(recs.p, first, recs.len);
+    }
+    if (log)
+        platformUnmapFile(log, len);
+    if (recs.p && jnReplace(&E->journal, base, &recs) == -1)
+        jnRemove(&E->journal);
+    jnBufFree(&recs);
+}
+
+/* Rewrite the journal as the shortest log giving the buffer as it is now:
+ * runs of untouched lines as JN_LINES and every other row in full. This
+ * only works while the journal applies to the mapped file, as the line
+ * numbers are those of 'map'. */
+void editorJournalCompact(struct editorConfig *E) {
+    struct jnBuf recs = { 0 };
+    jnEncode(&recs, JN_CLEAR, 0, 0, NULL, 0);
+
+    editorSetEditRow(E, NULL);
+    struct rtIter it;
+    int more;
+    uint32_t row = 0;
+    size_t run = 0, runlen = 0; /* Lines not encoded yet. */
+    for (more = rtIterAt(&E->rows, 0, &it); more; more = rtIterNext(&it)) {
+        size_t line;
+        int k = rtIterLines(&it, &line);
+        if (k && runlen && run + runlen == line) {
+            runlen += k;
+            row += k;
+            continue;
+        }
+        if (runlen)
+            jnEncode(&recs, JN_LINES, run, runlen, NULL, 0);
+        runlen = 0;
+        if (k) {
+            run = line;
+            runlen = k;
+            row += k;
+            continue;
+        }
+        int len;
+        char *text = rtIterText(&it, &len);
+        jnEncode(&recs, JN_INSERT_ROW, row, 0, text, len);
+        if (rtIterContinued(&it))
+            jnEncode(&recs, JN_CONTINUED, row, 1, NULL, 0);
+        row++;
+    }
+    if (runlen)
+        jnEncode(&recs, JN_LINES, run, runlen, NULL, 0);
+
+    jnReplace(&E->journal, E->journal.base, &recs);
+    jnBufFree(&recs);
+}
+
+/* Write the journal while no key is pressed, and compact it once it has
+ * grown to several times what it held after the last compaction. */
+void editorJournalIdle(struct editorConfig *E) {
+    struct journal *j = &E->journal;
+    jnFlush(j);
+    if (j->size >= JN_COMPACT && j->size / 4 > j->compacted && E->jmapped && !E->indexer && !E->save)
+        editorJournalCompact(E);
+}
+
+/* Add the lines the background indexer finished since the last call to
+ * the end of the buffer. Returns 1 while indexing was still going on, as
+ * the progress shown changed. */
+int editorIndexPoll(struct editorConfig *E) {
+    if (E->indexer == NULL)
+        return 0;
+    size_t n = E->lines.n;
+    int done = liCollect(E->indexer, &E->lines);
+    rtAppendLines(&E->rows, n, E->lines.n - n);
+    E->numrows += E->lines.n - n;
+    if (done) {
+        liStop(E->indexer);
+        E->indexer = NULL;
+        editorIndexDone(E);
+    }
+    return 1;
+}
+
+/* Wait for the background indexer, when the whole file is needed. */
+void editorIndexFinish(struct editorConfig *E) {
+    if (E->indexer == NULL)
+        return;
+    size_t n = E->lines.n;
+    liFinish(E->indexer, &E->lines);
+    E->indexer = NULL;
+    rtAppendLines(&E->rows, n, E->lines.n - n);
+    E->numrows += E->lines.n - n;
+    editorIndexDone(E);
+}
+
+/* Once every line is known, limit the rows taken to be on disk as they are
+ * to whole lines of the file: a last line without a newline gets one when
+ * saved, and lines lose their '\r'. */
+void editorIndexDone(struct editorConfig *E) {
+    int n = E->lines.cr ? 0 : E->lines.n;
+    if (n && E->map[E->maplen - 1] != '\n')
+        n--;
+    if (E->ondisk > n)
+        E->ondisk = n;
+    if (E->maprows > n)
+        E->maprows = n;
+}
+
+/* A save in progress: the text of the buffer as it was when the save was
+ * started, written out by a background thread while editing goes on. */
+struct editorSaveJob {
+    char *filename;
+    struct platformIov *iov; /* Runs of the mapping and copies of rows. */
+    int n, cap;
+    struct slab copies; /* Where those copies live. */
+    long long total; /* Bytes in iov. */
+    int dirty; /* E->dirty when the snapshot was taken. */
+    int rows; /* Rows in the snapshot. */
+    int same; /* Rows at its start the file already has. */
+    long long from; /* Bytes those rows take. */
+    char *redo; /* Set to write only from 'from' on, see editorSaveTail. */
+    int inplace; /* The tail was written in place. */
+    int recut; /* Rows of a long line are not cut as LI_LINE_MAX cuts it. */
+    int gzip; /* Write it gzip-compressed, see gzfWrite. */
+    long long written; /* Bytes written, or -1 with the error in err. */
+    int err;
+    int done; /* Set by the thread once it is finished. */
+    struct platformThread *thread;
+};
+
+/* Start of the redo file an in-place save leaves while it runs. */
+struct editorRedo {
+    char magic[8];
+    long long from; /* Where in the file the tail goes. */
+    long long len; /* Bytes of tail after this header. */
+};
+
+#define KILO_REDO_MAGIC "KILOREDO"
+
+/* Add 'len' bytes at 'p' to a save, extending the last buffer when 'p'
+ * continues it, as runs of untouched lines do in the mapping. */
+void editorSaveAppend(struct editorSaveJob *job, const char *p, size_t len) {
+    job->total += len;
+    if (job->n && job->iov[job->n - 1].base + job->iov[job->n - 1].len == p) {
+        job->iov[job->n - 1].len += len;
+        return;
+    }
+    if (job->n == job->cap) {
+        job->cap = job->cap ? job->cap * 2 : 256;
+        job->iov = realloc(job->iov, sizeof(struct platformIov) * job->cap);
+    }
+    job->iov[job->n].base = p;
+    job->iov[job->n].len = len;
+    job->n++;
+}
+
+/* Add lines [line, line + k) of the mapping, as they are in the file. */
+void editorSaveLines(struct editorConfig *E, struct editorSaveJob *job, size_t line, int k) {
+    char *start = E->map + E->lines.off[line];
+    size_t len = E->lines.off[line + k] - E->lines.off[line];
+    editorSaveAppend(job, start, len);
+    if (start[len - 1] != '\n' && !liContinued(&E->lines, E->map, line + k - 1))
+        editorSaveAppend(job, "\n", 1);
+}
+
+/* Take a snapshot of the buffer to save. Text still in the mapping is
+ * referenced, as it never changes while mapped; rows with text of their
+ * own are copied. Untouched lines merge into long runs, so the snapshot is
+ * about the size of what was edited rather than of the file, and the rows
+ * before E->maprows are taken as one run without visiting them. */
+struct editorSaveJob *editorSnapshot(struct editorConfig *E) {
+    struct editorSaveJob *job = calloc(1, sizeof(struct editorSaveJob));
+    job->filename = strdup(E->filename);
+    job->dirty = E->dirty;
+    job->rows = E->numrows;
+    job->same = E->ondisk < E->numrows ? E->ondisk : E->numrows;
+
+    int i = E->maprows < job->same ? E->maprows : job->same;
+    if (i)
+        editorSaveAppend(job, E->map, E->lines.off[i]);
+    if (i == job->same)
+        job->from = job->total;
+
+    /* The rows a long line is in must be the ones reading the file back
+     * gives, pieces of LI_LINE_MAX then one that is not empty, or the
+     * journal of the file would not fit them; see editorSaveRecut(). */
+    int runon = i ? liContinued(&E->lines, E->map, i - 1) : 0;
+    struct rtIter it;
+    int more;
+    for (more = rtIterAt(&E->rows, i, &it); more; more = rtIterNext(&it)) {
+        /* Without a '\r' to trim, untouched lines are saved exactly as
+         * they are in the file, a leaf's worth at a time. */
+        size_t line;
+        int k = E->lines.cr ? 0 : rtIterLines(&it, &line);
+        if (k) {
+            if (runon && liLineLen(&E->lines, E->map, line) == 0)
+                job->recut = 1;
+            runon = liContinued(&E->lines, E->map, line + k - 1);
+            int cut = (i < job->same && i + k > job->same) ? job->same - i : k;
+            editorSaveLines(E, job, line, cut);
+            if (i < job->same && i + cut == job->same)
+                job->from = job->total;
+            if (cut < k)
+                editorSaveLines(E, job, line + cut, k - cut);
+            i += k;
+            continue;
+        }
+
+        int len;
+        char *text = rtIterText(&it, &len);
+        int cont = rtIterContinued(&it);
+        if (cont ? len != LI_LINE_MAX : len > LI_LINE_MAX || (runon && len == 0))
+            job->recut = 1;
+        runon = cont;
+        if (E->map && text >= E->map && text + len <= E->map + E->maplen) {
+            editorSaveAppend(job, text, len);
+            /* Take the newline from the mapping too when it follows. */
+            if (text + len < E->map + E->maplen && text[len] == '\n')
+                editorSaveAppend(job, &text[len], 1);
+            else if (!cont)
+                editorSaveAppend(job, "\n", 1);
+        } else {
+            if (len) {
+                char *copy = slabAlloc(&job->copies, len);
+                memcpy(copy, text, len);
+                editorSaveAppend(job, copy, len);
+            }
+            if (!cont)
+                editorSaveAppend(job, "\n", 1);
+        }
+        if (++i == job->same)
+            job->from = job->total;
+    }
+    if (runon)
+        job->recut = 1;
+    return job;
+}
+
+/* Bytes rows [from, to) take in the file, counted no further than just
+ * past 'limit'. */
+long long editorRowBytes(struct editorConfig *E, int from, int to, long long limit) {
+    long long bytes = 0;
+    struct rtIter it;
+    int i = from;
+    int more;
+    for (more = rtIterAt(&E->rows, from, &it); more && i < to && bytes <= limit; more = rtIterNext(&it)) {
+        size_t line;
+        int k = E->lines.cr ? 0 : rtIterLines(&it, &line);
+        if (k) {
+            if (k > to - i)
+                k = to - i;
+            bytes += E->lines.off[line + k] - E->lines.off[line];
+            if (E->map[E->lines.off[line + k] - 1] != '\n' && !liContinued(&E->lines, E->map, line + k - 1))
+                bytes++;
+            i += k;
+            continue;
+        }
+        int len;
+        rtIterText(&it, &len);
+        bytes += len + !rtIterContinued(&it);
+        i++;
+    }
+    return bytes;
+}
+
+/* Decide whether the save can rewrite just the end of the file, from the
+ * first row edited on. That needs the file to be as the buffer last read
+ * or wrote it, and the tail to be short next to what stays. When the
+ * mapping is the file itself, the rows of the tail are given text of
+ * their own first, as rewriting changes what the mapping shows there. */
+int editorSaveInPlace(struct editorConfig *E) {
+    struct jnStamp now;
+    if (E->map == NULL || E->gzip || platformFileStamp(E->filename, &now.size, &now.mtime) == -1)
+        return 0;
+    if (now.size != E->disk.size || now.mtime != E->disk.mtime)
+        return 0;
+
+    int same = E->ondisk < E->numrows ? E->ondisk : E->numrows;
+    int m = E->maprows < same ? E->maprows : same;
+    long long tail = editorRowBytes(E, same, E->numrows, KILO_SAVE_IN_PLACE);
+    if (tail > KILO_SAVE_IN_PLACE)
+        return 0;
+    if ((long long)E->lines.off[m] + editorRowBytes(E, m, same, tail) < tail)
+        return 0;
+
+    if (E->mapondisk) {
+        for (int i = same; i < E->numrows; i++)
+            editorRowOwn(E, editorRow(E, i));
+    }
+    return 1;
+}
+
+/* Write iov[0, n), PLATFORM_IOV_MAX buffers at a time. */
+int editorSaveWrite(struct platformFile *f, struct platformIov *iov, int n) {
+    for (int i = 0; i < n; i += PLATFORM_IOV_MAX) {
+        int k = n - i < PLATFORM_IOV_MAX ? n - i : PLATFORM_IOV_MAX;
+        if (platformWriteFile(f, &iov[i], k) == -1)
+            return -1;
+    }
+    return 0;
+}
+
+/* Overwrite the file from job->from on with the rest of the snapshot and
+ * cut it to length. The tail is made durable in the redo file first, and
+ * removed once the file has it, so a crash halfway is finished by the
+ * next editorOpen rather than leaving the file mangled. Returns 0, or -1
+ * with errno set. */
+int editorSaveTail(struct editorSaveJob *job) {
+    int i = 0;
+    long long at = 0;
+    while (i < job->n && at + (long long)job->iov[i].len <= job->from)
+        at += job->iov[i++].len;
+    struct platformIov *tail = &job->iov[i];
+    int n = job->n - i;
+    struct platformIov keep = { 0 };
+    if (n) {
+        keep = *tail;
+        tail->base += job->from - at;
+        tail->len -= job->from - at;
+    }
+
+    struct editorRedo redo = { KILO_REDO_MAGIC, job->from, job->total - job->from };
+    struct platformIov head = { (const char *)&redo, sizeof(redo) };
+    int res = -1;
+    struct platformFile *f = platformCreateReplacement(job->redo);
+    if (f) {
+        if (platformWriteFile(f, &head, 1) == -1 || editorSaveWrite(f, tail, n) == -1)
+            platformAbortFile(f);
+        else if (platformCommitFile(f) == 0 && (f = platformOpenFile(job->filename)) != NULL) {
+            if (platformSeekFile(f, job->from) == 0 && editorSaveWrite(f, tail, n) == 0
+                && platformTruncateFile(f, job->total) == 0 && platformSyncFile(f) == 0)
+                res = 0;
+            int err = errno;
+            platformCloseFile(f);
+            errno = err;
+        }
+    }
+    if (n)
+        *tail = keep;
+    if (res == 0)
+        remove(job->redo);
+    return res;
+}
+
+/* Finish an in-place save of the file being opened that was cut short, from
+ * the redo file it left. */
+void editorSaveRecover(struct editorConfig *E) {
+    char *path = editorSidePath(E->filename, KILO_REDO_SUFFIX);
+    size_t len;
+    char *map = platformMapFile(path, &len);
+    if (map == NULL) {
+        free(path);
+        return;
+    }
+
+    struct editorRedo redo;
+    struct jnStamp now;
+    int valid = len >= sizeof(redo);
+    if (valid) {
+        memcpy(&redo, map, sizeof(redo));
+        valid = !memcmp(redo.magic, KILO_REDO_MAGIC, 8) && redo.len == (long long)(len - sizeof(redo))
+            && platformFileStamp(E->filename, &now.size, &now.mtime) == 0 && now.size >= redo.from;
+    }
+    int done = 0;
+    struct platformFile *f = valid ? platformOpenFile(E->filename) : NULL;
+    if (f) {
+        struct platformIov tail = { map + sizeof(redo), redo.len };
+        done = platformSeekFile(f, redo.from) == 0 && platformWriteFile(f, &tail, 1) == 0
+            && platformTruncateFile(f, redo.from + redo.len) == 0 && platformSyncFile(f) == 0;
+        platformCloseFile(f);
+    }
+    platformUnmapFile(map, len);
+    /* One that does not fit the file is of no use either. */
+    if (done || !valid)
+        remove(path);
+    if (done)
+        editorSetStatusMessage(E, "Finished an interrupted save");
+    free(path);
+}
+
+/* Write a snapshot, on its own thread; the result is picked up by
+ * editorSavePoll. The tail goes in place when the snapshot allows it;
+ * otherwise, or if that fails, the whole of it goes to a new file renamed
+ * over the old one. */
+void editorSaveThread(void *arg) {
+    struct editorSaveJob *job = arg;
+    job->written = -1;
+    if (job->redo && editorSaveTail(job) == 0) {
+        job->inplace = 1;
+        job->written = job->total - job->from;
+        __atomic_store_n(&job->done, 1, __ATOMIC_RELEASE);
+        return;
+    }
+
+    struct platformFile *f = platformCreateReplacement(job->filename);
+    if (f) {
+        long long written;
+#ifdef KILO_HAVE_ZLIB
+        if (job->gzip)
+            written = gzfWrite(f, job->iov, job->n);
+        else
+#endif
+            written = editorSaveWrite(f, job->iov, job->n) == -1 ? -1 : job->total;
+        if (written == -1)
+            platformAbortFile(f);
+        else if (platformCommitFile(f) == 0)
+            job->written = written;
+    }
+    job->err = errno;
+    /* A redo file left by a failed attempt in place is out of date now. */
+    if (job->redo && job->written != -1)
+        remove(job->redo);
+    __atomic_store_n(&job->done, 1, __ATOMIC_RELEASE);
+}
+
+/* Move the journal over to the file just saved: it now holds only the
+ * edits made while saving, if any, and no longer refers to lines of the
+ * mapping. */
+void editorJournalSaved(struct editorConfig *E, int clean) {
+    struct journal *j = &E->journal;
+    struct jnStamp base = E->disk;
+    E->jmapped = 0;
+    if (base.size == -1 || E->gzip) {
+        jnRemove(j);
+        jnClose(j);
+        return;
+    }
+    if (j->path == NULL) {
+        char *path = editorSidePath(E->filename, KILO_JOURNAL_SUFFIX);
+        jnSetup(j, path, base, 0);
+        free(path);
+        return;
+    }
+    if (clean || jnReplace(j, base, &j->kept) == -1) {
+        jnRemove(j);
+        j->base = base;
+    }
+    jnKeep(j, 0);
+}
+
+/* Report a finished save. The buffer is clean only if nothing was edited
+ * after the snapshot was taken. Rows are read back if the save asks for it,
+ * see editorSaveRecut(), unless 'closing' as the buffer is about to go. */
+void editorSaveEnd(struct editorConfig *E, int closing) {
+    struct editorSaveJob *job = E->save;
+    if (job->thread)
+        platformJoinThread(job->thread);
+
+    if (job->written == -1) {
+        /* An attempt in place may have changed the file past 'from'. */
+        if (job->redo && E->ondisk > job->same)
+            E->ondisk = job->same;
+        jnKeep(&E->journal, 0);
+        editorSetStatusMessage(E, "Can't save! I/O error: %s", strerror(job->err));
+    } else {
+        if (!job->inplace)
+            E->mapondisk = 0;
+        E->ondisk = E->touched < job->rows ? E->touched : job->rows;
+        /* No row of a compressed file is at an offset in it to write to. */
+        if (job->gzip)
+            E->ondisk = 0;
+        E->partial = 0;
+        if (platformFileStamp(E->filename, &E->disk.size, &E->disk.mtime) == -1)
+            E->disk.size = E->disk.mtime = -1;
+        /* A new file took the place of the one followed. */
+        if (E->watch && !job->inplace) {
+            platformWatchClose(E->watch);
+            E->watch = platformWatchFile(E->filename);
+        }
+        editorJournalSaved(E, E->dirty == job->dirty);
+        if (E->dirty == job->dirty)
+            E->dirty = 0;
+        /* Logged row numbers would not match the rows of the file read
+         * back, which editorSaveRecut() fixes once the buffer is clean. */
+        if (job->recut && E->dirty) {
+            jnRemove(&E->journal);
+            E->journal.error = 1;
+        }
+        editorSetStatusMessage(E, "%lld bytes written to disk", job->written);
+    }
+    int recut = job->recut && job->written != -1 && E->dirty == 0 && !closing;
+    free(job->filename);
+    free(job->iov);
+    free(job->redo);
+    slabReset(&job->copies);
+    free(job);
+    E->save = NULL;
+    if (recut)
+        editorSaveRecut(E);
 }
 
+/* Returns 1 if a save finished. */
+int editorSavePoll(struct editorConfig *E) {
+    if (E->save == NULL || !__atomic_load_n(&E->save->done, __ATOMIC_ACQUIRE))
+        return 0;
+    editorSaveEnd(E, 0);
+    return 1;
+}
+
+/* Read the file just saved back in when edits left a long line in rows
+ * other than the ones reading it gives, see LI_LINE_MAX, so that the rows
+ * the journal numbers are those of the file. The buffer is clean, so only
+ * where the line is cut changes; the cursor stays on the same row. */
+void editorSaveRecut(struct editorConfig *E) {
+    struct platformWatch *w = E->watch;
+    int cy = E->cy, cx = E->cx;
+    E->watch = NULL;
+    char *filename = strdup(E->filename);
+    editorOpen(E, filename);
+    free(filename);
+    editorIndexFinish(E);
+    E->watch = w;
+
+    if (cy >= E->numrows)
+        cy = E->numrows ? E->numrows - 1 : 0;
+    E->cy = cy;
+    E->cx = (E->numrows == 0 || cx > editorRow(E, cy)->size) ? 0 : cx;
+}
+
+/* Wait for a save in progress, before the mapping goes away or on exit. */
+void editorSaveWait(struct editorConfig *E) {
+    if (E->save == NULL)
+        return;
+    editorSaveEnd(E, 1);
+}
+
+/* Start saving the buffer in the background. Only taking the snapshot
+ * holds up editing. */
 void editorSave(struct editorConfig *E) {
+    if (E->pager) {
+        editorSetStatusMessage(E, "Read-only, opened with -R");
+        return;
+    }
+    if (E->save) {
+        editorSetStatusMessage(E, "Already saving, try again when done");
+        return;
+    }
     if (E->filename == NULL) {
         E->filename = editorPrompt(E, "Save as: %s (ESC to cancel)", NULL);
         if (E->filename == NULL) {
@@ -593,44 +2213,243 @@ void editorSave(struct editorConfig *E) {
             return;
         }
         editorSelectSyntaxHighlight(E);
+#ifdef KILO_HAVE_ZLIB
+        size_t len = strlen(E->filename);
+        E->gzip = len > 3 && strcmp(E->filename + len - 3, ".gz") == 0;
+#endif
     }
 
-    int len;
-    char *buf = editorRowsToString(E, &len);
-
-    int fd = open(E->filename, O_RDWR | O_CREAT, 0644);
-    if (fd != -1) {
-        if (ftruncate(fd, len) != -1) {
-            if (write(fd, buf, len) == len) {
-                close(fd);
-                free(buf);
-                E->dirty = 0;
-                editorSetStatusMessage(E, "%d bytes written to disk", len);
-                return;
-            }
+    editorSetEditRow(E, NULL);
+    editorIndexFinish(E);
+    editorDiskPoll(E);
+
+    int inplace = editorSaveInPlace(E);
+    jnKeep(&E->journal, 1);
+    E->save = editorSnapshot(E);
+    E->save->gzip = E->gzip;
+    if (inplace)
+        E->save->redo = editorSidePath(E->filename, KILO_REDO_SUFFIX);
+    E->touched = INT_MAX;
+    editorSetStatusMessage(E, "Saving...");
+    E->save->thread = platformStartThread(editorSaveThread, E->save);
+    if (E->save->thread == NULL)
+        editorSaveThread(E->save);
+    editorSavePoll(E);
+}
+
+/************\
+  * follow *
+\************/
+
+/* Add text read from the end of the file: its first line finishes the last
+ * row if the file had left it without a newline, the others are new rows.
+ * The rows are the file's, so nothing is logged or made dirty. */
+void editorFollowAppend(struct editorConfig *E, const char *p, size_t len) {
+    const char *end = p + len;
+    while (p < end) {
+        const char *nl = memchr(p, '\n', end - p);
+        size_t n = (nl ? nl : end) - p;
+        while (nl && n && p[n - 1] == '\r')
+            n--;
+        erow *last = E->partial && E->numrows ? editorRow(E, E->numrows - 1) : NULL;
+        /* A line longer than LI_LINE_MAX goes on in rows of its own, cut
+         * where the line index would cut it. */
+        if (last && last->size >= LI_LINE_MAX) {
+            last->cont = 1;
+            last = NULL;
+        }
+        size_t room = LI_LINE_MAX - (last ? last->size : 0);
+        if (n > room) {
+            n = room;
+            nl = NULL;
         }
-        close(fd);
+        if (last) {
+            editorRowAppend(E, last, p, n);
+        } else {
+            editorSetRow(E, rtInsert(&E->rows, E->numrows), (char *)p, n);
+            editorSyntaxInvalidate(E, E->numrows);
+            E->numrows++;
+        }
+        E->partial = nl == NULL;
+        p = nl ? nl + 1 : p + n;
+    }
+}
+
+/* Read what was appended to the followed file, from where the buffer ends
+ * in it up to 'size'. Only the new bytes are read and only new rows made,
+ * so this costs what was appended whatever the size of the file. The view
+ * keeps up with the end of the file while the cursor is on the last row.
+ * Returns 1 if anything was read. */
+int editorFollowRead(struct editorConfig *E, long long size, long long mtime) {
+    static char buf[KILO_FOLLOW_CHUNK];
+    int atend = E->cy >= E->numrows - 1;
+    /* Whether the file had every whole row as it is, and still does. */
+    int same = E->ondisk >= E->numrows - E->partial;
+    long long off = E->disk.size;
+    while (off < size) {
+        long long n = size - off < KILO_FOLLOW_CHUNK ? size - off : KILO_FOLLOW_CHUNK;
+        n = platformWatchRead(E->watch, off, buf, n);
+        if (n <= 0)
+            break;
+        if (memchr(buf, '\r', n))
+            same = 0;
+        editorFollowAppend(E, buf, n);
+        off += n;
+    }
+    if (off == E->disk.size)
+        return 0;
+
+    E->disk.size = off;
+    E->disk.mtime = off == size ? mtime : -1;
+    if (same)
+        E->ondisk = E->numrows - E->partial;
+    /* The buffer has no unsaved edits, so there is nothing logged: the next
+     * record starts a log for the file as it is now. */
+    E->journal.base = E->disk;
+
+    if (atend && E->numrows) {
+        E->cy = E->numrows - 1;
+        E->cx = 0;
+    }
+    return 1;
+}
+
+/* Read the followed file again after it was truncated or replaced, as
+ * logs are when rotated. While nothing is at its path, as halfway through
+ * a rotation, this is tried again on the next poll. Following stops
+ * rather than throw away unsaved edits, and the buffer lets go of the
+ * file, which may be shorter than its mapping now. Returns 1 if the buffer
+ * changed. */
+int editorFollowReload(struct editorConfig *E) {
+    if (E->watch)
+        platformWatchClose(E->watch);
+    E->watch = NULL;
+    if (E->dirty) {
+        editorDiskDetach(E);
+        E->follow = 0;
+        editorSetStatusMessage(E, "File changed on disk, stopped following: buffer has unsaved changes");
+        return 1;
     }
-    free(buf);
-    editorSetStatusMessage(E, "Can't save! I/O error: %s", strerror(errno));
+    /* Watching first, a file replaced again while being read shows up as
+     * replaced on the next poll. */
+    struct platformWatch *w = platformWatchFile(E->filename);
+    if (w == NULL)
+        return 0;
+
+    editorReload(E, E->cy >= E->numrows - 1);
+    E->watch = w;
+    return 1;
+}
+
+/* Pick up changes to the followed file, reading what was appended and
+ * reloading it if it got shorter or was replaced. Waits while lines are
+ * still being indexed or a save is running, as both need the rows to stay
+ * as they are. Returns 1 if the buffer changed. */
+int editorFollowPoll(struct editorConfig *E) {
+    if (!E->follow || E->indexer || E->save)
+        return 0;
+    if (E->watch == NULL)
+        return editorFollowReload(E);
+    long long size, mtime;
+    int events = platformWatchPoll(E->watch, &size, &mtime);
+    if (events == 0)
+        return 0;
+    if ((events & PLATFORM_WATCH_REPLACED) || size < E->disk.size)
+        return editorFollowReload(E);
+    if (size == E->disk.size)
+        return 0;
+    if (E->dirty) {
+        platformWatchClose(E->watch);
+        E->watch = NULL;
+        E->follow = 0;
+        editorSetStatusMessage(E, "File grew on disk, stopped following: buffer has unsaved changes");
+        return 1;
+    }
+    return editorFollowRead(E, size, mtime);
+}
+
+/* Start or stop following the file, showing what is appended to it as it
+ * is written, like tail -f. */
+void editorToggleFollow(struct editorConfig *E) {
+    if (E->follow) {
+        if (E->watch)
+            platformWatchClose(E->watch);
+        E->watch = NULL;
+        E->follow = 0;
+        editorSetStatusMessage(E, "Stopped following");
+        return;
+    }
+    if (E->filename == NULL || E->disk.size == -1) {
+        editorSetStatusMessage(E, "Nothing on disk to follow");
+        return;
+    }
+    if (E->gzip) {
+        editorSetStatusMessage(E, "Can't follow a compressed file");
+        return;
+    }
+    E->watch = platformWatchFile(E->filename);
+    if (E->watch == NULL) {
+        editorSetStatusMessage(E, "Can't follow: %s", strerror(errno));
+        return;
+    }
+    E->follow = 1;
+    editorSetStatusMessage(E, "Following, F to stop");
+}
+
+/* Choose whether saving compresses the file with gzip, as it does for a
+ * file read compressed or saved under a name ending in .gz. */
+void editorToggleGzip(struct editorConfig *E) {
+#ifdef KILO_HAVE_ZLIB
+    E->gzip = !E->gzip;
+    editorSetStatusMessage(E, E->gzip ? "Saving gzip-compressed, Z to change"
+                                      : "Saving uncompressed, Z to change");
+#else
+    editorSetStatusMessage(E, "Built without gzip support");
+#endif
 }
 
 /**********\
   * find *
 \**********/
 
+/* Return the offset of 'query' in the 'size' bytes at 's', or -1. The text
+ * need not be terminated, as mapped text is not. */
+static int editorFindIn(char *s, int size, char *query) {
+    int qlen = strlen(query);
+    for (int j = 0; j + qlen <= size; j++) {
+        char *p = memchr(&s[j], query[0], size - j);
+        if (p == NULL || qlen == 0)
+            return qlen ? -1 : 0;
+        j = p - s;
+        if (j + qlen <= size && !memcmp(p, query, qlen))
+            return j;
+    }
+    return -1;
+}
+
+/* Return the render offset of 'query' in row 'at', or -1. Text without a
+ * tab renders as itself, so it is searched without building render, or a
+ * row at all for lines not looked at yet. */
+int editorRowFind(struct editorConfig *E, int at, char *query) {
+    struct rtIter it;
+    rtIterAt(&E->rows, at, &it);
+    erow *row = rtIterRow(&it);
+    int size;
+    char *chars = (row == NULL || row->render == NULL) ? rtIterText(&it, &size) : NULL;
+    if (chars && E->pager)
+        editorPagerRead(E, size);
+    if (chars && memchr(chars, '\t', size) == NULL)
+        return editorFindIn(chars, size, query);
+    row = editorRow(E, at);
+    editorRenderRow(E, row);
+    return editorFindIn(row->render, row->rsize, query);
+}
+
 void editorFindCallback(struct editorConfig *E, char *query, int key) {
     static int last_match = -1;
     static int direction = 1;
 
-    static int saved_hl_line;
-    static char *saved_hl = NULL;
-
-    if (saved_hl) {
-        memcpy(E->row[saved_hl_line].hl, saved_hl, E->row[saved_hl_line].rsize);
-        free(saved_hl);
-        saved_hl = NULL;
-    }
+    E->match = NULL;
 
     if (key == '\r' || key == '\x1b') {
         last_match = -1;
@@ -656,18 +2475,17 @@ void editorFindCallback(struct editorConfig *E, char *query, int key) {
         else if (current == E->numrows)
             current = 0;
 
-        erow *row = &E->row[current];
-        char *match = strstr(row->render, query);
-        if (match) {
+        int at = editorRowFind(E, current, query);
+        if (at != -1) {
+            erow *row = editorRow(E, current);
             last_match = current;
             E->cy = current;
-            E->cx = editorRowRxToCx(row, match - row->render);
+            E->cx = editorRowRxToCx(row, at);
             E->rowoff = E->numrows;
 
-            saved_hl_line = current;
-            saved_hl = malloc(row->rsize);
-            memcpy(saved_hl, row->hl, row->rsize);
-            memset(&row->hl[match - row->render], HL_MATCH, strlen(query));
+            E->match = row;
+            E->match_at = at;
+            E->match_len = strlen(query);
             break;
         }
     }
@@ -692,31 +2510,24 @@ void editorFind(struct editorConfig *E) {
     }
 }
 
-/*******************\
-  * append buffer *
-\*******************/
-
-// buffer struct is to prevent
-// many small write() calls
-struct abuf {
-    char *b;
-    int len;
-};
-
-#define ABUF_INIT { NULL, 0 }
-
-void abAppend(struct abuf *ab, const char *s, int len) {
-    char *new = realloc(ab->b, ab->len + len);
-
-    if (new == NULL)
+/* Jump to a line number the user types. Rows are found by index in the
+ * tree, so only the rows that end up on screen are built. */
+void editorGotoLine(struct editorConfig *E) {
+    char *num = editorPrompt(E, "Go to line: %s (ESC to cancel)", NULL);
+    if (num == NULL)
         return;
-    memcpy(&new[ab->len], s, len);
-    ab->b = new;
-    ab->len += len;
-}
-
-void abFree(struct abuf *ab) {
-    free(ab->b);
+    long line = atol(num);
+    free(num);
+
+    if (line > E->numrows)
+        editorIndexFinish(E);
+    if (line > E->numrows)
+        line = E->numrows;
+    if (line < 1)
+        line = 1;
+    E->cy = line - 1;
+    E->cx = 0;
+    E->rowoff = E->numrows;
 }
 
 /************\
@@ -724,9 +2535,12 @@ void abFree(struct abuf *ab) {
 \************/
 
 void editorScroll(struct editorConfig *E) {
+    if (E->editrow && E->editrow != editorRow(E, E->cy))
+        editorSetEditRow(E, NULL);
+
     E->rx = 0;
     if (E->cy < E->numrows) {
-        E->rx = editorRowCxToRx(&E->row[E->cy], E->cx);
+        E->rx = editorRowCxToRx(editorRow(E, E->cy), E->cx);
     }
 
     if (E->cy < E->rowoff) {
@@ -743,11 +2557,111 @@ void editorScroll(struct editorConfig *E) {
     }
 }
 
-void editorDrawRows(struct editorConfig *E, struct abuf *ab) {
+/* Add the span [start, end) with highlight 'hl' to 'out', cutting out the
+ * part the search match covers. */
+static int editorAddSpan(hlspan *out, int n, int start, int end, int hl, int ms, int me) {
+    if (start < ms) {
+        hlspan span = { start, (end < ms ? end : ms) - start, hl };
+        out[n++] = span;
+    }
+    if (end > me) {
+        int from = start > me ? start : me;
+        hlspan span = { from, end - from, hl };
+        out[n++] = span;
+    }
+    return n;
+}
+
+/* Fill 'out' with the highlighted spans of render columns [from, from +
+ * len) of 'row', relative to 'from', with the search match laid over them.
+ * 'out' needs room for len + 2 spans. Returns the number of spans. */
+int editorWindowSpans(struct editorConfig *E, erow *row, int from, int len, hlspan *out) {
+    int ms = len, me = len;
+    if (row == E->match) {
+        ms = E->match_at - from;
+        me = ms + E->match_len;
+        if (ms < 0)
+            ms = 0;
+        if (me > len)
+            me = len;
+        if (ms >= me)
+            ms = me = len;
+    }
+
+    int n = 0;
+    if (row->hl) {
+        unsigned char *hl = &row->hl[from];
+        int i, j;
+        for (i = 0; i < len; i = j) {
+            for (j = i + 1; j < len && hl[j] == hl[i]; j++)
+                ;
+            if (hl[i] != HL_NORMAL)
+                n = editorAddSpan(out, n, i, j, hl[i], ms, me);
+        }
+    } else {
+        /* Spans are sorted; find the first one ending past 'from'. */
+        int lo = 0, hi = row->nspans;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if ((int)(row->spans[mid].start + row->spans[mid].len) <= from)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        for (int k = lo; k < row->nspans && (int)row->spans[k].start < from + len; k++) {
+            int start = (int)row->spans[k].start - from;
+            int end = start + row->spans[k].len;
+            n = editorAddSpan(out, n, start < 0 ? 0 : start, end > len ? len : end,
+                row->spans[k].hl, ms, me);
+        }
+    }
+
+    if (ms < me) {
+        int k = 0;
+        while (k < n && (int)out[k].start < ms)
+            k++;
+        memmove(&out[k + 1], &out[k], sizeof(hlspan) * (n - k));
+        hlspan span = { ms, me - ms, HL_MATCH };
+        out[k] = span;
+        n++;
+    }
+    return n;
+}
+
+/* The attributes cells of highlight color 'color' are drawn with. */
+static int editorColorAttr(int color) {
+    if (color == -1)
+        return 0;
+    return (color - 29) | (color == 32 || color == 33 ? SCR_BOLD : 0);
+}
+
+/* Put 'len' rendered characters at row 'y', column 'x' with 'attr',
+ * showing control characters inverted. Returns the column after them. */
+int editorDrawText(struct editorConfig *E, int y, int x, char *s, int len, int attr) {
+    int j, from = 0;
+    for (j = 0; j < len; j++) {
+        if (!iscntrl(s[j]))
+            continue;
+        x = scrPut(&E->screen, y, x, &s[from], j - from, attr);
+        from = j + 1;
+
+        char sym = (s[j] <= 26) ? '@' + s[j] : '?';
+        x = scrPut(&E->screen, y, x, &sym, 1, attr | SCR_INVERSE);
+    }
+    return scrPut(&E->screen, y, x, &s[from], len - from, attr);
+}
+
+void editorDrawRows(struct editorConfig *E) {
+    if (E->spanbufcap < E->screencols + 2) {
+        E->spanbufcap = E->screencols + 2;
+        E->spanbuf = realloc(E->spanbuf, sizeof(hlspan) * E->spanbufcap);
+    }
+    hlspan *spans = E->spanbuf;
     int y;
     for (y = 0; y < E->screenrows; y++) {
         int filerow = y + E->rowoff;
         if (filerow >= E->numrows) {
+            scrPut(&E->screen, y, 0, "~", 1, 0);
             if (E->numrows == 0 && y == E->screenrows / 3) {
                 char welcome[80];
                 int welcomelen = snprintf(welcome, sizeof(welcome),
@@ -755,135 +2669,99 @@ void editorDrawRows(struct editorConfig *E, struct abuf *ab) {
                 if (welcomelen > E->screencols)
                     welcomelen = E->screencols;
                 int padding = (E->screencols - welcomelen) / 2;
-                if (padding) {
-                    abAppend(ab, "~", 1);
-                    padding--;
-                }
-                while (padding--)
-                    abAppend(ab, " ", 1);
-                abAppend(ab, welcome, welcomelen);
-            } else {
-                abAppend(ab, "~", 1);
+                scrPut(&E->screen, y, padding, welcome, welcomelen, 0);
             }
         } else {
-            int len = E->row[filerow].rsize - E->coloff;
+            erow *row = editorRow(E, filerow);
+            editorRenderRow(E, row);
+            int len = row->rsize - E->coloff;
             if (len < 0)
                 len = 0;
             if (len > E->screencols)
                 len = E->screencols;
-            char *c = &E->row[filerow].render[E->coloff];
-            unsigned char *hl = &E->row[filerow].hl[E->coloff];
-            int current_color = -1;
-            int j;
-            for (j = 0; j < len; j++) {
-                if (iscntrl(c[j])) {
-                    char sym = (c[j] <= 26) ? '@' + c[j] : '?';
-                    abAppend(ab, "\x1b[7m", 4);
-                    abAppend(ab, &sym, 1);
-                    abAppend(ab, "\x1b[m", 3);
-                    if (current_color != -1) {
-                        char buf[16];
-                        int clen;
-                        // if (current_color == editorSyntaxToColor(HL_KEYWORD1) ||
-                        //     current_color == editorSyntaxToColor(HL_KEYWORD2)) {
-                        if (current_color == 32 || current_color == 33) {
-                            clen = snprintf(buf, sizeof(buf), "\x1b[1;%dm", current_color);
-                        } else {
-                            clen = snprintf(buf, sizeof(buf), "\x1b[%dm", current_color);
-                        }
-                        abAppend(ab, buf, clen);
-                        // abAppend(ab, "\x1b[m", 3);
-                    }
-                } else if (hl[j] == HL_NORMAL) {
-                    if (current_color != -1) {
-                        abAppend(ab, "\x1b[39m", 5);
-                        current_color = -1;
-                    }
-                    abAppend(ab, &c[j], 1);
-                } else {
-                    int color = editorSyntaxToColor(hl[j]);
-                    if (color != current_color) {
-                        char buf[16];
-                        int clen;
-                        // if (current_color == editorSyntaxToColor(HL_KEYWORD1) ||
-                        //     current_color == editorSyntaxToColor(HL_KEYWORD2)) {
-                        if (current_color == 32 || current_color == 33) {
-                            current_color = color;
-                            clen = snprintf(buf, sizeof(buf), "\x1b[1;%dm", current_color);
-                        } else {
-                            current_color = color;
-                            clen = snprintf(buf, sizeof(buf), "\x1b[%dm", current_color);
-                        }
-                        abAppend(ab, buf, clen);
-                        // abAppend(ab, "\x1b[m", 3);
-                    }
-                    abAppend(ab, &c[j], 1);
+            char *c = &row->render[E->coloff];
+            int n = editorWindowSpans(E, row, E->coloff, len, spans);
+            int at = 0;
+            for (int k = 0; k <= n; k++) {
+                int start = k < n ? (int)spans[k].start : len;
+                if (at < start) {
+                    editorDrawText(E, y, at, &c[at], start - at, 0);
+                    at = start;
                 }
+                if (k == n)
+                    break;
+                editorDrawText(E, y, at, &c[at], spans[k].len,
+                    editorColorAttr(editorSyntaxToColor(spans[k].hl)));
+                at += spans[k].len;
             }
-            abAppend(ab, "\x1b[39m", 5);
         }
-
-        abAppend(ab, "\x1b[K", 3);
-        abAppend(ab, "\r\n", 2);
     }
 }
 
-void editorDrawStatusBar(struct editorConfig *E, struct abuf *ab) {
-    abAppend(ab, "\x1b[7m", 4);
+void editorDrawStatusBar(struct editorConfig *E) {
     char status[80], rstatus[80];
-    int len = snprintf(status, sizeof(status), " %s | %.20s - %d lines %s",
-        E->mode ? "NORMAL" : "INSERT",
-        E->filename ? E->filename : "[No Name]",
-        E->numrows, E->dirty ? "(modified)" : "");
+    int len;
+    if (E->indexer) {
+        /* Estimate the total from the newline density seen so far. */
+        size_t bytes, lines;
+        liProgress(E->indexer, &bytes, &lines);
+        len = snprintf(status, sizeof(status), " %s | %.20s - ~%.0f lines, indexing %d%% %s",
+            E->mode ? "NORMAL" : "INSERT",
+            E->filename ? E->filename : "[No Name]",
+            (double)lines * E->maplen / bytes, (int)(100.0 * bytes / E->maplen),
+            E->dirty ? "(modified)" : E->pager ? "(read-only)" : "");
+    } else if (E->stream) {
+        len = snprintf(status, sizeof(status), " %s | %.20s - %d lines, reading %.1f MB %s",
+            E->mode ? "NORMAL" : "INSERT",
+            E->filename ? E->filename : "[No Name]",
+            E->numrows, E->maplen / 1e6, E->dirty ? "(modified)" : E->pager ? "(read-only)" : "");
+    } else {
+        len = snprintf(status, sizeof(status), " %s | %.20s - %d lines %s",
+            E->mode ? "NORMAL" : "INSERT",
+            E->filename ? E->filename : "[No Name]",
+            E->numrows, E->dirty ? "(modified)" : E->pager ? "(read-only)" : "");
+    }
     int rlen = snprintf(rstatus, sizeof(rstatus), "%s | %d/%d ",
         E->syntax ? E->syntax->filetype : "no ft", E->cy + 1, E->numrows);
     if (len > E->screencols)
         len = E->screencols;
-    abAppend(ab, status, len);
-    while (len < E->screencols) {
-        if (E->screencols - len == rlen) {
-            abAppend(ab, rstatus, rlen);
-            break;
-        } else {
-            abAppend(ab, " ", 1);
-            len++;
-        }
-    }
-    abAppend(ab, "\x1b[m", 3);
-    abAppend(ab, "\r\n", 2);
+    int y = E->screenrows;
+    scrPut(&E->screen, y, 0, status, len, SCR_INVERSE);
+    scrFill(&E->screen, y, len, E->screencols - len, SCR_INVERSE);
+    if (E->screencols - len >= rlen)
+        scrPut(&E->screen, y, E->screencols - rlen, rstatus, rlen, SCR_INVERSE);
 }
 
-void editorDrawMessageBar(struct editorConfig *E, struct abuf *ab) {
-    abAppend(ab, "\x1b[K", 3);
+void editorDrawMessageBar(struct editorConfig *E) {
     int msglen = strlen(E->statusmsg);
     if (msglen > E->screencols)
         msglen = E->screencols;
     if (msglen && time(NULL) - E->statusmsg_time < 5)
-        abAppend(ab, E->statusmsg, msglen);
+        scrPut(&E->screen, E->screenrows + 1, 0, E->statusmsg, msglen, 0);
 }
 
+/* Draw the frame into E->screen and write out what changed since the last
+ * one, see screen.h. */
 void editorRefreshScreen(struct editorConfig *E) {
     editorScroll(E);
 
-    struct abuf ab = ABUF_INIT;
-
-    abAppend(&ab, "\x1b[?25l", 6); // hides cursor
-    abAppend(&ab, "\x1b[H", 3); // moves cursor to first pos
-
-    editorDrawRows(E, &ab);
-    editorDrawStatusBar(E, &ab);
-    editorDrawMessageBar(E, &ab);
-
-    char buf[32];
-    snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (E->cy - E->rowoff) + 1,
-        (E->rx - E->coloff) + 1);
-    // ^ move cursor to y,x pos
-    abAppend(&ab, buf, strlen(buf));
-
-    abAppend(&ab, "\x1b[?25h", 6); // unhides cursor
-
-    write(STDOUT_FILENO, ab.b, ab.len);
-    abFree(&ab);
+    struct screen *s = &E->screen;
+    if (s->rows != E->screenrows + 2 || s->cols != E->screencols)
+        scrResize(s, E->screenrows + 2, E->screencols);
+    scrClear(s);
+    if (E->rowoff != E->drawnoff)
+        scrScroll(s, 0, E->screenrows, E->rowoff - E->drawnoff);
+    E->drawnoff = E->rowoff;
+
+    editorDrawRows(E);
+    if (E->pager)
+        editorPagerScrolled(E);
+    editorDrawStatusBar(E);
+    editorDrawMessageBar(E);
+
+    size_t len = scrFlush(s, E->cy - E->rowoff, E->rx - E->coloff);
+    write(STDOUT_FILENO, s->out, len);
+    E->drawn = platformClock();
 }
 
 void editorSetStatusMessage(struct editorConfig *E, const char *fmt, ...) {
@@ -894,6 +2772,29 @@ void editorSetStatusMessage(struct editorConfig *E, const char *fmt, ...) {
     E->statusmsg_time = time(NULL);
 }
 
+/* Show how row memory is doing. Fragmentation counts every reserved byte
+ * not holding row data: size class rounding, free slots and chunk tails.
+ * Shared is what cached rows rendering as their chars save. */
+void editorMemoryStats(struct editorConfig *E) {
+    struct slab *m = &E->mem;
+    int frag = m->reserved ? (int)(100 - m->live * 100 / m->reserved) : 0;
+    size_t shared = 0;
+    for (int j = 0; j < KILO_RENDER_CACHE; j++) {
+        erow *row = E->rcache[j];
+        if (row && row->render == row->chars)
+            shared += row->rsize + 1;
+    }
+    editorSetStatusMessage(E, "%zu/%zu blocks, %zuK data in %zuK, %d%% frag, %zuK shared",
+        m->allocs - m->frees, m->allocs, m->live / 1024, m->reserved / 1024, frag,
+        shared / 1024);
+}
+
+void editorScreenStats(struct editorConfig *E) {
+    struct screen *s = &E->screen;
+    editorSetStatusMessage(E, "%zu bytes last frame, %llu in %lu frames, %llu a frame",
+        s->last, s->bytes, s->frames, s->frames ? s->bytes / s->frames : 0);
+}
+
 /***********\
   * input *
 \***********/
@@ -909,23 +2810,32 @@ int isStopChr(int c, char *s) {
     return 0;
 }
 
+/* Character at column 'cx' of the cursor row, '\0' outside the buffer. */
+int editorCharAt(struct editorConfig *E, int cx) {
+    erow *row = editorRow(E, E->cy);
+    if (row == NULL || cx < 0 || cx >= row->size)
+        return '\0';
+    return editorRowChar(row, cx);
+}
+
 void editorSpecialMovement(struct editorConfig *E, int key) {
     char *stopChars = " '\"\n()[].#<>";
+    erow *row;
 
     switch (key) {
     case 'w':
-        while (!isStopChr(E->row[E->cy].chars[E->cx], stopChars)) {
+        while (!isStopChr(editorCharAt(E, E->cx), stopChars)) {
             editorMoveCursor(E, ARROW_RIGHT);
-            while (isStopChr(E->row[E->cy].chars[E->cx + 1], stopChars)) {
+            while (isStopChr(editorCharAt(E, E->cx + 1), stopChars) && E->cy < E->numrows) {
                 editorMoveCursor(E, ARROW_RIGHT);
             }
         }
         editorMoveCursor(E, ARROW_RIGHT);
         break;
     case 'b':
-        while (!isStopChr(E->row[E->cy].chars[E->cx], stopChars)) {
+        while (!isStopChr(editorCharAt(E, E->cx), stopChars) && (E->cx || E->cy)) {
             editorMoveCursor(E, ARROW_LEFT);
-            while (isStopChr(E->row[E->cy].chars[E->cx - 1], stopChars)) {
+            while (isStopChr(editorCharAt(E, E->cx - 1), stopChars) && (E->cx || E->cy)) {
                 editorMoveCursor(E, ARROW_LEFT);
             }
         }
@@ -935,14 +2845,14 @@ void editorSpecialMovement(struct editorConfig *E, int key) {
     case '}':
         E->cx = 0;
         editorMoveCursor(E, ARROW_DOWN);
-        while (E->row[E->cy].size != 0) {
+        while ((row = editorRow(E, E->cy)) && row->size != 0) {
             editorMoveCursor(E, ARROW_DOWN);
         }
         break;
     case '{':
         E->cx = 0;
         editorMoveCursor(E, ARROW_UP);
-        while (E->row[E->cy].size != 0) {
+        while (E->cy > 0 && editorRow(E, E->cy)->size != 0) {
             editorMoveCursor(E, ARROW_UP);
         }
         break;
@@ -978,6 +2888,10 @@ int editorNormalMovement(int key) {
 }
 
 void editorDoInsert(struct editorConfig *E, int key) {
+    if (E->pager) {
+        editorSetStatusMessage(E, "Read-only, opened with -R");
+        return;
+    }
     switch (key) {
     case 'i':
         E->mode = 0;
@@ -992,13 +2906,13 @@ void editorDoInsert(struct editorConfig *E, int key) {
         break;
     case 'A':
         if (E->cy < E->numrows) {
-            E->cx = E->row[E->cy].size;
+            E->cx = editorRow(E, E->cy)->size;
         }
         E->mode = 0;
         break;
     case 'o':
         if (E->cy < E->numrows) {
-            E->cx = E->row[E->cy].size;
+            E->cx = editorRow(E, E->cy)->size;
         }
         editorInsertNewline(E);
         E->mode = 0;
@@ -1012,6 +2926,17 @@ void editorDoInsert(struct editorConfig *E, int key) {
     }
 }
 
+/* Insert what was pasted, in one go, see editorReadPaste(). */
+void editorPaste(struct editorConfig *E) {
+    size_t len;
+    char *text = editorReadPaste(E, &len);
+    if (E->pager)
+        editorSetStatusMessage(E, "Read-only, opened with -R");
+    else
+        editorInsertText(E, text, len);
+    free(text);
+}
+
 char *editorPrompt(struct editorConfig *E, char *prompt, EditorPromptFunc callback) {
     size_t bufsize = 128;
     char *buf = malloc(bufsize);
@@ -1023,7 +2948,7 @@ char *editorPrompt(struct editorConfig *E, char *prompt, EditorPromptFunc callba
         editorSetStatusMessage(E, prompt, buf);
         editorRefreshScreen(E);
 
-        int c = editorReadKey();
+        int c = editorReadKey(E);
         if (c == DEL_KEY || c == CTRL_KEY('h') || c == BACKSPACE) {
             if (buflen != 0)
                 buf[--buflen] = '\0';
@@ -1040,6 +2965,21 @@ char *editorPrompt(struct editorConfig *E, char *prompt, EditorPromptFunc callba
                     callback(E, buf, c);
                 return buf;
             }
+        } else if (c == PASTE_START) {
+            /* Up to the first line break, without its control characters. */
+            size_t len;
+            char *text = editorReadPaste(E, &len);
+            for (size_t j = 0; j < len && text[j] != '\r' && text[j] != '\n'; j++) {
+                if (iscntrl(text[j]) || (unsigned char)text[j] >= 128)
+                    continue;
+                if (buflen == bufsize - 1) {
+                    bufsize *= 2;
+                    buf = realloc(buf, bufsize);
+                }
+                buf[buflen++] = text[j];
+                buf[buflen] = '\0';
+            }
+            free(text);
         } else if (!iscntrl(c) && c < 128) {
             if (buflen == bufsize - 1) {
                 bufsize *= 2;
@@ -1055,7 +2995,7 @@ char *editorPrompt(struct editorConfig *E, char *prompt, EditorPromptFunc callba
 }
 
 void editorMoveCursor(struct editorConfig *E, int key) {
-    erow *row = (E->cy >= E->numrows) ? NULL : &E->row[E->cy];
+    erow *row = (E->cy >= E->numrows) ? NULL : editorRow(E, E->cy);
 
     switch (key) {
     case ARROW_LEFT:
@@ -1063,7 +3003,7 @@ void editorMoveCursor(struct editorConfig *E, int key) {
             E->cx--;
         } else if (E->cy > 0) {
             E->cy--;
-            E->cx = E->row[E->cy].size;
+            E->cx = editorRow(E, E->cy)->size;
         }
         break;
     case ARROW_RIGHT:
@@ -1086,7 +3026,7 @@ void editorMoveCursor(struct editorConfig *E, int key) {
         break;
     }
 
-    row = (E->cy >= E->numrows) ? NULL : &E->row[E->cy];
+    row = (E->cy >= E->numrows) ? NULL : editorRow(E, E->cy);
     int rowlen = row ? row->size : 0;
     if (E->cx > rowlen) {
         E->cx = rowlen;
@@ -1095,7 +3035,7 @@ void editorMoveCursor(struct editorConfig *E, int key) {
 
 void editorProcessKeypress(struct editorConfig *E) {
     static int quit_times = KILO_QUIT_TIMES;
-    int c = editorReadKey();
+    int c = editorReadKey(E);
 
     switch (c) {
     case '\r':
@@ -1110,6 +3050,8 @@ void editorProcessKeypress(struct editorConfig *E) {
             quit_times--;
             return;
         }
+        editorSaveWait(E);
+        jnRemove(&E->journal);
         write(STDOUT_FILENO, "\x1b[2J", 4);
         write(STDOUT_FILENO, "\x1b[H", 3);
         exit(0);
@@ -1125,7 +3067,7 @@ void editorProcessKeypress(struct editorConfig *E) {
 
     case END_KEY:
         if (E->cy < E->numrows) {
-            E->cx = E->row[E->cy].size;
+            E->cx = editorRow(E, E->cy)->size;
         }
         break;
 
@@ -1133,6 +3075,10 @@ void editorProcessKeypress(struct editorConfig *E) {
         editorFind(E);
         break;
 
+    case CTRL_KEY('g'):
+        editorGotoLine(E);
+        break;
+
     case BACKSPACE:
     case CTRL_KEY('h'):
     case DEL_KEY:
@@ -1164,7 +3110,15 @@ void editorProcessKeypress(struct editorConfig *E) {
         editorMoveCursor(E, c);
         break;
 
+    case PASTE_START:
+        editorPaste(E);
+        break;
+
     case CTRL_KEY('l'):
+        E->screen.valid = 0; /* Draw it all again, whatever the terminal shows. */
+        E->mode = 1;
+        break;
+
     case '\x1b':
         E->mode = 1;
         break;
@@ -1178,7 +3132,7 @@ void editorProcessKeypress(struct editorConfig *E) {
 
 void editorNormalProcessKeypress(struct editorConfig *E) {
     static int quit_times = KILO_QUIT_TIMES;
-    int c = editorReadKey();
+    int c = editorReadKey(E);
 
     switch (c) {
     case CTRL_KEY('q'):
@@ -1189,6 +3143,8 @@ void editorNormalProcessKeypress(struct editorConfig *E) {
             quit_times--;
             return;
         }
+        editorSaveWait(E);
+        jnRemove(&E->journal);
         write(STDOUT_FILENO, "\x1b[2J", 4);
         write(STDOUT_FILENO, "\x1b[H", 3);
         exit(0);
@@ -1204,7 +3160,7 @@ void editorNormalProcessKeypress(struct editorConfig *E) {
 
     case END_KEY:
         if (E->cy < E->numrows) {
-            E->cx = E->row[E->cy].size;
+            E->cx = editorRow(E, E->cy)->size;
         }
         break;
 
@@ -1212,6 +3168,10 @@ void editorNormalProcessKeypress(struct editorConfig *E) {
         editorFind(E);
         break;
 
+    case CTRL_KEY('g'):
+        editorGotoLine(E);
+        break;
+
     case PAGE_UP:
     case PAGE_DOWN: {
         if (c == PAGE_UP) {
@@ -1252,7 +3212,27 @@ void editorNormalProcessKeypress(struct editorConfig *E) {
         break;
 
     case 'p':
-        editorSetStatusMessage(E, "char at %d = %d", E->rx, E->row[E->cy].chars[E->cx]);
+        editorSetStatusMessage(E, "char at %d = %d", E->rx, editorCharAt(E, E->cx));
+        break;
+
+    case 'M':
+        editorMemoryStats(E);
+        break;
+
+    case 'S':
+        editorScreenStats(E);
+        break;
+
+    case PASTE_START:
+        editorPaste(E);
+        break;
+
+    case 'F':
+        editorToggleFollow(E);
+        break;
+
+    case 'Z':
+        editorToggleGzip(E);
         break;
 
     default:
@@ -1262,6 +3242,31 @@ void editorNormalProcessKeypress(struct editorConfig *E) {
     quit_times = KILO_QUIT_TIMES;
 }
 
+static void editorProcessKey(struct editorConfig *E) {
+    if (E->mode == MODE_NORMAL)
+        editorNormalProcessKeypress(E);
+    else
+        editorProcessKeypress(E);
+}
+
+/* Handle a key, waiting for it, and then the keys typed or pasted since,
+ * so that one frame shows them all. The frame is drawn once no key is
+ * waiting, but no sooner than a frame time, 1/fps seconds, after the last
+ * one, taking the keys that come meanwhile too. Nor later than a frame
+ * time after the first key, so a long paste still shows how it goes. */
+void editorProcessInput(struct editorConfig *E) {
+    editorProcessKey(E);
+    long long frame = 1000 / E->fps, start = platformClock();
+    while (1) {
+        long long now = platformClock(), wait = E->drawn + frame - now;
+        if (now - start >= frame)
+            break;
+        if (E->keyat == E->keylen && !platformKeyWait(wait > 0 ? (int)wait : 0))
+            break;
+        editorProcessKey(E);
+    }
+}
+
 /**********\
   * init *
 \**********/
@@ -1273,7 +3278,43 @@ void initEditor(struct editorConfig *E) {
     E->rowoff = 0;
     E->coloff = 0;
     E->numrows = 0;
-    E->row = NULL;
+    memset(&E->mem, 0, sizeof(E->mem));
+    memset(&E->rows, 0, sizeof(E->rows));
+    E->rows.mem = &E->mem;
+    memset(&E->lines, 0, sizeof(E->lines));
+    E->rows.lines = &E->lines;
+    E->indexer = NULL;
+    E->stream = NULL;
+    E->spool = NULL;
+    E->save = NULL;
+    memset(&E->journal, 0, sizeof(E->journal));
+    E->jmapped = 0;
+    E->ondisk = E->maprows = 0;
+    E->touched = INT_MAX;
+    E->mapondisk = 0;
+    E->partial = 0;
+    E->gzip = 0;
+    E->pager = 0;
+    E->pagerlo = E->pagerhi = 0;
+    E->pagerread = 0;
+    E->follow = 0;
+    E->watch = NULL;
+    E->disk.size = E->disk.mtime = -1;
+    E->editrow = NULL;
+    E->rcache = calloc(KILO_RENDER_CACHE, sizeof(erow *));
+    E->rcache_ref = calloc(KILO_RENDER_CACHE, 1);
+    E->rcache_hand = 0;
+    E->hlfrontier = 0;
+    E->hlbuf = NULL;
+    E->hlbufcap = 0;
+    E->spanbuf = NULL;
+    E->spanbufcap = 0;
+    E->keyat = E->keylen = 0;
+    E->fps = KILO_FPS;
+    E->drawn = 0;
+    E->match = NULL;
+    E->map = NULL;
+    E->maplen = 0;
     E->dirty = 0;
     E->filename = NULL;
     E->statusmsg[0] = '\0';
@@ -1284,4 +3325,8 @@ void initEditor(struct editorConfig *E) {
     if (getWindowSize(0, 0, &E->screenrows, &E->screencols) == -1)
         die("getWindowSize");
     E->screenrows -= 2;
+    memset(&E->screen, 0, sizeof(E->screen));
+    scrResize(&E->screen, E->screenrows + 2, E->screencols);
+    E->screen.scroll = editorTermScroll();
+    E->drawnoff = 0;
 }
@@ -1,6 +1,16 @@
 #pragma once
 #include <time.h>
 #include "../_mod/platform.h"
+#include "journal.h"
+#include "lineindex.h"
+#include "rowtree.h"
+#include "screen.h"
+#include "slab.h"
+
+#define KILO_FPS 60 /* Frames drawn a second at most, see editorProcessInput. */
+#define KILO_PAGER_CAP (64 << 20) /* Bytes kept by -R, see editorConfig.pager. */
+
+struct editorSaveJob;
 
 enum editorMode {
     MODE_INSERT = 0,
@@ -13,9 +23,48 @@ struct editorConfig {
     int coloff; /* Offset of column displayed. */
     int screenrows; /* Number of rows that we can show */
     int screencols; /* Number of cols that we can show */
+    struct screen screen; /* Cells on the terminal, see screen.h */
+    int drawnoff; /* rowoff when the screen was last drawn. */
+    long long drawn; /* platformClock() then. */
+    int fps; /* Frames drawn a second at most. */
+    char keys[4096]; /* Bytes read from the terminal, see editorReadByte. */
+    int keyat, keylen; /* Next byte of keys to take, and the end of them. */
     int numrows; /* Number of rows */
     int rawmode; /* Is terminal raw mode enabled? */
-    erow *row; /* Rows */
+    struct slab mem; /* Row allocator, see slab.h */
+    struct rowtree rows; /* Rows, see rowtree.h */
+    erow *editrow; /* Row held in gap buffer form while being edited. */
+    erow **rcache; /* Rows with render and hl built, see editorRenderRow. */
+    unsigned char *rcache_ref; /* Rows in rcache used since the hand passed. */
+    int rcache_hand; /* Next rcache slot to consider for eviction. */
+    int hlfrontier; /* Rows before this have a known hl_open_comment. */
+    unsigned char *hlbuf; /* Scratch highlight bytes, see editorUpdateSyntax. */
+    int hlbufcap;
+    hlspan *spanbuf; /* Scratch spans, see editorDrawRows. */
+    int spanbufcap;
+    char *map; /* Mapped file rows may still point into, see editorOpen. */
+    size_t maplen;
+    struct lineindex lines; /* Line offsets in map, see lineindex.h */
+    struct platformStream *stream; /* Input still being read, see editorStreamPoll. */
+    struct platformSpool *spool; /* Holds what it sent, mapped at map. */
+    struct liIndexer *indexer; /* Indexes the rest of map, or NULL. */
+    struct editorSaveJob *save; /* Save running in the background, or NULL. */
+    struct journal journal; /* Edits not saved yet, see journal.h */
+    int jmapped; /* The journal applies to the mapped file. */
+    struct jnStamp disk; /* The file as last read or written. */
+    int ondisk; /* Rows at the start of the buffer the file has as they are. */
+    int maprows; /* Of those, rows at their offset in map, see editorSnapshot. */
+    int touched; /* First row edited since the running save started. */
+    int mapondisk; /* map is the file on disk, not one a save replaced. */
+    int partial; /* The file does not end its last row with a newline. */
+    int gzip; /* The file is gzip-compressed, and saved that way, see editorOpen. */
+    size_t pager; /* Read-only, keeping about this many bytes, see editorPagerDrop. */
+    size_t pagerlo, pagerhi; /* Bytes of map on screen when last drawn. */
+    size_t pagerread; /* Bytes of map read by passes since pages were let go. */
+    int follow; /* Showing what is appended to the file, see editorFollowPoll. */
+    struct platformWatch *watch; /* The file being followed, or NULL. */
+    erow *match; /* Row with a search match shown, or NULL. */
+    int match_at, match_len; /* Render columns of that match. */
     int dirty; /* File modified but not saved. */
     int mode;
     int rx;
@@ -27,7 +76,9 @@ struct editorConfig {
 
 void initEditor(struct editorConfig *E);
 void editorOpen(struct editorConfig *E, char *filename);
+void editorOpenStream(struct editorConfig *E, struct platformStream *s);
 void editorSetStatusMessage(struct editorConfig *E, const char *fmt, ...);
 void editorRefreshScreen(struct editorConfig *E);
 void editorNormalProcessKeypress(struct editorConfig *E);
 void editorProcessKeypress(struct editorConfig *E);
+void editorProcessInput(struct editorConfig *E);
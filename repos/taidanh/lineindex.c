@@ -0,0 +1,340 @@
+#include "lineindex.h"
+#include "../_mod/platform.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define LI_HAVE_AVX2
+#endif
+
+struct liUnit {
+    struct lineindex part; /* Lines that start in the unit, from off[1]. */
+    int done; /* Set by the worker once part is complete. */
+};
+
+struct liIndexer {
+    const char *buf;
+    size_t len;
+    struct liUnit *units;
+    size_t nunits;
+    size_t next; /* Next unit to hand out. */
+    size_t collected; /* Units already appended to the caller's index. */
+    size_t scanned; /* Bytes in finished units. */
+    size_t lines; /* Newlines in finished units. */
+    int stop; /* Set to make workers quit early. */
+    int drop; /* Let pages of a unit go once it is scanned. */
+    struct platformThread **threads;
+    int nthreads;
+};
+
+static void liInit(struct lineindex *li) {
+    li->cap = 1024;
+    li->off = malloc(sizeof(uint64_t) * li->cap);
+    li->off[0] = 0;
+    li->n = 0;
+}
+
+/* Make room for 'more' offsets past the last one. */
+static void liReserve(struct lineindex *li, size_t more) {
+    if (li->n + 1 + more > li->cap) {
+        while (li->n + 1 + more > li->cap)
+            li->cap *= 2;
+        li->off = realloc(li->off, sizeof(uint64_t) * li->cap);
+    }
+}
+
+static void liPush(struct lineindex *li, uint64_t off) {
+    liReserve(li, 1);
+    li->off[++li->n] = off;
+}
+
+/* Push the line starting after each bit set in 'mask', bit 0 being the
+ * byte at offset 'at'. Room must have been reserved. */
+static void liPushMask(struct lineindex *li, uint32_t mask, uint64_t at) {
+    uint64_t *out = &li->off[li->n + 1];
+    uint64_t *p = out;
+    while (mask) {
+        *p++ = at + __builtin_ctz(mask) + 1;
+        mask &= mask - 1;
+    }
+    li->n += p - out;
+}
+
+static size_t liScanScalar(struct lineindex *li, const char *buf, size_t len, uint64_t base) {
+    const char *p = buf;
+    const char *end = buf + len;
+    while ((p = memchr(p, '\n', end - p)) != NULL) {
+        p++;
+        liPush(li, base + (p - buf));
+    }
+    if (!li->cr && memchr(buf, '\r', len))
+        li->cr = 1;
+    return len;
+}
+
+#if defined(__SSE2__)
+static size_t liScanSSE2(struct lineindex *li, const char *buf, size_t len, uint64_t base) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    __m128i crs = _mm_setzero_si128();
+    size_t i;
+    for (i = 0; i + 16 <= len; i += 16) {
+        liReserve(li, 16);
+        __m128i v = _mm_loadu_si128((const __m128i *)&buf[i]);
+        liPushMask(li, _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)), base + i);
+        crs = _mm_or_si128(crs, _mm_cmpeq_epi8(v, cr));
+    }
+    if (_mm_movemask_epi8(crs))
+        li->cr = 1;
+    return i;
+}
+#endif
+
+#ifdef LI_HAVE_AVX2
+__attribute__((target("avx2")))
+static size_t liScanAVX2(struct lineindex *li, const char *buf, size_t len, uint64_t base) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    __m256i crs = _mm256_setzero_si256();
+    size_t i;
+    for (i = 0; i + 64 <= len; i += 64) {
+        liReserve(li, 64);
+        __m256i a = _mm256_loadu_si256((const __m256i *)&buf[i]);
+        __m256i b = _mm256_loadu_si256((const __m256i *)&buf[i + 32]);
+        uint32_t ma = _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, nl));
+        uint32_t mb = _mm256_movemask_epi8(_mm256_cmpeq_epi8(b, nl));
+        liPushMask(li, ma, base + i);
+        liPushMask(li, mb, base + i + 32);
+        crs = _mm256_or_si256(crs, _mm256_or_si256(_mm256_cmpeq_epi8(a, cr), _mm256_cmpeq_epi8(b, cr)));
+    }
+    if (_mm256_movemask_epi8(crs))
+        li->cr = 1;
+    return i;
+}
+#endif
+
+/* Push the start of every line in buf[0, len), long ones left whole. */
+static void liScanBytes(struct lineindex *li, const char *buf, size_t len, uint64_t base) {
+    size_t done = 0;
+#ifdef LI_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2"))
+        done = liScanAVX2(li, buf, len, base);
+#endif
+#if defined(__SSE2__)
+    done += liScanSSE2(li, buf + done, len - done, base + done);
+#endif
+    liScanScalar(li, buf + done, len - done, base + done);
+}
+
+/* Cut the last line, known to run on without a newline up to 'stop', into
+ * lines of LI_LINE_MAX bytes. Bytes from 'base' on are at 'buf'. A cut
+ * never leaves a '\r' ending a line, where liLineLen() would trim it. */
+static void liCut(struct lineindex *li, const char *buf, uint64_t base, uint64_t stop) {
+    for (;;) {
+        uint64_t last = li->off[li->n];
+        if (stop - last <= LI_LINE_MAX)
+            return;
+        uint64_t at = last + LI_LINE_MAX;
+        if (at <= base)
+            at = base + 1;
+        while (at < stop && buf[at - 1 - base] == '\r')
+            at++;
+        if (at >= stop)
+            return;
+        liPush(li, at);
+    }
+}
+
+/* Cut the lines from 'from' on that are longer than LI_LINE_MAX, and the
+ * unfinished one running on to 'end'. Bytes [base, end) are at 'buf', which
+ * is enough as lines are cut as soon as they grow too long. */
+static void liSplit(struct lineindex *li, size_t from, const char *buf, uint64_t base, uint64_t end) {
+    if (end - li->off[from] <= LI_LINE_MAX)
+        return;
+    size_t i = from;
+    while (i < li->n && li->off[i + 1] - li->off[i] <= LI_LINE_MAX)
+        i++;
+    size_t rest = li->n - i;
+    uint64_t *tail = NULL;
+    if (rest) {
+        tail = malloc(sizeof(uint64_t) * rest);
+        memcpy(tail, &li->off[i + 1], sizeof(uint64_t) * rest);
+        li->n = i;
+    }
+    for (size_t k = 0; k < rest; k++) {
+        liCut(li, buf, base, tail[k] - 1);
+        liPush(li, tail[k]);
+    }
+    liCut(li, buf, base, end);
+    free(tail);
+}
+
+/* Append the start of every line that follows a newline in buf[0, len),
+ * 'buf' sitting at offset 'base' of the file. */
+void liScan(struct lineindex *li, const char *buf, size_t len, uint64_t base) {
+    if (li->off == NULL)
+        liInit(li);
+    size_t from = li->n;
+    liScanBytes(li, buf, len, base);
+    liSplit(li, from, buf, base, base + len);
+}
+
+/* Close the last line of a 'len' byte buffer scanned with liScan() if it
+ * has no newline. */
+void liEnd(struct lineindex *li, size_t len) {
+    if (li->off[li->n] < len)
+        liPush(li, len);
+    li->ended = 1;
+}
+
+/* Index all of 'buf', closing the last line if it has no newline. */
+void liBuild(struct lineindex *li, const char *buf, size_t len) {
+    liScan(li, buf, len, 0);
+    liEnd(li, len);
+}
+
+/* Length of line 'line' of 'buf' without its trailing '\r' and '\n'. */
+size_t liLineLen(struct lineindex *li, const char *buf, size_t line) {
+    uint64_t start = li->off[line];
+    uint64_t end = li->off[line + 1];
+    while (end > start && (buf[end - 1] == '\n' || buf[end - 1] == '\r'))
+        end--;
+    return end - start;
+}
+
+/* Whether line 'line' runs on into the next without a newline, having been
+ * cut from a line longer than LI_LINE_MAX. */
+int liContinued(struct lineindex *li, const char *buf, size_t line) {
+    if (buf[li->off[line + 1] - 1] == '\n')
+        return 0;
+    return line + 1 < li->n || !li->ended;
+}
+
+/* Line holding byte 'at' of the buffer, which must be before off[n]. */
+size_t liLineAt(struct lineindex *li, uint64_t at) {
+    size_t lo = 0, hi = li->n;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (li->off[mid] <= at)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+void liFree(struct lineindex *li) {
+    free(li->off);
+    memset(li, 0, sizeof(*li));
+}
+
+static void liScanUnit(struct liIndexer *x, size_t u) {
+    size_t at = u * LI_UNIT;
+    size_t len = x->len - at < LI_UNIT ? x->len - at : LI_UNIT;
+    struct lineindex *part = &x->units[u].part;
+    liInit(part);
+    liScanBytes(part, x->buf + at, len, at);
+    if (x->drop)
+        platformDropPages(x->buf + at, len);
+    __atomic_fetch_add(&x->scanned, len, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&x->lines, part->n, __ATOMIC_RELAXED);
+    __atomic_store_n(&x->units[u].done, 1, __ATOMIC_RELEASE);
+}
+
+/* Worker loop: take the next unit until there are none left. */
+static void liWork(void *arg) {
+    struct liIndexer *x = arg;
+    while (!__atomic_load_n(&x->stop, __ATOMIC_RELAXED)) {
+        size_t u = __atomic_fetch_add(&x->next, 1, __ATOMIC_RELAXED);
+        if (u >= x->nunits)
+            break;
+        liScanUnit(x, u);
+    }
+}
+
+/* Start indexing 'buf' on 'threads' workers. The first unit is scanned
+ * before this returns, so the caller can show the start of the file right
+ * away. With 'drop' set each unit's pages are let go once it is scanned, so
+ * indexing a file keeps no more of it in memory than the units in hand. */
+struct liIndexer *liStart(const char *buf, size_t len, int threads, int drop) {
+    struct liIndexer *x = calloc(1, sizeof(struct liIndexer));
+    x->buf = buf;
+    x->len = len;
+    x->drop = drop;
+    x->nunits = (len + LI_UNIT - 1) / LI_UNIT;
+    x->units = calloc(x->nunits ? x->nunits : 1, sizeof(struct liUnit));
+    x->next = 1;
+    x->threads = calloc(threads, sizeof(struct platformThread *));
+    for (int i = 0; i < threads; i++) {
+        struct platformThread *t = platformStartThread(liWork, x);
+        if (t)
+            x->threads[x->nthreads++] = t;
+    }
+    if (x->nunits)
+        liScanUnit(x, 0);
+    return x;
+}
+
+/* Append the offsets of finished units that follow the ones already
+ * collected to 'li'. Returns 1 once the whole buffer is in 'li'. */
+int liCollect(struct liIndexer *x, struct lineindex *li) {
+    if (li->off == NULL)
+        liInit(li);
+    while (x->collected < x->nunits && __atomic_load_n(&x->units[x->collected].done, __ATOMIC_ACQUIRE)) {
+        struct lineindex *part = &x->units[x->collected].part;
+        size_t from = li->n;
+        liReserve(li, part->n);
+        memcpy(&li->off[li->n + 1], &part->off[1], sizeof(uint64_t) * part->n);
+        li->n += part->n;
+        li->cr |= part->cr;
+        liFree(part);
+        x->collected++;
+        size_t end = x->collected * LI_UNIT;
+        liSplit(li, from, x->buf, 0, end < x->len ? end : x->len);
+    }
+    if (x->collected < x->nunits)
+        return 0;
+    liEnd(li, x->len);
+    return 1;
+}
+
+/* Bytes scanned and newlines found so far, for an estimate of the total. */
+void liProgress(struct liIndexer *x, size_t *bytes, size_t *lines) {
+    *bytes = __atomic_load_n(&x->scanned, __ATOMIC_RELAXED);
+    *lines = __atomic_load_n(&x->lines, __ATOMIC_RELAXED);
+}
+
+static void liJoin(struct liIndexer *x) {
+    for (int i = 0; i < x->nthreads; i++)
+        platformJoinThread(x->threads[i]);
+    x->nthreads = 0;
+}
+
+static void liRelease(struct liIndexer *x) {
+    for (size_t u = x->collected; u < x->nunits; u++)
+        liFree(&x->units[u].part);
+    free(x->units);
+    free(x->threads);
+    free(x);
+}
+
+/* Wait for the whole buffer, collect it into 'li' and release 'x'. Units
+ * no worker got to, if threads could not be started, are scanned here. */
+void liFinish(struct liIndexer *x, struct lineindex *li) {
+    liJoin(x);
+    liWork(x);
+    liCollect(x, li);
+    liRelease(x);
+}
+
+/* Stop the workers, dropping whatever was not collected, and release 'x'. */
+void liStop(struct liIndexer *x) {
+    __atomic_store_n(&x->stop, 1, __ATOMIC_RELAXED);
+    liJoin(x);
+    liRelease(x);
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/* Offsets of the lines of a file, found in one pass over its bytes. Line i
+ * spans [off[i], off[i + 1]), newline included; off[n] is the end of the
+ * file, so a last line without a newline still counts. The scan compares
+ * 64 bytes a step with AVX2, as two 32 byte vectors, or 16 with SSE2, where
+ * the CPU has them, and falls back to memchr elsewhere.
+ *
+ * Large files are indexed in the background: liStart() cuts the buffer into
+ * LI_UNIT sized units that a pool of workers scans in any order, and
+ * liCollect() appends the offsets of the units finished so far, in file
+ * order, to the caller's index.
+ *
+ * A line longer than LI_LINE_MAX is cut into several, so no line is too
+ * long to be a row, whatever the file: a multi-gigabyte log with no
+ * newline, or a sparse file of zeros, becomes rows of about LI_LINE_MAX
+ * bytes that liContinued() tells apart from real lines. */
+
+/* Both can be set at build time, small, to exercise cutting and workers
+ * on small files, see tests/run.sh. */
+#ifndef LI_UNIT
+#define LI_UNIT (16 << 20) /* Bytes a background worker indexes at a time. */
+#endif
+#ifndef LI_LINE_MAX
+#define LI_LINE_MAX (1 << 20) /* Longest line kept in one piece. */
+#endif
+
+struct lineindex {
+    uint64_t *off; /* n + 1 offsets once built. */
+    size_t n; /* Lines. */
+    size_t cap;
+    int cr; /* The buffer holds a '\r', so lines may need trimming. */
+    int ended; /* The last line is closed, see liEnd(). */
+};
+
+void liScan(struct lineindex *li, const char *buf, size_t len, uint64_t base);
+void liEnd(struct lineindex *li, size_t len);
+void liBuild(struct lineindex *li, const char *buf, size_t len);
+size_t liLineLen(struct lineindex *li, const char *buf, size_t line);
+int liContinued(struct lineindex *li, const char *buf, size_t line);
+size_t liLineAt(struct lineindex *li, uint64_t at);
+void liFree(struct lineindex *li);
+
+struct liIndexer;
+
+struct liIndexer *liStart(const char *buf, size_t len, int threads, int drop);
+int liCollect(struct liIndexer *x, struct lineindex *li);
+void liProgress(struct liIndexer *x, size_t *bytes, size_t *lines);
+void liFinish(struct liIndexer *x, struct lineindex *li);
+void liStop(struct liIndexer *x);
@@ -0,0 +1,433 @@
+#include "rowtree.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct rtNode {
+    int leaf; /* Leaf block (1) or internal node (0). */
+    int n; /* Rows in a leaf, children in an internal node. */
+    int count; /* Rows in the whole subtree. */
+    struct rtNode *parent;
+    /* One spare slot so a node can overflow before it is split. */
+    union {
+        erow *rows[RT_LEAF + 1];
+        struct rtNode *child[RT_FANOUT + 1];
+    };
+};
+
+/* Slots of lines without a row hold (line << 2) | (hl_open_comment << 1) | 1;
+ * rows are aligned, so a real row pointer never has the low bit set. */
+static int rtIsLine(erow *slot) {
+    return (uintptr_t)slot & 1;
+}
+
+static erow *rtLineSlot(size_t line, int oc) {
+    return (erow *)(((uintptr_t)line << 2) | ((uintptr_t)oc << 1) | 1);
+}
+
+static int rtCapacity(struct rtNode *node) {
+    return node->leaf ? RT_LEAF : RT_FANOUT;
+}
+
+static struct rtNode *rtNewNode(int leaf) {
+    struct rtNode *node = calloc(1, sizeof(struct rtNode));
+    node->leaf = leaf;
+    return node;
+}
+
+/* Position of 'node' among its parent's children. */
+static int rtChildPos(struct rtNode *node) {
+    struct rtNode *parent = node->parent;
+    int i = 0;
+    while (parent->child[i] != node)
+        i++;
+    return i;
+}
+
+static void rtAddCount(struct rtNode *node, int delta) {
+    for (; node; node = node->parent)
+        node->count += delta;
+}
+
+/* Move items [from, n) of 'src' to the end of 'dst', fixing back pointers
+ * and subtree counts of both nodes. */
+static void rtMoveItems(struct rtNode *dst, struct rtNode *src, int from) {
+    int moved = src->n - from;
+    int rows = 0;
+    for (int i = 0; i < moved; i++) {
+        if (src->leaf) {
+            erow *row = src->rows[from + i];
+            dst->rows[dst->n + i] = row;
+            if (!rtIsLine(row))
+                row->leaf = dst;
+            rows++;
+        } else {
+            struct rtNode *child = src->child[from + i];
+            dst->child[dst->n + i] = child;
+            child->parent = dst;
+            rows += child->count;
+        }
+    }
+    dst->n += moved;
+    dst->count += rows;
+    src->n = from;
+    src->count -= rows;
+}
+
+/* Insert 'child' into 'parent' right after position 'pos'. */
+static void rtInsertChild(struct rtNode *parent, int pos, struct rtNode *child) {
+    memmove(&parent->child[pos + 2], &parent->child[pos + 1],
+        sizeof(struct rtNode *) * (parent->n - pos - 1));
+    parent->child[pos + 1] = child;
+    parent->n++;
+    child->parent = parent;
+}
+
+static void rtRemoveChild(struct rtNode *parent, int pos) {
+    memmove(&parent->child[pos], &parent->child[pos + 1],
+        sizeof(struct rtNode *) * (parent->n - pos - 1));
+    parent->n--;
+}
+
+/* Split nodes that overflowed, from 'node' up to the root. */
+static void rtSplit(struct rowtree *t, struct rtNode *node) {
+    while (node->n > rtCapacity(node)) {
+        struct rtNode *right = rtNewNode(node->leaf);
+        rtMoveItems(right, node, node->n / 2);
+
+        if (node->parent == NULL) {
+            struct rtNode *root = rtNewNode(0);
+            root->child[0] = node;
+            root->n = 1;
+            root->count = node->count + right->count;
+            node->parent = root;
+            t->root = root;
+        }
+        rtInsertChild(node->parent, rtChildPos(node), right);
+        node = node->parent;
+    }
+}
+
+/* Merge underfull nodes into a neighbour and drop empty ones, from 'node'
+ * up to the root. Nodes that cannot be merged are left underfull; this
+ * keeps deletes cheap and the height is still bounded by the largest size
+ * the tree ever had. */
+static void rtRebalance(struct rowtree *t, struct rtNode *node) {
+    while (node->parent) {
+        struct rtNode *parent = node->parent;
+        int pos = rtChildPos(node);
+
+        if (node->n == 0) {
+            rtRemoveChild(parent, pos);
+            free(node);
+        } else if (node->n < rtCapacity(node) / 4) {
+            int lpos = pos > 0 ? pos - 1 : pos;
+            if (lpos + 1 >= parent->n)
+                break;
+            struct rtNode *left = parent->child[lpos];
+            struct rtNode *right = parent->child[lpos + 1];
+            if (left->n + right->n > rtCapacity(node))
+                break;
+            rtMoveItems(left, right, 0);
+            rtRemoveChild(parent, lpos + 1);
+            free(right);
+        } else {
+            break;
+        }
+        node = parent;
+    }
+
+    /* Shrink the tree while the root is an internal node with one child. */
+    struct rtNode *root = t->root;
+    while (root && !root->leaf && root->n <= 1) {
+        t->root = root->n ? root->child[0] : NULL;
+        if (t->root)
+            t->root->parent = NULL;
+        free(root);
+        root = t->root;
+    }
+}
+
+/* Descend to the leaf holding row 'at'; '*pos' gets the slot in the leaf.
+ * With 'append' set, 'at' may equal the subtree size. */
+static struct rtNode *rtFind(struct rtNode *node, int at, int append, int *pos) {
+    while (!node->leaf) {
+        int i;
+        for (i = 0; i < node->n - 1; i++) {
+            int count = node->child[i]->count;
+            if (at < count || (append && at == count))
+                break;
+            at -= count;
+        }
+        node = node->child[i];
+    }
+    *pos = at;
+    return node;
+}
+
+/* Return the row in slot 'pos' of 'leaf', building it from the line index
+ * if the slot still holds a line of the file. */
+static erow *rtRowAt(struct rowtree *t, struct rtNode *leaf, int pos) {
+    erow *slot = leaf->rows[pos];
+    if (!rtIsLine(slot))
+        return slot;
+
+    size_t line = (uintptr_t)slot >> 2;
+    erow *row = slabAlloc(t->mem, sizeof(erow));
+    memset(row, 0, sizeof(erow));
+    row->leaf = leaf;
+    row->chars = t->map + t->lines->off[line];
+    row->size = liLineLen(t->lines, t->map, line);
+    row->cont = liContinued(t->lines, t->map, line);
+    row->mapped = 1;
+    row->hl_open_comment = ((uintptr_t)slot >> 1) & 1;
+    leaf->rows[pos] = row;
+    return row;
+}
+
+/* Return the row at index 'at', or NULL if out of range. */
+erow *rtAt(struct rowtree *t, int at) {
+    if (t->root == NULL || at < 0 || at >= t->root->count)
+        return NULL;
+    int pos;
+    struct rtNode *leaf = rtFind(t->root, at, 0, &pos);
+    return rtRowAt(t, leaf, pos);
+}
+
+/* Free 'row' if it is still the line of the file it was built from, with
+ * no render, and put the line back in its slot to be built again when next
+ * asked for. Returns 1 if the row was freed. */
+int rtForget(struct rowtree *t, erow *row) {
+    if (!row->mapped || row->render)
+        return 0;
+    uint64_t at = row->chars - t->map;
+    size_t line = liLineAt(t->lines, at);
+    if (t->lines->off[line] != at || liLineLen(t->lines, t->map, line) != (size_t)row->size
+        || liContinued(t->lines, t->map, line) != row->cont)
+        return 0;
+
+    struct rtNode *leaf = row->leaf;
+    int pos = 0;
+    while (leaf->rows[pos] != row)
+        pos++;
+    leaf->rows[pos] = rtLineSlot(line, row->hl_open_comment);
+    slabFree(t->mem, row, sizeof(erow));
+    return 1;
+}
+
+/* Return the index of 'row' in the buffer. */
+int rtIndexOf(erow *row) {
+    struct rtNode *node = row->leaf;
+    int idx = 0;
+    while (node->rows[idx] != row)
+        idx++;
+    for (; node->parent; node = node->parent) {
+        struct rtNode *parent = node->parent;
+        for (int i = 0; parent->child[i] != node; i++)
+            idx += parent->child[i]->count;
+    }
+    return idx;
+}
+
+/* Return the leaf after 'node', or NULL if it is the last one. */
+static struct rtNode *rtNextLeaf(struct rtNode *node) {
+    /* Climb until there is a subtree to the right, then take its first leaf. */
+    while (node->parent) {
+        int i = rtChildPos(node);
+        if (i + 1 < node->parent->n) {
+            node = node->parent->child[i + 1];
+            while (!node->leaf)
+                node = node->child[0];
+            return node;
+        }
+        node = node->parent;
+    }
+    return NULL;
+}
+
+/* Return the row after 'row', or NULL at the end of the buffer. */
+erow *rtNext(struct rowtree *t, erow *row) {
+    struct rtNode *node = row->leaf;
+    int pos = 0;
+    while (node->rows[pos] != row)
+        pos++;
+    if (pos + 1 < node->n)
+        return rtRowAt(t, node, pos + 1);
+    node = rtNextLeaf(node);
+    return node ? rtRowAt(t, node, 0) : NULL;
+}
+
+/* Insert a new zeroed row at index 'at' and return it. */
+erow *rtInsert(struct rowtree *t, int at) {
+    if (t->root == NULL)
+        t->root = rtNewNode(1);
+    if (at < 0 || at > t->root->count)
+        return NULL;
+
+    int pos;
+    struct rtNode *leaf = rtFind(t->root, at, 1, &pos);
+    erow *row = slabAlloc(t->mem, sizeof(erow));
+    memset(row, 0, sizeof(erow));
+    row->leaf = leaf;
+    memmove(&leaf->rows[pos + 1], &leaf->rows[pos], sizeof(erow *) * (leaf->n - pos));
+    leaf->rows[pos] = row;
+    leaf->n++;
+    rtAddCount(leaf, 1);
+    rtSplit(t, leaf);
+    return row;
+}
+
+/* Hang the empty node 'node' to the right of 'last', the rightmost node of
+ * its level, adding parents as needed. */
+static void rtAppendNode(struct rowtree *t, struct rtNode *last, struct rtNode *node) {
+    struct rtNode *parent = last->parent;
+    if (parent == NULL) {
+        parent = rtNewNode(0);
+        parent->child[0] = last;
+        parent->n = 1;
+        parent->count = last->count;
+        last->parent = parent;
+        t->root = parent;
+    } else if (parent->n == RT_FANOUT) {
+        struct rtNode *next = rtNewNode(0);
+        rtAppendNode(t, parent, next);
+        parent = next;
+    }
+    parent->child[parent->n++] = node;
+    node->parent = parent;
+}
+
+/* Append lines [line, line + n) of the file as untouched slots. Leaves are
+ * filled up before the next one is started, so a freshly loaded file costs
+ * about one pointer per line. */
+void rtAppendLines(struct rowtree *t, size_t line, size_t n) {
+    if (t->root == NULL)
+        t->root = rtNewNode(1);
+    struct rtNode *leaf = t->root;
+    while (!leaf->leaf)
+        leaf = leaf->child[leaf->n - 1];
+
+    while (n > 0) {
+        if (leaf->n == RT_LEAF) {
+            struct rtNode *next = rtNewNode(1);
+            rtAppendNode(t, leaf, next);
+            leaf = next;
+        }
+        int k = RT_LEAF - leaf->n;
+        if ((size_t)k > n)
+            k = n;
+        for (int i = 0; i < k; i++)
+            leaf->rows[leaf->n++] = rtLineSlot(line++, 0);
+        rtAddCount(leaf, k);
+        n -= k;
+    }
+}
+
+/* Remove the row at 'at' and release it. The caller frees its contents. */
+void rtDelete(struct rowtree *t, int at) {
+    if (t->root == NULL || at < 0 || at >= t->root->count)
+        return;
+
+    int pos;
+    struct rtNode *leaf = rtFind(t->root, at, 0, &pos);
+    if (!rtIsLine(leaf->rows[pos]))
+        slabFree(t->mem, leaf->rows[pos], sizeof(erow));
+    memmove(&leaf->rows[pos], &leaf->rows[pos + 1], sizeof(erow *) * (leaf->n - pos - 1));
+    leaf->n--;
+    rtAddCount(leaf, -1);
+    rtRebalance(t, leaf);
+}
+
+static void rtFreeNode(struct rtNode *node) {
+    for (int i = 0; !node->leaf && i < node->n; i++)
+        rtFreeNode(node->child[i]);
+    free(node);
+}
+
+/* Release every node. Rows are left in the slab, which the caller resets
+ * together with their contents. */
+void rtFree(struct rowtree *t) {
+    if (t->root)
+        rtFreeNode(t->root);
+    t->root = NULL;
+}
+
+/* Point 'it' at row 'at'. Returns 0 if there is no such row. */
+int rtIterAt(struct rowtree *t, int at, struct rtIter *it) {
+    it->t = t;
+    if (t->root == NULL || at < 0 || at >= t->root->count)
+        return 0;
+    it->leaf = rtFind(t->root, at, 0, &it->pos);
+    return 1;
+}
+
+/* Step to the next row. Returns 0 at the end of the buffer. */
+int rtIterNext(struct rtIter *it) {
+    if (it->pos + 1 < it->leaf->n) {
+        it->pos++;
+        return 1;
+    }
+    struct rtNode *next = rtNextLeaf(it->leaf);
+    if (next == NULL)
+        return 0;
+    it->leaf = next;
+    it->pos = 0;
+    return 1;
+}
+
+/* The row under 'it', or NULL if it is a line that has no row yet. */
+erow *rtIterRow(struct rtIter *it) {
+    erow *slot = it->leaf->rows[it->pos];
+    return rtIsLine(slot) ? NULL : slot;
+}
+
+/* The text under 'it'. A row must be compact. */
+char *rtIterText(struct rtIter *it, int *len) {
+    erow *slot = it->leaf->rows[it->pos];
+    if (!rtIsLine(slot)) {
+        *len = slot->size;
+        return slot->chars;
+    }
+    size_t line = (uintptr_t)slot >> 2;
+    *len = liLineLen(it->t->lines, it->t->map, line);
+    return it->t->map + it->t->lines->off[line];
+}
+
+/* Whether the row under 'it' runs on into the next without a newline. */
+int rtIterContinued(struct rtIter *it) {
+    erow *slot = it->leaf->rows[it->pos];
+    if (!rtIsLine(slot))
+        return slot->cont;
+    return liContinued(it->t->lines, it->t->map, (uintptr_t)slot >> 2);
+}
+
+/* Count the untouched lines from 'it' on that follow each other in the
+ * file, within the current leaf, and leave 'it' on the last of them. The
+ * first line number goes to '*line'. Returns 0 if 'it' is on a row. */
+int rtIterLines(struct rtIter *it, size_t *line) {
+    erow **rows = it->leaf->rows;
+    if (!rtIsLine(rows[it->pos]))
+        return 0;
+    *line = (uintptr_t)rows[it->pos] >> 2;
+    int k = 1;
+    while (it->pos + 1 < it->leaf->n && rtIsLine(rows[it->pos + 1])
+        && ((uintptr_t)rows[it->pos + 1] >> 2) == *line + k) {
+        it->pos++;
+        k++;
+    }
+    return k;
+}
+
+int rtIterOpenComment(struct rtIter *it) {
+    erow *slot = it->leaf->rows[it->pos];
+    return rtIsLine(slot) ? (int)(((uintptr_t)slot >> 1) & 1) : slot->hl_open_comment;
+}
+
+void rtIterSetOpenComment(struct rtIter *it, int oc) {
+    erow *slot = it->leaf->rows[it->pos];
+    if (rtIsLine(slot))
+        it->leaf->rows[it->pos] = rtLineSlot((uintptr_t)slot >> 2, oc);
+    else
+        slot->hl_open_comment = oc;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "../_mod/platform.h"
+#include "lineindex.h"
+#include "slab.h"
+
+/* Row storage as a counted B-tree. Rows hang off fixed-size leaf blocks and
+ * every node knows how many rows its subtree holds, so looking a row up by
+ * line number, inserting and deleting are all O(log n). Rows do not store
+ * their index: rtIndexOf() derives it by walking from the row's leaf to the
+ * root and summing the counts of the subtrees to its left. Rows are
+ * allocated by the tree from the slab 'mem' points to and keep their address
+ * until deleted.
+ *
+ * Lines of the file that were never looked at take no row: their slot holds
+ * the line number, tagged in the low bit, plus the line's hl_open_comment,
+ * and rtAt() builds the row from the line index the first time it is asked
+ * for; rtForget() turns a row left as it was built back into its line.
+ * The rtIter functions walk rows in order without building any, for passes
+ * over the whole buffer such as saving or searching. */
+
+#define RT_LEAF 64 /* Row slots per leaf block. */
+#define RT_FANOUT 32 /* Children per internal node. */
+
+struct rtNode;
+
+struct rowtree {
+    struct rtNode *root;
+    struct slab *mem; /* Allocator the rows come from. */
+    char *map; /* File the untouched lines are in. */
+    struct lineindex *lines; /* Where in 'map' each line starts. */
+};
+
+struct rtIter {
+    struct rowtree *t;
+    struct rtNode *leaf;
+    int pos;
+};
+
+erow *rtAt(struct rowtree *t, int at);
+int rtForget(struct rowtree *t, erow *row);
+int rtIndexOf(erow *row);
+erow *rtNext(struct rowtree *t, erow *row);
+erow *rtInsert(struct rowtree *t, int at);
+void rtAppendLines(struct rowtree *t, size_t line, size_t n);
+void rtDelete(struct rowtree *t, int at);
+void rtFree(struct rowtree *t);
+
+int rtIterAt(struct rowtree *t, int at, struct rtIter *it);
+int rtIterNext(struct rtIter *it);
+erow *rtIterRow(struct rtIter *it);
+char *rtIterText(struct rtIter *it, int *len);
+int rtIterContinued(struct rtIter *it);
+int rtIterLines(struct rtIter *it, size_t *line);
+int rtIterOpenComment(struct rtIter *it);
+void rtIterSetOpenComment(struct rtIter *it, int oc);
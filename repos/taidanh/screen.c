@@ -0,0 +1,351 @@
+#include "screen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCR_SAME(a, b) ((a).ch == (b).ch && (a).attr == (b).attr)
+#define SCR_BLANK(c) ((c).ch == ' ' && (c).attr == 0)
+
+void scrResize(struct screen *s, int rows, int cols) {
+    size_t n = (size_t)rows * cols;
+    free(s->front);
+    free(s->back);
+    s->rows = rows;
+    s->cols = cols;
+    s->front = malloc(sizeof(struct scrCell) * (n ? n : 1));
+    s->back = malloc(sizeof(struct scrCell) * (n ? n : 1));
+    s->valid = 0;
+    s->cy = -1;
+    scrClear(s);
+}
+
+void scrClear(struct screen *s) {
+    size_t n = (size_t)s->rows * s->cols;
+    for (size_t i = 0; i < n; i++) {
+        s->back[i].ch = ' ';
+        s->back[i].attr = 0;
+    }
+}
+
+void scrFill(struct screen *s, int y, int x, int len, int attr) {
+    if (y < 0 || y >= s->rows)
+        return;
+    struct scrCell *c = &s->back[(size_t)y * s->cols];
+    for (; len > 0 && x < s->cols; len--, x++) {
+        c[x].ch = ' ';
+        c[x].attr = attr;
+    }
+}
+
+int scrPut(struct screen *s, int y, int x, const char *p, int len, int attr) {
+    if (y < 0 || y >= s->rows)
+        return x;
+    struct scrCell *c = &s->back[(size_t)y * s->cols];
+    for (int i = 0; i < len && x < s->cols; i++, x++) {
+        c[x].ch = p[i];
+        c[x].attr = attr;
+    }
+    return x;
+}
+
+/* Make room for 'len' more bytes in s->out. */
+static char *scrRoom(struct screen *s, size_t len) {
+    if (s->len + len > s->cap) {
+        size_t cap = s->cap ? s->cap * 2 : 4096;
+        while (cap < s->len + len)
+            cap *= 2;
+        char *out = realloc(s->out, cap);
+        if (out == NULL)
+            return NULL;
+        s->out = out;
+        s->cap = cap;
+    }
+    return &s->out[s->len];
+}
+
+static void scrAppend(struct screen *s, const char *p, size_t len) {
+    char *to = scrRoom(s, len);
+    if (to == NULL)
+        return;
+    memcpy(to, p, len);
+    s->len += len;
+}
+
+/* Write in 'seq' the SGR sequence that takes the terminal from drawing
+ * with 'from' to drawing with 'to'. Bold and inverse only go away together
+ * with everything else, so losing either starts from a reset. */
+static int scrEncode(char *seq, int from, int to) {
+    int n = 2;
+    seq[0] = '\x1b';
+    seq[1] = '[';
+    if (from & ~to & (SCR_BOLD | SCR_INVERSE)) {
+        seq[n++] = '0';
+        from = 0;
+    }
+    if ((to & SCR_BOLD) && !(from & SCR_BOLD))
+        n += sprintf(&seq[n], "%s1", n > 2 ? ";" : "");
+    if ((to & SCR_INVERSE) && !(from & SCR_INVERSE))
+        n += sprintf(&seq[n], "%s7", n > 2 ? ";" : "");
+    if ((to & SCR_COLOR) != (from & SCR_COLOR)) {
+        int color = to & SCR_COLOR;
+        n += sprintf(&seq[n], "%s3%c", n > 2 ? ";" : "", color ? '0' + color - 1 : '9');
+    }
+    if (n == 3 && seq[2] == '0')
+        n = 2; /* A plain reset. */
+    seq[n++] = 'm';
+    return n;
+}
+
+/* SGR sequences from one set of attributes to another, encoded the first
+ * time the terminal goes that way. */
+static struct {
+    unsigned char len;
+    char seq[15];
+} scrSGR[SCR_ATTRS][SCR_ATTRS];
+
+/* Switch the terminal to drawing with 'attr'. */
+static void scrAttr(struct screen *s, int attr) {
+    if (attr == s->attr)
+        return;
+    if (scrSGR[s->attr][attr].len == 0)
+        scrSGR[s->attr][attr].len = scrEncode(scrSGR[s->attr][attr].seq, s->attr, attr);
+    scrAppend(s, scrSGR[s->attr][attr].seq, scrSGR[s->attr][attr].len);
+    s->attr = attr;
+}
+
+/* Write 'v' in decimal to 'buf'. */
+static int scrNum(char *buf, int v) {
+    char digits[12];
+    int d = 0, n = 0;
+    do
+        digits[d++] = '0' + v % 10;
+    while ((v /= 10) != 0);
+    while (d)
+        buf[n++] = digits[--d];
+    return n;
+}
+
+/* Write in 'buf' a control sequence ending in 'final' with parameters
+ * 'a' and 'b', leaving out 'b' if it is 0 and then 'a' if it is 1. */
+static int scrCsi(char *buf, int a, int b, char final) {
+    int n = 2;
+    buf[0] = '\x1b';
+    buf[1] = '[';
+    if (a != 1 || b)
+        n += scrNum(&buf[n], a);
+    if (b) {
+        buf[n++] = ';';
+        n += scrNum(&buf[n], b);
+    }
+    buf[n++] = final;
+    return n;
+}
+
+/* Move the cursor to row 'y', column 'x', the shortest way there. */
+static void scrMove(struct screen *s, int y, int x) {
+    if (s->cy == y && s->cx == x)
+        return;
+    char best[32], buf[32];
+    int n = scrCsi(best, y + 1, x ? x + 1 : 0, 'H');
+
+    if (s->cy == y && x != s->cx) {
+        int k = x > s->cx ? scrCsi(buf, x - s->cx, 0, 'C') : scrCsi(buf, s->cx - x, 0, 'D');
+        if (k < n) {
+            memcpy(best, buf, k);
+            n = k;
+        }
+    }
+    if (s->cy != -1 && (s->cy == y || s->cy + 1 == y)) {
+        int k = 0;
+        buf[k++] = '\r';
+        if (s->cy != y)
+            buf[k++] = '\n';
+        if (x)
+            k += scrCsi(&buf[k], x, 0, 'C');
+        if (k < n) {
+            memcpy(best, buf, k);
+            n = k;
+        }
+    }
+    scrAppend(s, best, n);
+    s->cy = y;
+    s->cx = x;
+}
+
+/* Write cells [from, to) of back grid row 'y'. */
+static void scrWrite(struct screen *s, int y, int from, int to) {
+    struct scrCell *c = &s->back[(size_t)y * s->cols];
+    scrMove(s, y, from);
+    int x = from;
+    while (x < to) {
+        scrAttr(s, c[x].attr);
+        int end = x + 1;
+        while (end < to && c[end].attr == c[x].attr)
+            end++;
+        char *out = scrRoom(s, end - x);
+        if (out == NULL)
+            return;
+        for (int i = x; i < end; i++)
+            *out++ = c[i].ch;
+        s->len += end - x;
+        x = end;
+    }
+    s->cx = to;
+    /* Past the last column the next byte may wrap or may not. */
+    if (to >= s->cols)
+        s->cy = -1;
+}
+
+void scrScroll(struct screen *s, int top, int bottom, int n) {
+    s->stop = top;
+    s->sbottom = bottom;
+    s->sn = n;
+}
+
+/* Count the rows in [top, bottom) of the back grid that the front grid
+ * has 'n' rows further down. */
+static int scrMatches(struct screen *s, int top, int bottom, int n) {
+    size_t row = sizeof(struct scrCell) * s->cols;
+    int count = 0;
+    for (int y = top; y < bottom; y++) {
+        if (y + n < top || y + n >= bottom)
+            continue;
+        if (memcmp(&s->back[(size_t)y * s->cols], &s->front[(size_t)(y + n) * s->cols], row) == 0)
+            count++;
+    }
+    return count;
+}
+
+/* Scroll what scrScroll() asked for, on the terminal and in the front
+ * grid, if more rows then match the back grid than do now. */
+static void scrScrollRegion(struct screen *s, int *hidden) {
+    int top = s->stop, bottom = s->sbottom, n = s->sn;
+    int count = n > 0 ? n : -n;
+    s->sn = 0;
+    if (s->scroll == SCR_SCROLL_NONE || n == 0 || top < 0 || bottom > s->rows ||
+        count >= bottom - top)
+        return;
+    if (scrMatches(s, top, bottom, n) <= scrMatches(s, top, bottom, 0))
+        return;
+
+    char buf[32];
+    if (!*hidden) {
+        scrAppend(s, "\x1b[?25l", 6);
+        *hidden = 1;
+    }
+    scrAttr(s, 0); /* Rows scrolled in take the current background. */
+    scrAppend(s, buf, scrCsi(buf, top + 1, bottom, 'r'));
+    if (s->scroll == SCR_SCROLL_SU) {
+        scrAppend(s, buf, scrCsi(buf, count, 0, n > 0 ? 'S' : 'T'));
+    } else {
+        /* A line feed on the bottom margin scrolls up, a reverse index on
+         * the top one down. */
+        scrAppend(s, buf, scrCsi(buf, n > 0 ? bottom : top + 1, 0, 'H'));
+        for (int i = 0; i < count; i++)
+            scrAppend(s, n > 0 ? "\n" : "\x1bM", n > 0 ? 1 : 2);
+    }
+    scrAppend(s, "\x1b[r", 3);
+    s->cy = -1; /* Setting the margins moved the cursor home. */
+
+    size_t row = sizeof(struct scrCell) * s->cols;
+    struct scrCell *f = &s->front[(size_t)top * s->cols];
+    int keep = bottom - top - count, from = n > 0 ? bottom - count : top;
+    if (n > 0)
+        memmove(f, &f[(size_t)count * s->cols], row * keep);
+    else
+        memmove(&f[(size_t)count * s->cols], f, row * keep);
+    for (size_t i = (size_t)from * s->cols; i < (size_t)(from + count) * s->cols; i++) {
+        s->front[i].ch = ' ';
+        s->front[i].attr = 0;
+    }
+}
+
+/* Returns the number of cells before the trailing blanks of 'c'. */
+static int scrUsed(const struct scrCell *c, int cols) {
+    while (cols > 0 && SCR_BLANK(c[cols - 1]))
+        cols--;
+    return cols;
+}
+
+static int scrWide(const struct scrCell *c, int cols) {
+    for (int x = 0; x < cols; x++)
+        if (c[x].ch >= 0x80)
+            return 1;
+    return 0;
+}
+
+size_t scrFlush(struct screen *s, int cy, int cx) {
+    int hidden = 0;
+    s->len = 0;
+    if (!s->valid) {
+        scrAppend(s, "\x1b[?25l\x1b[m\x1b[2J", 13);
+        hidden = 1;
+        s->attr = 0;
+        s->cy = -1;
+        size_t n = (size_t)s->rows * s->cols;
+        for (size_t i = 0; i < n; i++) {
+            s->front[i].ch = ' ';
+            s->front[i].attr = 0;
+        }
+        s->valid = 1;
+        s->sn = 0;
+    }
+    scrScrollRegion(s, &hidden);
+
+    for (int y = 0; y < s->rows; y++) {
+        struct scrCell *f = &s->front[(size_t)y * s->cols];
+        struct scrCell *b = &s->back[(size_t)y * s->cols];
+        if (memcmp(f, b, sizeof(struct scrCell) * s->cols) == 0)
+            continue;
+        if (!hidden) {
+            scrAppend(s, "\x1b[?25l", 6);
+            hidden = 1;
+        }
+
+        int used = scrUsed(b, s->cols), was = scrUsed(f, s->cols);
+        if (scrWide(b, used) || scrWide(f, was)) {
+            /* Columns and cells part ways; write it all and clear after. */
+            scrWrite(s, y, 0, used);
+            scrAttr(s, 0);
+            scrAppend(s, "\x1b[K", 3);
+            s->cy = -1;
+        } else {
+            int x = 0;
+            while (x < used) {
+                if (SCR_SAME(f[x], b[x])) {
+                    x++;
+                    continue;
+                }
+                int last = x;
+                for (int j = x + 1; j < used && j - last <= SCR_GAP; j++)
+                    if (!SCR_SAME(f[j], b[j]))
+                        last = j;
+                scrWrite(s, y, x, last + 1);
+                x = last + 1;
+            }
+            if (was > used) {
+                scrMove(s, y, used);
+                scrAttr(s, 0);
+                scrAppend(s, "\x1b[K", 3);
+            }
+        }
+        memcpy(f, b, sizeof(struct scrCell) * s->cols);
+    }
+
+    scrAttr(s, 0);
+    scrMove(s, cy, cx);
+    if (hidden)
+        scrAppend(s, "\x1b[?25h", 6);
+    s->last = s->len;
+    s->bytes += s->len;
+    s->frames++;
+    return s->len;
+}
+
+void scrFree(struct screen *s) {
+    free(s->front);
+    free(s->back);
+    free(s->out);
+    memset(s, 0, sizeof(*s));
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <stddef.h>
+
+/* The terminal as a grid of cells, each a byte of text and the attributes
+ * it is drawn with. A frame is drawn into the back grid, and scrFlush()
+ * writes out only the runs of cells that differ from the front grid, which
+ * holds what the terminal shows, moving the cursor between them the
+ * shortest way it can. A keypress that only moves the cursor then costs a
+ * few bytes rather than a screenful.
+ *
+ * Cells are bytes, as rows are rendered. A row holding bytes of multibyte
+ * characters takes fewer columns on the terminal than it has cells, so
+ * such a row is written whole whenever it changes. */
+
+#define SCR_COLOR 0x0f /* Foreground 30 + color - 1, or 0 for the default. */
+#define SCR_BOLD 0x10
+#define SCR_INVERSE 0x20
+#define SCR_ATTRS 0x40 /* Attributes are below this. */
+#define SCR_GAP 4 /* Unchanged cells rewritten rather than moved over. */
+
+/* How the terminal scrolls part of the screen, see scrScroll(). */
+#define SCR_SCROLL_NONE 0 /* It can't; rows are drawn again. */
+#define SCR_SCROLL_INDEX 1 /* Line feeds and reverse index at the margins. */
+#define SCR_SCROLL_SU 2 /* Scroll up and scroll down, CSI S and T. */
+
+struct scrCell {
+    unsigned char ch;
+    unsigned char attr;
+};
+
+struct screen {
+    int rows, cols;
+    struct scrCell *front; /* What the terminal shows. */
+    struct scrCell *back; /* The frame being drawn. */
+    int valid; /* front is known; cleared to redraw everything. */
+    int cy, cx; /* Where the terminal cursor is, cy -1 if not known. */
+    int attr; /* Attributes the terminal draws with. */
+    int scroll; /* SCR_SCROLL_NONE, _INDEX or _SU. */
+    int stop, sbottom, sn; /* The scroll scrScroll() asked for, sn 0 if none. */
+    char *out; /* Bytes of the frame being written. */
+    size_t len, cap;
+    size_t last; /* Bytes the last frame took. */
+    unsigned long long bytes; /* Bytes all frames took. */
+    unsigned long frames;
+};
+
+/* Size the grids for a 'rows' by 'cols' terminal, to be drawn in full. */
+void scrResize(struct screen *s, int rows, int cols);
+
+/* Blank the back grid for a new frame. */
+void scrClear(struct screen *s);
+
+/* Put 'len' blanks drawn with 'attr' at row 'y', column 'x'. */
+void scrFill(struct screen *s, int y, int x, int len, int attr);
+
+/* Put 'len' bytes at row 'y', column 'x' of the back grid, with 'attr'.
+ * Bytes past the last column are dropped. Returns the column after them. */
+int scrPut(struct screen *s, int y, int x, const char *p, int len, int attr);
+
+/* Tell the next scrFlush() that rows [top, bottom) show what they did 'n'
+ * rows further down, or up if 'n' is negative. If that saves drawing
+ * rows, the terminal scrolls them in a scroll region and only the rows
+ * it exposes are drawn. */
+void scrScroll(struct screen *s, int top, int bottom, int n);
+
+/* Build in s->out what brings the terminal from the front grid to the
+ * back one, leaving the cursor at row 'cy', column 'cx', and make the back
+ * grid the front one. Returns the number of bytes in s->out. */
+size_t scrFlush(struct screen *s, int cy, int cx);
+
+void scrFree(struct screen *s);
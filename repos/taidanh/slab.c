@@ -0,0 +1,127 @@
+#include "slab.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct slabChunk {
+    struct slabChunk *next;
+    size_t used; /* Bytes carved from data so far. */
+    char data[SLAB_CHUNK];
+};
+
+struct slabLarge {
+    struct slabLarge *prev, *next;
+    size_t size;
+};
+
+/* Classes are 16 byte steps up to 256, then powers of two up to SLAB_MAX. */
+static int slabClass(size_t size) {
+    if (size <= 256)
+        return size ? (size + 15) / 16 - 1 : 0;
+    int c = 16;
+    size_t cap = 512;
+    while (cap < size) {
+        cap *= 2;
+        c++;
+    }
+    return c;
+}
+
+static size_t slabClassSize(int c) {
+    return c < 16 ? (size_t)(c + 1) * 16 : (size_t)512 << (c - 16);
+}
+
+void *slabAlloc(struct slab *s, size_t size) {
+    s->allocs++;
+    s->live += size;
+
+    if (size > SLAB_MAX) {
+        struct slabLarge *l = malloc(sizeof(struct slabLarge) + size);
+        l->prev = NULL;
+        l->next = s->large;
+        l->size = size;
+        if (s->large)
+            s->large->prev = l;
+        s->large = l;
+        s->inuse += size;
+        s->reserved += size;
+        return l + 1;
+    }
+
+    int c = slabClass(size);
+    size_t csize = slabClassSize(c);
+    s->inuse += csize;
+
+    void *p = s->freelist[c];
+    if (p) {
+        s->freelist[c] = *(void **)p;
+        return p;
+    }
+
+    struct slabChunk *chunk = s->chunks;
+    if (chunk == NULL || chunk->used + csize > SLAB_CHUNK) {
+        chunk = malloc(sizeof(struct slabChunk));
+        chunk->next = s->chunks;
+        chunk->used = 0;
+        s->chunks = chunk;
+        s->reserved += SLAB_CHUNK;
+    }
+    p = &chunk->data[chunk->used];
+    chunk->used += csize;
+    return p;
+}
+
+/* Give back a block; 'size' must be the size it was allocated with. */
+void slabFree(struct slab *s, void *p, size_t size) {
+    if (p == NULL)
+        return;
+    s->frees++;
+    s->live -= size;
+
+    if (size > SLAB_MAX) {
+        struct slabLarge *l = (struct slabLarge *)p - 1;
+        if (l->prev)
+            l->prev->next = l->next;
+        else
+            s->large = l->next;
+        if (l->next)
+            l->next->prev = l->prev;
+        s->inuse -= size;
+        s->reserved -= size;
+        free(l);
+        return;
+    }
+
+    int c = slabClass(size);
+    s->inuse -= slabClassSize(c);
+    *(void **)p = s->freelist[c];
+    s->freelist[c] = p;
+}
+
+void *slabRealloc(struct slab *s, void *p, size_t oldsize, size_t newsize) {
+    if (p == NULL)
+        return slabAlloc(s, newsize);
+    if (oldsize <= SLAB_MAX && newsize <= SLAB_MAX && slabClass(oldsize) == slabClass(newsize)) {
+        s->live += newsize - oldsize;
+        return p;
+    }
+    void *np = slabAlloc(s, newsize);
+    memcpy(np, p, oldsize < newsize ? oldsize : newsize);
+    slabFree(s, p, oldsize);
+    return np;
+}
+
+/* Release every block at once. */
+void slabReset(struct slab *s) {
+    while (s->chunks) {
+        struct slabChunk *next = s->chunks->next;
+        free(s->chunks);
+        s->chunks = next;
+    }
+    while (s->large) {
+        struct slabLarge *next = s->large->next;
+        free(s->large);
+        s->large = next;
+    }
+    memset(s, 0, sizeof(*s));
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <stddef.h>
+
+/* Size-classed slab allocator for row payloads. Small blocks are carved out
+ * of large chunks without a per-block header and recycled through one free
+ * list per size class; callers pass the block size back on free. Blocks
+ * above SLAB_MAX go to malloc but are still tracked, so slabReset() can drop
+ * everything a buffer allocated in one go. */
+
+#define SLAB_CHUNK (256 * 1024) /* Bytes carved from malloc at a time. */
+#define SLAB_MAX 4096 /* Largest block served from chunks. */
+#define SLAB_CLASSES 20
+
+struct slabChunk;
+struct slabLarge;
+
+struct slab {
+    struct slabChunk *chunks; /* Chunks, the one being carved first. */
+    struct slabLarge *large; /* Blocks above SLAB_MAX. */
+    void *freelist[SLAB_CLASSES];
+    size_t allocs; /* Blocks handed out so far. */
+    size_t frees; /* Blocks given back so far. */
+    size_t live; /* Bytes requested by live blocks. */
+    size_t inuse; /* Bytes of live blocks after size class rounding. */
+    size_t reserved; /* Bytes taken from malloc. */
+};
+
+void *slabAlloc(struct slab *s, size_t size);
+void slabFree(struct slab *s, void *p, size_t size);
+void *slabRealloc(struct slab *s, void *p, size_t oldsize, size_t newsize);
+void slabReset(struct slab *s);
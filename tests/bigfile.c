@@ -0,0 +1,95 @@
+/* A sparse file of 3072 times LI_LINE_MAX bytes, 3 GB as built by default,
+ * holding one line of zeros between two short ones. The long line is cut
+ * into rows, and the file must open, save in place, save whole and replay
+ * its journal byte for byte. Set LI_LINE_MAX small to run it in a moment,
+ * see run.sh. */
+#include "kilotest.h"
+
+#include <sys/stat.h>
+
+#define BIG_SIZE ((off_t)3072 * LI_LINE_MAX)
+
+static ino_t inode(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_ino : 0;
+}
+
+static off_t size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+/* Every row but the first and last is a full piece of the long line. */
+static void checkRows(struct editorConfig *E, const char *head, const char *tail) {
+    CHECK(E->numrows > 3000, "%d rows", E->numrows);
+    CHECK(testRowIs(E, 0, head, strlen(head)), "first row");
+    erow *last = editorRow(E, E->numrows - 1);
+    size_t n = strlen(tail);
+    CHECK(!last->cont && (size_t)last->size >= n && memcmp(&last->chars[last->size - n], tail, n) == 0,
+        "last row");
+
+    struct rtIter it;
+    int i = 1, bad = 0;
+    for (int more = rtIterAt(&E->rows, 1, &it); more && i < E->numrows - 1; more = rtIterNext(&it), i++) {
+        int l;
+        rtIterText(&it, &l);
+        if (!rtIterContinued(&it) || l != LI_LINE_MAX)
+            bad++;
+    }
+    CHECK(bad == 0, "%d rows not a full piece", bad);
+}
+
+int main(int argc, char **argv) {
+    static struct editorConfig E2;
+    char path[4096], journal[4096 + sizeof(KILO_JOURNAL_SUFFIX)];
+    snprintf(path, sizeof(path), "%s/big.log", argc > 1 ? argv[1] : ".");
+    snprintf(journal, sizeof(journal), "%s%s", path, KILO_JOURNAL_SUFFIX);
+
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL || fputs("head line\n", fp) == EOF || fseeko(fp, BIG_SIZE - 5, SEEK_SET) != 0 ||
+        fputs("tail\n", fp) == EOF || fclose(fp) != 0) {
+        perror(path);
+        return 1;
+    }
+
+    /* Opening cuts the line of zeros into pieces and loses no byte. */
+    initEditor(&E);
+    editorOpen(&E, path);
+    editorIndexFinish(&E);
+    checkRows(&E, "head line", "tail");
+    CHECK(testMatchesFile(&E, path), "the file as opened");
+
+    /* An edit on the last row rewrites the tail of the file in place. */
+    ino_t ino = inode(path);
+    editorRowInsertChar(&E, editorRow(&E, E.numrows - 1), 0, 'X');
+    long long written = testSave(&E);
+    CHECK(written > 0 && written <= 2 * LI_LINE_MAX, "%lld bytes written for the tail", written);
+    CHECK(inode(path) == ino, "the tail save replaced the file");
+    CHECK(size(path) == BIG_SIZE + 1 && testMatchesFile(&E, path), "the file after the tail save");
+
+    /* Edits not saved come back from the journal, with where rows of the
+     * long line stop being pieces of it: Enter inside one ends the line. */
+    editorRowInsertChar(&E, editorRow(&E, 0), 0, '>');
+    editorRowAppendString(&E, editorRow(&E, E.numrows - 1), "!!", 2);
+    E.cy = E.numrows / 2;
+    E.cx = 5;
+    editorInsertNewline(&E);
+    CHECK(!editorRow(&E, E.cy - 1)->cont && editorRow(&E, E.cy)->cont, "Enter inside a piece");
+    jnFlush(&E.journal);
+    initEditor(&E2);
+    editorOpen(&E2, path);
+    editorIndexFinish(&E2);
+    CHECK(E2.dirty && testSameRows(&E, &E2), "the buffer replayed from the journal");
+
+    /* An edit on the first row writes the whole file again. */
+    written = testSave(&E2);
+    CHECK(written == BIG_SIZE + 5, "%lld bytes written for the whole file", written);
+    CHECK(inode(path) != ino && testMatchesFile(&E2, path), "the file after the whole save");
+    CHECK(access(journal, F_OK) != 0, "the journal outlived a clean save");
+
+    jnClose(&E.journal);
+    remove(journal);
+    remove(path);
+    printf("bigfile: %d rows of %d bytes, %d failures\n", E2.numrows, LI_LINE_MAX, fails);
+    return fails != 0;
+}
@@ -0,0 +1,125 @@
+/* The file changing on disk under an open buffer, whose rows not edited
+ * point into a mapping of it: cut short, which raises SIGBUS past its new
+ * end, or rewritten in place, which shows through. Reading those rows must
+ * not crash, and the buffer must stop changing with the file once
+ * editorDiskPoll() sees it changed. */
+#include "kilotest.h"
+
+#include <sys/stat.h>
+
+#define LINES 4000
+
+/* Line 'i' of the file written by 'writeFile', 'c' being its first byte. */
+static int line(char *buf, int i, char c) {
+    return sprintf(buf, "%c line %d of the file, long enough to span pages\n", c, i);
+}
+
+static void writeFile(const char *path, char c) {
+    char buf[128];
+    FILE *fp = fopen(path, "w");
+    for (int i = 0; i < LINES; i++)
+        fwrite(buf, 1, line(buf, i, c), fp);
+    fclose(fp);
+}
+
+/* Write the file again through the same inode, at the same size. The
+ * mtime is moved on by hand, as the clock may not have ticked. */
+static void rewrite(const char *path, char c) {
+    char buf[128];
+    FILE *fp = fopen(path, "r+");
+    for (int i = 0; i < LINES; i++)
+        fwrite(buf, 1, line(buf, i, c), fp);
+    fclose(fp);
+    struct timespec t[2] = { { 0, UTIME_OMIT }, { 1, 0 } };
+    utimensat(AT_FDCWD, path, t, 0);
+}
+
+static void openFile(const char *path) {
+    initEditor(&E);
+    editorOpen(&E, (char *)path);
+    editorIndexFinish(&E);
+}
+
+/* Is every byte of row 'at' zero? */
+static int zeros(int at) {
+    erow *row = editorRow(&E, at);
+    for (int i = 0; i < row->size; i++)
+        if (row->chars[i])
+            return 0;
+    return row->size > 0;
+}
+
+/* Truncated under a buffer with edits: rows past the end read as zeros,
+ * before the poll and after, and a save writes the buffer whole. */
+static void testTruncateDirty(const char *path) {
+    char buf[129];
+    writeFile(path, 'a');
+    openFile(path);
+    editorRowInsertChar(&E, editorRow(&E, 0), 0, '>');
+    editorRenderRow(&E, editorRow(&E, LINES - 20));
+    truncate(path, 0);
+
+    /* Rows drawn before the poll, built already or not. */
+    CHECK(zeros(LINES - 10) && zeros(LINES - 20), "rows past the end before the poll");
+    editorRenderRow(&E, editorRow(&E, LINES - 30));
+    CHECK(editorDiskPoll(&E) == 1 && !E.mapondisk, "the poll did not see the file cut short");
+    CHECK(strstr(E.statusmsg, "cut short") != NULL, "status \"%s\"", E.statusmsg);
+    CHECK(E.numrows == LINES && zeros(LINES - 1), "rows past the end after the poll");
+    buf[0] = '>';
+    line(&buf[1], 0, 'a');
+    CHECK(testRowIs(&E, 0, buf, strlen(buf) - 1), "the edited row");
+
+    long long written = testSave(&E);
+    CHECK(written > 0 && testMatchesFile(&E, path), "the file after the save, %lld bytes", written);
+    jnRemove(&E.journal);
+    jnClose(&E.journal);
+}
+
+/* Truncated to half under a buffer with no edits: it is read again. */
+static void testTruncateClean(const char *path) {
+    char buf[128];
+    writeFile(path, 'b');
+    openFile(path);
+    E.cy = LINES - 1;
+    off_t half = 0;
+    for (int i = 0; i < LINES / 2; i++)
+        half += line(buf, i, 'b');
+    truncate(path, half);
+
+    CHECK(zeros(LINES - 1), "the last row before the poll");
+    CHECK(editorDiskPoll(&E) == 1, "the poll did not see the file cut short");
+    CHECK(E.numrows == LINES / 2 && testMatchesFile(&E, path), "%d rows read again", E.numrows);
+    CHECK(E.cy == LINES / 2 - 1, "cursor on row %d", E.cy);
+    CHECK(editorDiskPoll(&E) == 0, "the file read again taken for changed");
+}
+
+/* Rewritten in place under a buffer with edits: the rows are kept as they
+ * were once the poll sees it, however the file changes after. */
+static void testRewriteDirty(const char *path) {
+    char buf[128];
+    writeFile(path, 'c');
+    openFile(path);
+    editorRowInsertChar(&E, editorRow(&E, 0), 0, '>');
+    CHECK(editorDiskPoll(&E) == 0, "the file taken for changed as opened");
+    rewrite(path, 'd');
+    CHECK(editorDiskPoll(&E) == 1 && !E.mapondisk, "the poll did not see the rewrite");
+    rewrite(path, 'e');
+    CHECK(testRowIs(&E, 5, buf, line(buf, 5, 'd') - 1), "a row changed after the poll");
+    CHECK(editorDiskPoll(&E) == 0, "a detached buffer polled");
+
+    testSave(&E);
+    CHECK(testMatchesFile(&E, path), "the file after the save");
+    jnRemove(&E.journal);
+    jnClose(&E.journal);
+}
+
+int main(int argc, char **argv) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/disk.txt", argc > 1 ? argv[1] : ".");
+    testTruncateDirty(path);
+    testTruncateClean(path);
+    testRewriteDirty(path);
+    remove(path);
+    printf("disk: %d failures\n", fails);
+    return fails != 0;
+}
@@ -0,0 +1,131 @@
+/* Following a file, as tail -f does, while it grows, is cut short and is
+ * replaced by a rename, as logs are when rotated. A buffer with no edits
+ * keeps up with the file; one with edits stops following and keeps its
+ * rows, which must not read past the end of a file cut short. */
+#include "kilotest.h"
+
+#define LINES 3000
+
+static void append(const char *path, const char *mode, int from, int n) {
+    FILE *fp = fopen(path, mode);
+    for (int i = from; i < from + n; i++)
+        fprintf(fp, "line %d of the followed log\n", i);
+    fclose(fp);
+}
+
+/* Open 'path' with 'n' lines and follow it. */
+static void follow(const char *path, int n) {
+    append(path, "w", 0, n);
+    initEditor(&E);
+    editorOpen(&E, (char *)path);
+    editorIndexFinish(&E);
+    editorToggleFollow(&E);
+    CHECK(E.follow, "not following: %s", E.statusmsg);
+    editorFollowPoll(&E);
+}
+
+/* Poll until the buffer changes, for a second at most. */
+static int waitChange(void) {
+    for (int i = 0; i < 100; i++) {
+        if (editorFollowPoll(&E))
+            return 1;
+        usleep(10000);
+    }
+    return 0;
+}
+
+static void stop(const char *path) {
+    if (E.watch)
+        platformWatchClose(E.watch);
+    E.watch = NULL;
+    E.follow = 0;
+    jnRemove(&E.journal);
+    jnClose(&E.journal);
+}
+
+/* Every row past the first 'n' reads as zeros. */
+static int zerosFrom(int n) {
+    for (int at = n; at < E.numrows; at++) {
+        erow *row = editorRow(&E, at);
+        for (int i = 0; i < row->size; i++)
+            if (row->chars[i])
+                return 0;
+    }
+    return 1;
+}
+
+static void testClean(const char *path, const char *rotated) {
+    follow(path, LINES);
+    E.cy = E.numrows - 1;
+
+    append(path, "a", LINES, 10);
+    CHECK(waitChange() && E.numrows == LINES + 10 && testMatchesFile(&E, path), "%d rows after growing",
+        E.numrows);
+    CHECK(E.cy == E.numrows - 1, "the cursor left the end on growing");
+
+    append(path, "w", 0, 5);
+    CHECK(waitChange() && E.numrows == 5 && testMatchesFile(&E, path), "%d rows after truncating",
+        E.numrows);
+
+    append(rotated, "w", 100, LINES);
+    rename(rotated, path);
+    CHECK(waitChange() && E.numrows == LINES && testMatchesFile(&E, path), "%d rows after the rename",
+        E.numrows);
+    append(path, "a", 0, 1);
+    CHECK(waitChange() && E.numrows == LINES + 1 && testMatchesFile(&E, path),
+        "%d rows growing after the rename", E.numrows);
+    CHECK(!E.dirty && E.follow, "following stopped");
+    stop(path);
+}
+
+static void testDirtyGrow(const char *path) {
+    follow(path, LINES);
+    editorRowInsertChar(&E, editorRow(&E, 0), 0, '>');
+    append(path, "a", LINES, 10);
+    CHECK(waitChange() && !E.follow && E.numrows == LINES, "following went on with edits, %d rows",
+        E.numrows);
+    testSave(&E);
+    CHECK(testMatchesFile(&E, path), "the file saved after growing");
+    stop(path);
+}
+
+/* Cut short under rows not yet drawn: they read as zeros, before the poll
+ * and after, and the save writes the buffer as it shows. */
+static void testDirtyTruncate(const char *path) {
+    follow(path, LINES);
+    editorRowInsertChar(&E, editorRow(&E, 0), 0, '>');
+    append(path, "w", 0, 5);
+    CHECK(zerosFrom(LINES / 2), "rows past the end before the poll");
+    CHECK(waitChange() && !E.follow && !E.mapondisk, "following went on with edits after truncating");
+    CHECK(E.numrows == LINES && zerosFrom(LINES / 2), "rows past the end after the poll");
+    testSave(&E);
+    CHECK(testMatchesFile(&E, path), "the file saved after truncating");
+    stop(path);
+}
+
+/* Replaced under the buffer, the rows keep the file that was mapped. */
+static void testDirtyRename(const char *path, const char *rotated) {
+    follow(path, LINES);
+    editorRowInsertChar(&E, editorRow(&E, 0), 0, '>');
+    append(rotated, "w", 100, 5);
+    rename(rotated, path);
+    CHECK(waitChange() && !E.follow, "following went on with edits after the rename");
+    CHECK(E.numrows == LINES && testRowIs(&E, LINES - 1, "line 2999 of the followed log", 29),
+        "rows after the rename");
+    testSave(&E);
+    CHECK(testMatchesFile(&E, path), "the file saved after the rename");
+    stop(path);
+}
+
+int main(int argc, char **argv) {
+    char path[4096], rotated[4096 + 4];
+    snprintf(path, sizeof(path), "%s/follow.log", argc > 1 ? argv[1] : ".");
+    snprintf(rotated, sizeof(rotated), "%s.new", path);
+    testClean(path, rotated);
+    testDirtyGrow(path);
+    testDirtyTruncate(path);
+    testDirtyRename(path, rotated);
+    remove(path);
+    printf("follow: %d failures\n", fails);
+    return fails != 0;
+}
@@ -0,0 +1,172 @@
+/* Gzip files opened as the text they hold: members one after another read
+ * as one, as gunzip reads them, a file cut short or corrupt keeps what
+ * inflated before the damage and says so, and quitting while a large file
+ * is still inflating does not wait for the rest. Saving writes gzip again
+ * unless told not to. Built only where zlib is, see run.sh. */
+#include "kilotest.h"
+
+#ifdef KILO_HAVE_ZLIB
+#include <zlib.h>
+
+/* 'len' bytes at 'p' as one gzip member, appended to 'out' at '*at'. */
+static void member(char *out, size_t *at, size_t cap, const char *p, size_t len) {
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    deflateInit2(&z, 6, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    z.next_in = (unsigned char *)p;
+    z.avail_in = len;
+    z.next_out = (unsigned char *)out + *at;
+    z.avail_out = cap - *at;
+    CHECK(deflate(&z, Z_FINISH) == Z_STREAM_END, "deflate");
+    *at += z.total_out;
+    deflateEnd(&z);
+}
+
+/* The text of the gzip file at 'path', 'cap' bytes at most. */
+static char *gunzip(const char *path, size_t cap, size_t *len) {
+    size_t n;
+    char *map = platformMapFile(path, &n), *out = malloc(cap);
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    inflateInit2(&z, 16 + MAX_WBITS);
+    z.next_in = (unsigned char *)map;
+    z.avail_in = n;
+    z.next_out = (unsigned char *)out;
+    z.avail_out = cap;
+    int rc = inflate(&z, Z_FINISH);
+    *len = rc == Z_STREAM_END ? z.total_out : (size_t)-1;
+    inflateEnd(&z);
+    platformUnmapFile(map, n);
+    return out;
+}
+
+static void writeBytes(const char *path, const char *p, size_t len) {
+    FILE *fp = fopen(path, "w");
+    fwrite(p, 1, len, fp);
+    fclose(fp);
+}
+
+/* Open 'path' and read until the text is all inflated, for a minute at
+ * most. */
+static void openAll(const char *path) {
+    initEditor(&E);
+    editorOpen(&E, (char *)path);
+    long long start = platformClock();
+    while (E.stream && platformClock() - start < 60000) {
+        if (!editorStreamPoll(&E))
+            platformStreamWait(E.stream, 10);
+    }
+    CHECK(E.stream == NULL, "still inflating %s after a minute", path);
+}
+
+static void testMembers(const char *path) {
+    static char gz[4096];
+    size_t len = 0;
+    member(gz, &len, sizeof(gz), "one\n", 4);
+    member(gz, &len, sizeof(gz), "two\npar", 7);
+    member(gz, &len, sizeof(gz), "tial\nlast", 9);
+    len += 16; /* Padding after the last member, as tar leaves. */
+    writeBytes(path, gz, len);
+
+    openAll(path);
+    CHECK(E.gzip && E.numrows == 4 && testRowIs(&E, 0, "one", 3) && testRowIs(&E, 2, "partial", 7)
+            && testRowIs(&E, 3, "last", 4),
+        "%d rows of three members", E.numrows);
+    CHECK(E.statusmsg[0] == '\0', "members read with: %s", E.statusmsg);
+
+    /* Saved as one member, with no journal left. */
+    editorRowInsertChar(&E, editorRow(&E, 0), 0, '>');
+    CHECK(testSave(&E) > 0, "saving the members: %s", E.statusmsg);
+    size_t n;
+    char *text = gunzip(path, 4096, &n);
+    CHECK(n == 22 && memcmp(text, ">one\ntwo\npartial\nlast\n", 22) == 0, "the members saved");
+    free(text);
+    char journal[4096 + sizeof(KILO_JOURNAL_SUFFIX)];
+    snprintf(journal, sizeof(journal), "%s%s", path, KILO_JOURNAL_SUFFIX);
+    CHECK(access(journal, F_OK) == -1, "a journal for a gzip file");
+
+    /* Saved uncompressed once told to. */
+    editorToggleGzip(&E);
+    editorRowDelChar(&E, editorRow(&E, 0), 0);
+    CHECK(testSave(&E) == 21 && testMatchesFile(&E, path), "saving uncompressed: %s", E.statusmsg);
+    editorFreeRows(&E);
+}
+
+#define LINES 200000
+
+/* A damaged file keeps the lines before the damage. Corrupt data may
+ * inflate to other text before zlib finds it out, so only the rows of a
+ * file cut short are all checked. */
+static void testDamaged(const char *path) {
+    size_t cap = LINES * 40, len = 0, at = 0;
+    char *text = malloc(cap), *gz = malloc(cap);
+    for (int i = 0; i < LINES; i++)
+        at += sprintf(&text[at], "line %d of the compressed file\n", i);
+    member(gz, &len, cap, text, at);
+
+    for (int damage = 0; damage < 2; damage++) {
+        if (damage)
+            gz[len / 2] ^= 0x55;
+        writeBytes(path, gz, damage ? len : len / 2);
+        openAll(path);
+        const char *what = damage ? "corrupt" : "cut short";
+        CHECK(strstr(E.statusmsg, "Stopped reading input") != NULL, "%s: %s", what, E.statusmsg);
+        CHECK(E.numrows > 0 && E.numrows < LINES, "%d rows of a damaged file", E.numrows);
+        /* Every row but the last is whole; the last may be cut. */
+        int ok = 1;
+        for (int i = 0, off = 0; i < (damage ? 100 : E.numrows) && ok; i++) {
+            erow *row = editorRow(&E, i);
+            const char *nl = strchr(&text[off], '\n');
+            int want = nl - &text[off];
+            ok = (row->size == want || (i == E.numrows - 1 && row->size < want))
+                && memcmp(row->chars, &text[off], row->size) == 0;
+            off += want + 1;
+        }
+        CHECK(ok, "rows of a file %s", what);
+        editorFreeRows(&E);
+    }
+    free(text);
+    free(gz);
+}
+
+/* Quitting mid-inflate: a file of a few MB inflating to 2 GB, in 128
+ * members of 16 MB. */
+static void testQuit(const char *path) {
+    size_t cap = 1 << 20, len = 0;
+    char *gz = malloc(cap), *text = malloc(16 << 20);
+    for (size_t i = 0; i < (16 << 20); i++)
+        text[i] = i % 64 == 63 ? '\n' : 'a' + i % 64 % 26;
+    member(gz, &len, cap, text, 16 << 20);
+    FILE *fp = fopen(path, "w");
+    for (int i = 0; i < 128; i++)
+        fwrite(gz, 1, len, fp);
+    fclose(fp);
+    free(text);
+    free(gz);
+
+    initEditor(&E);
+    editorOpen(&E, (char *)path);
+    for (int i = 0; i < 3; i++)
+        editorStreamPoll(&E);
+    CHECK(E.stream != NULL, "inflated %zu bytes at once", E.maplen);
+    long long start = platformClock();
+    editorFreeRows(&E);
+    long long took = platformClock() - start;
+    CHECK(took < 1000, "quitting mid-inflate took %lld ms", took);
+}
+#endif
+
+int main(int argc, char **argv) {
+#ifdef KILO_HAVE_ZLIB
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/text.gz", argc > 1 ? argv[1] : ".");
+    testMembers(path);
+    testDamaged(path);
+    testQuit(path);
+    remove(path);
+    printf("gzip: %d failures\n", fails);
+#else
+    printf("gzip: built without zlib, skipped\n");
+#endif
+    return fails != 0;
+}
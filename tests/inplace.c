@@ -0,0 +1,199 @@
+/* Saves that rewrite only the end of the file, from the first row edited
+ * on. A save cut short after its redo file is written is finished by the
+ * next open, whatever state it left the file in; a redo file that does not
+ * fit the file is dropped. Where the tail cannot go in place, the whole
+ * file is written as a new one. Random edits and saves are in savefuzz.c. */
+#include "kilotest.h"
+
+#include <sys/stat.h>
+
+#define LINES 40000
+
+static char redoPath[4096 + sizeof(KILO_REDO_SUFFIX)];
+
+static void writeLines(const char *path, int n) {
+    FILE *fp = fopen(path, "w");
+    for (int i = 0; i < n; i++)
+        fprintf(fp, "line %d of a file saved in place\n", i);
+    fclose(fp);
+}
+
+static void writeBytes(const char *path, const char *p, size_t len) {
+    FILE *fp = fopen(path, "w");
+    fwrite(p, 1, len, fp);
+    fclose(fp);
+}
+
+static char *readBytes(const char *path, size_t *len) {
+    size_t n;
+    char *map = platformMapFile(path, &n);
+    char *buf = malloc(n + 1);
+    if (map) {
+        memcpy(buf, map, n);
+        platformUnmapFile(map, n);
+    }
+    *len = map ? n : 0;
+    return buf;
+}
+
+static ino_t inode(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_ino : 0;
+}
+
+static void openFile(const char *path) {
+    initEditor(&E);
+    editorOpen(&E, (char *)path);
+    editorIndexFinish(&E);
+}
+
+static void closeFile(void) {
+    jnRemove(&E.journal);
+    jnClose(&E.journal);
+    editorFreeRows(&E);
+}
+
+/* An edit near the end writes the rows from it on, over the file itself;
+ * one near the start writes a new file. */
+static void testTail(const char *path) {
+    writeLines(path, LINES);
+    openFile(path);
+    ino_t ino = inode(path);
+    editorRowAppendString(&E, editorRow(&E, LINES - 2), " and more", 9);
+    editorInsertRow(&E, LINES, "a new last line", 15);
+    long long written = testSave(&E);
+    CHECK(written > 0 && written < 100 && inode(path) == ino, "%lld bytes written for the tail", written);
+    CHECK(testMatchesFile(&E, path) && access(redoPath, F_OK) == -1, "the file saved in place");
+
+    /* The rows now match the file, so the next save starts after them. */
+    editorRowDelChar(&E, editorRow(&E, LINES), 0);
+    written = testSave(&E);
+    CHECK(written == 15 && inode(path) == ino, "%lld bytes written for the last row", written);
+    CHECK(testMatchesFile(&E, path), "the file saved in place again");
+
+    editorRowInsertChar(&E, editorRow(&E, 10), 0, '>');
+    written = testSave(&E);
+    CHECK(written > LINES * 30 && inode(path) != ino, "%lld bytes written for an early edit", written);
+    CHECK(testMatchesFile(&E, path), "the file saved whole");
+    closeFile();
+}
+
+/* Leave 'file' and a redo file for 'tail' at 'from', as a save cut short
+ * would, open and check the file comes out as 'want'. */
+static void testRedoOf(const char *path, const char *file, size_t flen, long long from, const char *tail,
+    size_t tlen, const char *want, size_t wlen, const char *what) {
+    writeBytes(path, file, flen);
+    struct editorRedo redo = { KILO_REDO_MAGIC, from, tlen };
+    FILE *fp = fopen(redoPath, "w");
+    fwrite(&redo, sizeof(redo), 1, fp);
+    fwrite(tail, 1, tlen, fp);
+    fclose(fp);
+
+    openFile(path);
+    size_t len;
+    char *got = readBytes(path, &len);
+    CHECK(len == wlen && memcmp(got, want, len) == 0, "%s: the file opened", what);
+    CHECK(testMatchesFile(&E, path) && !E.dirty, "%s: the buffer", what);
+    CHECK(access(redoPath, F_OK) == -1, "%s: the redo file left behind", what);
+    free(got);
+    closeFile();
+}
+
+static void testRedo(const char *path) {
+    writeLines(path, LINES);
+    size_t old;
+    char *before = readBytes(path, &old);
+    /* The save being redone put new text over the last 100 lines. */
+    char *last = before + old;
+    for (int i = 0; i < 100; i++)
+        last = memrchr(before, '\n', last - before);
+    long long from = last + 1 - before;
+    const char *tail = "the new end of the file\nin two lines\n";
+    size_t tlen = strlen(tail), wlen = from + tlen;
+    char *want = malloc(old + tlen), *file = malloc(old + tlen);
+    memcpy(want, before, from);
+    memcpy(want + from, tail, tlen);
+
+    /* Cut short before the file was touched, halfway through the tail
+     * and before the file was cut to length. */
+    testRedoOf(path, before, old, from, tail, tlen, want, wlen, "before writing");
+    memcpy(file, before, old);
+    memcpy(file + from, tail, tlen / 2);
+    testRedoOf(path, file, old, from, tail, tlen, want, wlen, "halfway");
+    memcpy(file + from, tail, tlen);
+    testRedoOf(path, file, old, from, tail, tlen, want, wlen, "before truncating");
+    testRedoOf(path, want, wlen, from, tail, tlen, want, wlen, "after truncating");
+    CHECK(strstr(E.statusmsg, "interrupted save") != NULL, "no word of the save finished: %s", E.statusmsg);
+
+    /* Growing the file: the tail is longer than what it replaces. */
+    char *grown = malloc(old + 5000);
+    memcpy(grown, before, from);
+    for (size_t i = 0; i < old - from + 4000; i++)
+        grown[from + i] = i % 40 == 39 ? '\n' : 'g';
+    size_t glen = old + 4000;
+    testRedoOf(path, before, old, from, grown + from, glen - from, grown, glen, "growing");
+
+    /* A redo file that does not fit is dropped, the file left alone. */
+    testRedoOf(path, before, old, old + 1, tail, tlen, before, old, "starting past the end");
+    writeBytes(path, before, old);
+    struct editorRedo redo = { KILO_REDO_MAGIC, from, tlen + 1 };
+    FILE *fp = fopen(redoPath, "w");
+    fwrite(&redo, sizeof(redo), 1, fp);
+    fwrite(tail, 1, tlen, fp);
+    fclose(fp);
+    openFile(path);
+    CHECK(testMatchesFile(&E, path) && E.maplen == old && access(redoPath, F_OK) == -1,
+        "a redo file shorter than it says");
+    closeFile();
+    writeBytes(redoPath, "KILOREDX and then some", 22);
+    openFile(path);
+    CHECK(E.maplen == old && access(redoPath, F_OK) == -1, "a redo file with a bad header");
+    closeFile();
+
+    free(before);
+    free(want);
+    free(file);
+    free(grown);
+}
+
+/* With no redo file to be had, the tail cannot go in place and the whole
+ * file is written instead. The save after that goes in place again. */
+static void testFallback(const char *path) {
+    writeLines(path, LINES);
+    openFile(path);
+    ino_t ino = inode(path);
+    mkdir(redoPath, 0755);
+    editorInsertRow(&E, LINES, "the last line", 13);
+    long long written = testSave(&E);
+    CHECK(written > LINES * 30 && inode(path) != ino, "%lld bytes written with no redo file", written);
+    CHECK(testMatchesFile(&E, path), "the file saved whole");
+    rmdir(redoPath);
+
+    ino = inode(path);
+    editorInsertRow(&E, E.numrows, "and one more", 12);
+    written = testSave(&E);
+    CHECK(written == 13 && inode(path) == ino, "%lld bytes written after the fallback", written);
+    CHECK(testMatchesFile(&E, path), "the file saved in place after the fallback");
+    closeFile();
+
+    /* Nor does the tail go in place in a file changed since it was read. */
+    openFile(path);
+    editorInsertRow(&E, E.numrows, "edited", 6);
+    writeLines(path, LINES + 2);
+    written = testSave(&E);
+    CHECK(written > LINES * 30 && testMatchesFile(&E, path), "%lld bytes written over a changed file",
+        written);
+    closeFile();
+}
+
+int main(int argc, char **argv) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/inplace.txt", argc > 1 ? argv[1] : ".");
+    snprintf(redoPath, sizeof(redoPath), "%s%s", path, KILO_REDO_SUFFIX);
+    testTail(path);
+    testRedo(path);
+    testFallback(path);
+    remove(path);
+    printf("inplace: %d failures\n", fails);
+    return fails != 0;
+}
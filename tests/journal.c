@@ -0,0 +1,194 @@
+/* Journals as a crash leaves them: cut short at every byte, stale for a
+ * file changed since, and compacted then added to. Replay must give the
+ * buffer as it was after the last whole record, ignore a stale log and
+ * leave a log that goes on being added to. */
+#include "kilotest.h"
+
+#define EDITS 60
+
+static struct editorConfig E2;
+static unsigned long long seed = 88172645463325252ULL;
+
+static unsigned rnd(unsigned n) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return n ? seed % n : 0;
+}
+
+static void writeFile(const char *path, const char *text) {
+    FILE *fp = fopen(path, "w");
+    fputs(text, fp);
+    fclose(fp);
+}
+
+static char *readFile(const char *path, size_t *len) {
+    size_t n;
+    char *map = platformMapFile(path, &n);
+    char *buf = malloc(n + 1);
+    if (map) {
+        memcpy(buf, map, n);
+        platformUnmapFile(map, n);
+    }
+    *len = map ? n : 0;
+    return buf;
+}
+
+static void openAs(struct editorConfig *e, const char *path) {
+    initEditor(e);
+    editorOpen(e, (char *)path);
+    editorIndexFinish(e);
+}
+
+/* One random edit logged as a single record. */
+static void edit(struct editorConfig *e) {
+    int at = rnd(e->numrows), r = rnd(6);
+    erow *row = e->numrows ? editorRow(e, at) : NULL;
+    if (row == NULL || r == 0)
+        editorInsertRow(e, rnd(e->numrows + 1), "inserted", 8);
+    else if (r == 1)
+        editorRowInsertChar(e, row, rnd(row->size + 1), 'A' + rnd(26));
+    else if (r == 2 && row->size)
+        editorRowDelChar(e, row, rnd(row->size));
+    else if (r == 3)
+        editorRowAppendString(e, row, "++", 2);
+    else if (r == 4 && row->size)
+        editorRowTruncate(e, row, rnd(row->size));
+    else
+        editorDelRow(e, at);
+}
+
+/* The log cut at each byte replays the edits whose records it holds
+ * whole, drops the torn one and is added to from there. */
+static void testTorn(const char *path, const char *journal) {
+    static char *state[EDITS + 1];
+    static size_t statelen[EDITS + 1], end[EDITS + 1];
+    writeFile(path, "first\nsecond\nthird\nfourth\n");
+    openAs(&E, path);
+    state[0] = testContents(&E, &statelen[0]);
+    for (int i = 1; i <= EDITS; i++) {
+        edit(&E);
+        jnFlush(&E.journal);
+        end[i] = E.journal.size;
+        state[i] = testContents(&E, &statelen[i]);
+    }
+    jnClose(&E.journal);
+    size_t len;
+    char *log = readFile(journal, &len);
+    CHECK(len == end[EDITS], "%zu bytes logged of %zu", len, end[EDITS]);
+
+    int k = 0;
+    for (size_t cut = 0; cut <= len; cut++) {
+        while (k < EDITS && end[k + 1] <= cut)
+            k++;
+        FILE *fp = fopen(journal, "w");
+        fwrite(log, 1, cut, fp);
+        fclose(fp);
+        openAs(&E2, path);
+        size_t n;
+        char *got = testContents(&E2, &n);
+        CHECK(n == statelen[k] && memcmp(got, state[k], n) == 0, "log cut at %zu of %zu: not edit %d", cut,
+            len, k);
+        CHECK(E2.dirty == k, "log cut at %zu: %d edits recovered of %d", cut, E2.dirty, k);
+        free(got);
+
+        /* What is added goes after the last whole record. */
+        if (k && cut % 7 == 0) {
+            editorInsertRow(&E2, 0, "after", 5);
+            jnClose(&E2.journal);
+            openAs(&E2, path);
+            CHECK(E2.dirty == k + 1 && testRowIs(&E2, 0, "after", 5), "added to the log cut at %zu", cut);
+        }
+        jnClose(&E2.journal);
+        if (fails > 10)
+            break;
+    }
+    for (int i = 0; i <= EDITS; i++)
+        free(state[i]);
+    free(log);
+    remove(journal);
+}
+
+/* A log for the file as it was before it changed is not replayed, and is
+ * written over by the first edit to the file as it is now. */
+static void testStale(const char *path, const char *journal) {
+    writeFile(path, "one\ntwo\n");
+    openAs(&E, path);
+    editorRowAppendString(&E, editorRow(&E, 0), " logged", 7);
+    jnClose(&E.journal);
+
+    writeFile(path, "one\ntwo\nthree\n");
+    openAs(&E2, path);
+    CHECK(!E2.dirty && E2.numrows == 3 && testMatchesFile(&E2, path), "a stale log replayed");
+    editorRowAppendString(&E2, editorRow(&E2, 2), "!", 1);
+    jnClose(&E2.journal);
+    openAs(&E2, path);
+    CHECK(E2.dirty == 1 && testRowIs(&E2, 0, "one", 3) && testRowIs(&E2, 2, "three!", 6),
+        "the log written over the stale one");
+    jnClose(&E2.journal);
+
+    /* Nor is one that is not a log at all. */
+    writeFile(journal, "KILOJNL0 and then some bytes of something else");
+    openAs(&E2, path);
+    CHECK(!E2.dirty && testMatchesFile(&E2, path), "a log with a bad header replayed");
+    jnClose(&E2.journal);
+    remove(journal);
+}
+
+/* A compacted log replays to the same rows as the one it replaced, and
+ * goes on being added to, torn or not. */
+static void testCompacted(const char *path, const char *journal) {
+    FILE *fp = fopen(path, "w");
+    for (int i = 0; i < 3000; i++)
+        fprintf(fp, "line %d\n", i);
+    fclose(fp);
+    openAs(&E, path);
+    /* Typing, a key at a time, into a few rows. */
+    for (int i = 0; i < 2000; i++) {
+        erow *row = editorRow(&E, 100 + i % 10 * 271);
+        if (i % 5 == 4)
+            editorRowDelChar(&E, row, row->size - 1);
+        else
+            editorRowInsertChar(&E, row, row->size, 'a' + i % 26);
+    }
+    edit(&E);
+    jnFlush(&E.journal);
+    size_t before = E.journal.size;
+    editorJournalCompact(&E);
+    CHECK(E.journal.size < before / 4, "compacted from %zu bytes to %zu", before, E.journal.size);
+    openAs(&E2, path);
+    CHECK(E2.dirty && testSameRows(&E, &E2), "the compacted log replayed");
+    jnClose(&E2.journal);
+
+    for (int i = 0; i < 50; i++)
+        edit(&E);
+    jnFlush(&E.journal);
+    size_t len;
+    char *log = readFile(journal, &len);
+    openAs(&E2, path);
+    CHECK(testSameRows(&E, &E2), "the compacted log added to");
+    jnClose(&E2.journal);
+
+    /* Torn in what was added, the compacted part still replays. */
+    fp = fopen(journal, "w");
+    fwrite(log, 1, len - 3, fp);
+    fclose(fp);
+    openAs(&E2, path);
+    CHECK(E2.numrows > 2000 && E2.dirty, "the compacted log torn after compaction");
+    jnClose(&E2.journal);
+    free(log);
+    jnRemove(&E.journal);
+    jnClose(&E.journal);
+}
+
+int main(int argc, char **argv) {
+    char path[4096], journal[4096 + sizeof(KILO_JOURNAL_SUFFIX)];
+    snprintf(path, sizeof(path), "%s/journaled.txt", argc > 1 ? argv[1] : ".");
+    snprintf(journal, sizeof(journal), "%s%s", path, KILO_JOURNAL_SUFFIX);
+    testTorn(path, journal);
+    testStale(path, journal);
+    testCompacted(path, journal);
+    remove(path);
+    printf("journal: %d failures\n", fails);
+    return fails != 0;
+}
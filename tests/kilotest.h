@@ -0,0 +1,115 @@
+#pragma once
+/* Drivers take kilo.c and the Linux platform layer in whole, so they can
+ * call what kilo.h does not export, and run without a terminal: the window
+ * is always 24 by 80. See run.sh for how they are built. */
+#include "kilo.c"
+#define getWindowSize platformGetWindowSize
+#define getCursorPosition platformGetCursorPosition
+#include "platform_linux.c"
+#undef getWindowSize
+#undef getCursorPosition
+
+struct editorConfig E;
+static int fails __attribute__((unused));
+
+void editorAtExit(void) {
+}
+
+void handleSigWinCh(int unused __attribute__((unused))) {
+}
+
+int getWindowSize(int ifd, int ofd, int *rows, int *cols) {
+    *rows = 24;
+    *cols = 80;
+    return 0;
+}
+
+/* Count a failure, saying what it was, unless 'ok'. */
+#define CHECK(ok, ...)                                 \
+    do {                                               \
+        if (!(ok)) {                                   \
+            fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__);              \
+            fputc('\n', stderr);                       \
+            fails++;                                   \
+        }                                              \
+    } while (0)
+
+/* The bytes of the buffer as a save would write them. The caller frees
+ * what is returned. */
+static inline char *testContents(struct editorConfig *E, size_t *len) {
+    size_t cap = 4096, n = 0;
+    char *buf = malloc(cap);
+    struct rtIter it;
+    editorSetEditRow(E, NULL);
+    for (int more = rtIterAt(&E->rows, 0, &it); more; more = rtIterNext(&it)) {
+        int l;
+        char *t = rtIterText(&it, &l);
+        while (n + l + 1 > cap)
+            buf = realloc(buf, cap *= 2);
+        memcpy(&buf[n], t, l);
+        n += l;
+        if (!rtIterContinued(&it))
+            buf[n++] = '\n';
+    }
+    if (E->partial && n)
+        n--;
+    *len = n;
+    return buf;
+}
+
+/* Does row 'at' hold exactly the 'len' bytes at 's'? */
+static inline int testRowIs(struct editorConfig *E, int at, const char *s, size_t len) {
+    editorSetEditRow(E, NULL);
+    erow *row = editorRow(E, at);
+    return row && (size_t)row->size == len && memcmp(row->chars, s, len) == 0;
+}
+
+/* Does the file at 'path' hold what a save of the buffer would write? */
+static inline int testMatchesFile(struct editorConfig *E, const char *path) {
+    size_t len, at = 0;
+    char *map = platformMapFile(path, &len);
+    struct rtIter it;
+    int same = 1;
+    editorSetEditRow(E, NULL);
+    for (int more = rtIterAt(&E->rows, 0, &it); more && same; more = rtIterNext(&it)) {
+        int l;
+        char *t = rtIterText(&it, &l);
+        same = at + l <= len && memcmp(&map[at], t, l) == 0;
+        at += l;
+        if (same && !rtIterContinued(&it) && !(E->partial && at == len))
+            same = at < len && map[at++] == '\n';
+    }
+    same = same && at == len;
+    if (map)
+        platformUnmapFile(map, len);
+    return same;
+}
+
+/* Do two buffers hold the same rows, cut the same way? */
+static inline int testSameRows(struct editorConfig *a, struct editorConfig *b) {
+    struct rtIter i, j;
+    if (a->numrows != b->numrows)
+        return 0;
+    editorSetEditRow(a, NULL);
+    editorSetEditRow(b, NULL);
+    int more = rtIterAt(&a->rows, 0, &i);
+    rtIterAt(&b->rows, 0, &j);
+    for (; more; more = rtIterNext(&i), rtIterNext(&j)) {
+        int l, m;
+        char *s = rtIterText(&i, &l), *t = rtIterText(&j, &m);
+        if (l != m || memcmp(s, t, l) != 0 || rtIterContinued(&i) != rtIterContinued(&j))
+            return 0;
+    }
+    return 1;
+}
+
+/* Save and wait for the save to finish. Returns the bytes written, or -1. */
+static inline long long testSave(struct editorConfig *E) {
+    long long written = -1;
+    editorSave(E);
+    while (E->save && !editorSavePoll(E))
+        usleep(1000);
+    sscanf(E->statusmsg, "%lld bytes written", &written);
+    return written;
+}
@@ -0,0 +1,205 @@
+/* Random text with lines of every length, some with '\r' or '\0' in them.
+ * The line index must come out valid built whole, streamed and by the
+ * background workers, and the same where no '\r' moves a cut, and random
+ * edits must survive saves and journal replay byte for byte. Lines are only
+ * cut when LI_LINE_MAX is below the few hundred bytes these are, see
+ * run.sh. */
+#include "kilotest.h"
+
+static unsigned long long seed = 88172645463325252ULL;
+
+static unsigned rnd(unsigned n) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return n ? seed % n : 0;
+}
+
+/* Fill 'buf' with 'len' bytes of lines, with '\r' if 'cr'. */
+static void genText(char *buf, size_t len, int cr) {
+    size_t i = 0;
+    while (i < len) {
+        int kind = rnd(4);
+        size_t n = kind == 0 ? rnd(400) : kind == 1 ? rnd(40) : rnd(10);
+        for (size_t j = 0; j < n && i < len; j++) {
+            int r = rnd(30);
+            buf[i++] = r == 0 && cr ? '\r' : 'a' + r % 26;
+        }
+        if (i < len - 1 && cr && rnd(5) == 0)
+            buf[i++] = '\r';
+        if (i < len)
+            buf[i++] = '\n';
+    }
+}
+
+/* Is 'li' a valid index of 'buf': every newline ends a line, and lines
+ * are cut, never after a '\r', only when longer than LI_LINE_MAX? */
+static int checkIndex(struct lineindex *li, const char *buf, size_t len, const char *how) {
+    size_t newlines = 0, real = 0;
+    if (li->off[0] != 0 || li->off[li->n] != len) {
+        fprintf(stderr, "%s: index ends at %llu of %zu\n", how, (unsigned long long)li->off[li->n], len);
+        return 1;
+    }
+    for (size_t i = 0; i < li->n; i++) {
+        const char *s = &buf[li->off[i]];
+        size_t n = li->off[i + 1] - li->off[i];
+        const char *nl = n ? memchr(s, '\n', n) : NULL;
+        int bad = n == 0 || (nl && nl != &s[n - 1]);
+        if (liContinued(li, buf, i))
+            bad |= s[n - 1] == '\r' ||
+                (n > LI_LINE_MAX + 2 && !memchr(&s[LI_LINE_MAX - 1], '\r', n - LI_LINE_MAX + 1));
+        else
+            bad |= (s[n - 1] != '\n' && i + 1 != li->n) || (n > LI_LINE_MAX + 2 && !memchr(s, '\r', n));
+        if (bad) {
+            fprintf(stderr, "%s: line %zu of %zu bytes\n", how, i, n);
+            return 1;
+        }
+        newlines += nl != NULL;
+    }
+    for (size_t i = 0; i < len; i++)
+        real += buf[i] == '\n';
+    if (newlines != real) {
+        fprintf(stderr, "%s: %zu newlines of %zu\n", how, newlines, real);
+        return 1;
+    }
+    return 0;
+}
+
+static void testIndex(int rounds) {
+    for (int round = 0; round < rounds; round++) {
+        size_t len = 1 + rnd(5000);
+        char *buf = malloc(len);
+        genText(buf, len, 1);
+        if (rnd(4) == 0)
+            for (size_t i = rnd(len); i < len && rnd(300); i++)
+                buf[i] = rnd(3) ? '\0' : '\r';
+
+        struct lineindex whole = { 0 }, streamed = { 0 }, units = { 0 };
+        liBuild(&whole, buf, len);
+        for (size_t at = 0; at < len;) {
+            size_t n = 1 + rnd(700);
+            if (n > len - at)
+                n = len - at;
+            liScan(&streamed, &buf[at], n, at);
+            at += n;
+        }
+        liEnd(&streamed, len);
+        struct liIndexer *x = liStart(buf, len, 1 + rnd(2), 0);
+        liFinish(x, &units);
+
+        fails += checkIndex(&whole, buf, len, "whole") + checkIndex(&streamed, buf, len, "streamed") +
+            checkIndex(&units, buf, len, "units");
+        /* Streamed, a cut can't move back over a '\r' in an earlier piece. */
+        size_t offs = sizeof(uint64_t) * (whole.n + 1);
+        CHECK(memchr(buf, '\r', len) || (whole.n == streamed.n && memcmp(whole.off, streamed.off, offs) == 0),
+            "round %d: streamed index differs", round);
+        CHECK(whole.n == units.n && memcmp(whole.off, units.off, offs) == 0,
+            "round %d: background index differs", round);
+        liFree(&whole);
+        liFree(&streamed);
+        liFree(&units);
+        free(buf);
+    }
+}
+
+/* One random edit of the kinds that split, join and cut rows. */
+static void edit(struct editorConfig *E) {
+    if (E->numrows == 0) {
+        editorInsertRow(E, 0, "seed", 4);
+        return;
+    }
+    int at = rnd(E->numrows), r = rnd(100);
+    erow *row = editorRow(E, at);
+    if (r < 25) {
+        editorRowInsertChar(E, row, rnd(row->size + 1), 'A' + rnd(26));
+    } else if (r < 40) {
+        editorRowDelChar(E, row, rnd(row->size));
+    } else if (r < 48) {
+        editorInsertRow(E, rnd(2) ? E->numrows : at, "new", 3);
+    } else if (r < 58) {
+        editorDelRow(E, at);
+    } else if (r < 75) {
+        E->cy = at;
+        E->cx = rnd(row->size + 1);
+        editorInsertNewline(E);
+    } else if (r < 92) {
+        E->cy = at;
+        E->cx = rnd(3) ? 0 : rnd(row->size + 1);
+        editorDelChar(E);
+    } else if (r < 97) {
+        editorRowAppendString(E, row, "XYZ", 3);
+    } else if (E->jmapped && !E->save) {
+        editorJournalCompact(E);
+    }
+}
+
+/* Rows of a saved file are cut as reading it back cuts them. */
+static int sameLayout(struct editorConfig *E, const char *path) {
+    size_t len;
+    char *map = platformMapFile(path, &len);
+    struct lineindex li = { 0 };
+    struct rtIter it;
+    int same = 1, i = 0;
+    liBuild(&li, map, len);
+    same = li.n == (size_t)E->numrows;
+    for (int more = rtIterAt(&E->rows, 0, &it); more && same; more = rtIterNext(&it), i++) {
+        int l;
+        rtIterText(&it, &l);
+        same = (size_t)l == liLineLen(&li, map, i) && rtIterContinued(&it) == liContinued(&li, map, i);
+    }
+    liFree(&li);
+    if (map)
+        platformUnmapFile(map, len);
+    return same;
+}
+
+static void testEdits(const char *path, int rounds) {
+    static struct editorConfig E2;
+    char journal[4096 + sizeof(KILO_JOURNAL_SUFFIX)];
+    snprintf(journal, sizeof(journal), "%s%s", path, KILO_JOURNAL_SUFFIX);
+    for (int round = 0; round < rounds; round++) {
+        size_t len = 1 + rnd(3000);
+        char *buf = malloc(len);
+        genText(buf, len, 0);
+        FILE *fp = fopen(path, "w");
+        fwrite(buf, 1, len, fp);
+        fclose(fp);
+        free(buf);
+        remove(journal);
+
+        initEditor(&E);
+        editorOpen(&E, (char *)path);
+        editorIndexFinish(&E);
+        CHECK(testMatchesFile(&E, path), "round %d: the file as opened", round);
+        for (int i = 0; i < 200; i++) {
+            edit(&E);
+            if (rnd(50) == 0) {
+                testSave(&E);
+                CHECK(testMatchesFile(&E, path), "round %d: the file after edit %d", round, i);
+                CHECK(sameLayout(&E, path), "round %d: rows after edit %d", round, i);
+            }
+        }
+
+        jnFlush(&E.journal);
+        initEditor(&E2);
+        editorOpen(&E2, (char *)path);
+        editorIndexFinish(&E2);
+        CHECK(testSameRows(&E, &E2), "round %d: the buffer replayed from the journal", round);
+        testSave(&E2);
+        CHECK(testMatchesFile(&E2, path), "round %d: the file after the replay", round);
+        jnRemove(&E2.journal);
+        jnClose(&E.journal);
+        if (fails > 10)
+            break;
+    }
+}
+
+int main(int argc, char **argv) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/lines.txt", argc > 1 ? argv[1] : ".");
+    testIndex(3000);
+    testEdits(path, 300);
+    remove(path);
+    printf("longlines: lines cut at %d bytes, %d failures\n", LI_LINE_MAX, fails);
+    return fails != 0;
+}
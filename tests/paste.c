@@ -0,0 +1,91 @@
+/* Pasted text goes in through editorInsertText() as if typed. */
+#include "kilotest.h"
+
+/* A buffer of the given lines, the cursor on row 'cy', column 'cx'. */
+static void setup(const char **lines, int n, int cy, int cx) {
+    initEditor(&E);
+    for (int i = 0; i < n; i++)
+        editorInsertRow(&E, i, (char *)lines[i], strlen(lines[i]));
+    E.cy = cy;
+    E.cx = cx;
+}
+
+static void paste(const char *s) {
+    editorInsertText(&E, s, strlen(s));
+}
+
+/* A paste shorter than what follows the cursor moves the rest of the row
+ * over itself. */
+static void testShortIntoLongRow(void) {
+    char row[300], want[302];
+    for (int i = 0; i < 299; i++)
+        row[i] = 'a' + i % 26;
+    row[299] = '\0';
+    const char *lines[] = { "above", row, "below" };
+    for (int at = 0; at <= 299; at += 23) {
+        setup(lines, 3, 1, at);
+        paste("XYZ");
+        memcpy(want, row, at);
+        memcpy(&want[at], "XYZ", 3);
+        memcpy(&want[at + 3], &row[at], 299 - at);
+        CHECK(testRowIs(&E, 1, want, 302), "XYZ at column %d", at);
+        CHECK(E.numrows == 3 && E.cy == 1 && E.cx == at + 3, "cursor after XYZ at %d", at);
+        CHECK(testRowIs(&E, 0, "above", 5) && testRowIs(&E, 2, "below", 5), "rows around XYZ at %d", at);
+    }
+}
+
+/* '\r', '\n' and "\r\n" each break the line once. */
+static void testLineBreaks(void) {
+    const char *lines[] = { "abcdef", "xyz" };
+    setup(lines, 2, 0, 3);
+    paste("ONE\rTWO\r\nTHREE\nFOUR");
+    const char *want[] = { "abcONE", "TWO", "THREE", "FOURdef", "xyz" };
+    CHECK(E.numrows == 5, "%d rows after breaks", E.numrows);
+    for (int i = 0; i < 5; i++)
+        CHECK(testRowIs(&E, i, want[i], strlen(want[i])), "row %d after breaks", i);
+    CHECK(E.cy == 3 && E.cx == 4, "cursor at %d,%d after breaks", E.cy, E.cx);
+
+    /* A break at the end leaves the cursor at the start of the rest. */
+    setup(lines, 2, 0, 0);
+    paste("new\n");
+    CHECK(E.numrows == 3 && testRowIs(&E, 0, "new", 3) && testRowIs(&E, 1, "abcdef", 6),
+        "paste ending in a break");
+    CHECK(E.cy == 1 && E.cx == 0, "cursor at %d,%d after a trailing break", E.cy, E.cx);
+}
+
+/* Past the last row a paste starts a new one. */
+static void testPastEnd(void) {
+    setup(NULL, 0, 0, 0);
+    paste("first\r\nsecond");
+    CHECK(E.numrows == 2 && testRowIs(&E, 0, "first", 5) && testRowIs(&E, 1, "second", 6),
+        "paste into an empty buffer");
+    CHECK(E.cy == 1 && E.cx == 6, "cursor at %d,%d in the empty buffer", E.cy, E.cx);
+
+    size_t len;
+    char *text = testContents(&E, &len);
+    CHECK(len == 13 && memcmp(text, "first\nsecond\n", 13) == 0, "saved bytes of the empty buffer");
+    free(text);
+}
+
+/* A paste starts with "\x1b[200~"; cut short, the sequence is an escape. */
+static void testPasteStart(void) {
+    const char *keys[] = { "\x1b[200~", "\x1b[20", "\x1b[2000~", "\x1b[200x" };
+    int want[] = { PASTE_START, '\x1b', '\x1b', '\x1b' };
+    for (int i = 0; i < 4; i++) {
+        initEditor(&E);
+        memcpy(E.keys, keys[i], strlen(keys[i]));
+        E.keyat = 0;
+        E.keylen = strlen(keys[i]);
+        int key = editorReadKey(&E);
+        CHECK(key == want[i], "key %d read from \\x1b%s", key, &keys[i][1]);
+    }
+}
+
+int main(void) {
+    testShortIntoLongRow();
+    testLineBreaks();
+    testPastEnd();
+    testPasteStart();
+    printf("paste: %d failures\n", fails);
+    return fails != 0;
+}
@@ -0,0 +1,86 @@
+/* Rows of the mapped file without tabs render as their text in the
+ * mapping, which is not terminated: highlighting and search must stop at
+ * rsize, and the first edit must leave the mapping alone. The files end
+ * at the end of a page, so a read past the text may fault. */
+#include "kilotest.h"
+
+/* Write a C file of one page, filled with comment lines, ending in 'tail'
+ * without a newline, and open it. */
+static void openPage(const char *dir, const char *tail) {
+    char path[4096];
+    long page = sysconf(_SC_PAGESIZE);
+    size_t n = strlen(tail);
+    snprintf(path, sizeof(path), "%s/page.c", dir);
+    FILE *fp = fopen(path, "w");
+    for (long i = 0; i < page - (long)n; i++)
+        fputc((i + 1) % 64 == 0 || i == page - (long)n - 1 ? '\n' : i % 64 < 2 ? '/' : 'x', fp);
+    fputs(tail, fp);
+    fclose(fp);
+
+    initEditor(&E);
+    editorOpen(&E, path);
+    editorIndexFinish(&E);
+}
+
+/* Render and highlight the last row, returning its highlight as bytes. */
+static unsigned char *lastRow(erow **out) {
+    static unsigned char hl[4096];
+    erow *row = editorRow(&E, E.numrows - 1);
+    editorRenderRow(&E, row);
+    editorSpansToBytes(row, hl);
+    *out = row;
+    return hl;
+}
+
+static void testKeyword(const char *dir) {
+    erow *row;
+    openPage(dir, "int x = 1; return");
+    unsigned char *hl = lastRow(&row);
+    CHECK(row->mapped && row->render == row->chars, "the mapped row has a render of its own");
+    CHECK(row->rsize == 17 && hl[11] == HL_KEYWORD1 && hl[16] == HL_KEYWORD1 && hl[0] == HL_KEYWORD2,
+        "keywords ending the file");
+    CHECK(editorRowFind(&E, E.numrows - 1, "return") == 11, "return not found");
+    CHECK(editorRowFind(&E, E.numrows - 1, "return;") == -1, "found past the end");
+
+    /* Editing copies the text and its render out of the mapping. */
+    E.cy = E.numrows - 1;
+    E.cx = row->size;
+    editorInsertChar(&E, ';');
+    editorSetEditRow(&E, NULL);
+    CHECK(!row->mapped && testRowIs(&E, E.numrows - 1, "int x = 1; return;", 18), "the edited row");
+    CHECK(E.map[E.maplen - 1] == 'n', "the edit went into the mapping");
+    jnRemove(&E.journal);
+    jnClose(&E.journal);
+}
+
+static void testComment(const char *dir) {
+    erow *row;
+    openPage(dir, "x /");
+    unsigned char *hl = lastRow(&row);
+    CHECK(row->render == row->chars && hl[2] == HL_NORMAL, "a '/' ending the file");
+    openPage(dir, "x //");
+    hl = lastRow(&row);
+    CHECK(hl[2] == HL_COMMENT && hl[3] == HL_COMMENT, "a comment ending the file");
+    openPage(dir, "x /*");
+    hl = lastRow(&row);
+    CHECK(hl[2] == HL_MLCOMMENT && row->hl_open_comment, "a comment opening at the end of the file");
+}
+
+/* A screen of mapped rows costs no copies of their text. */
+static void testShared(const char *dir) {
+    openPage(dir, "");
+    size_t live = E.mem.live;
+    for (int i = 0; i < E.numrows; i++)
+        editorRenderRow(&E, editorRow(&E, i));
+    size_t rows = E.numrows * (sizeof(erow) + sizeof(hlspan));
+    CHECK(E.mem.live - live <= rows, "%zu bytes for %d rows", E.mem.live - live, E.numrows);
+}
+
+int main(int argc, char **argv) {
+    const char *dir = argc > 1 ? argv[1] : ".";
+    testKeyword(dir);
+    testComment(dir);
+    testShared(dir);
+    printf("render: %d failures\n", fails);
+    return fails != 0;
+}
@@ -0,0 +1,54 @@
+#!/bin/sh
+# Build and run the drivers in tests/, or those named, as in
+#
+#   tests/run.sh paste
+#   CFLAGS=-DLI_LINE_MAX=37 tests/run.sh longlines
+#
+# with the system C compiler; CFLAGS are added to the build of every
+# source. Run without names, it also builds the drivers of long lines again
+# with lines cut at 37 bytes and small indexing units, so cutting is seen
+# on small files. Files the drivers write go under $TMPDIR.
+set -e
+root=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d "${TMPDIR:-/tmp}/kilo-tests.XXXXXX")
+trap 'rm -rf "$work"' EXIT
+
+cc=${CC:-cc}
+flags="-g -O2 -Wall -Wno-unused-parameter -I$root/repos/_mod -I$root/repos/taidanh"
+srcs="journal lineindex rowtree screen slab"
+libs=
+failed=0
+
+# gzip files are read and written with zlib, where there is one.
+if printf '#include <zlib.h>\nint main(void) { return !zlibVersion(); }\n' |
+    $cc -x c -o "$work/zlib" - -lz 2>/dev/null; then
+    flags="$flags -DKILO_HAVE_ZLIB"
+    srcs="$srcs gzfile"
+    libs=-lz
+fi
+
+# run NAME SUFFIX [FLAGS...]
+run() {
+    t=$1 bin=$work/$1$2
+    shift 2
+    $cc $flags "$@" $CFLAGS -o "$bin" "$root/tests/$t.c" \
+        $(for s in $srcs; do echo "$root/repos/taidanh/$s.c"; done) $libs -lpthread
+    mkdir "$bin.d"
+    if ! "$bin" "$bin.d" </dev/null; then
+        echo "$t$2: FAILED"
+        failed=1
+    fi
+}
+
+if [ $# -eq 0 ]; then
+    for t in $(cd "$root/tests" && ls *.c | sed 's/\.c$//'); do
+        run $t ""
+    done
+    run longlines -cut -DLI_LINE_MAX=37 -DLI_UNIT=1000
+    run bigfile -cut -DLI_LINE_MAX=37 -DLI_UNIT=1000
+else
+    for t in "$@"; do
+        run $t ""
+    done
+fi
+exit $failed
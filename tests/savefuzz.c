@@ -0,0 +1,187 @@
+/* Saves of a file large enough to be written through io_uring, with
+ * io_uring_enter() made to fail now and then. A failed ring must not leave
+ * a write reading the caller's buffers after platformWriteFile() returns,
+ * and the file must still come out whole. Then random edits, mostly near
+ * the end so that many saves are in place, are saved, some while more
+ * edits go on, and the file is read back and reopened against the buffer. */
+#define syscall testSyscall
+#include "kilotest.h"
+#undef syscall
+long syscall(long nr, ...);
+
+#include <stdarg.h>
+#include <sys/stat.h>
+
+#define BIG (6 << 20) /* Over PLATFORM_RING_MIN, so saves use the ring. */
+#define RING_BIG (40 << 20) /* Enough to fill the ring a few times over. */
+
+static int failAt; /* io_uring_enter() calls until one fails, or 0. */
+static int enters, failed;
+
+long testSyscall(long nr, ...) {
+    va_list ap;
+    long a[6];
+    va_start(ap, nr);
+    for (int i = 0; i < 6; i++)
+        a[i] = va_arg(ap, long);
+    va_end(ap);
+#ifdef PLATFORM_IO_URING
+    if (nr == __NR_io_uring_enter) {
+        enters++;
+        if (failAt && --failAt == 0) {
+            failed++;
+            errno = EBUSY;
+            return -1;
+        }
+    }
+#endif
+    return syscall(nr, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+static unsigned long long seed = 88172645463325252ULL;
+
+static unsigned rnd(unsigned n) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return n ? seed % n : 0;
+}
+
+static int sameFile(const char *path, const char *want, size_t len) {
+    size_t n;
+    char *map = platformMapFile(path, &n);
+    int same = map && n == len && memcmp(map, want, len) == 0;
+    if (map)
+        platformUnmapFile(map, n);
+    return same;
+}
+
+/* Fail the ring at each io_uring_enter() in turn, then scribble over the
+ * buffers as soon as the write returns: a write still in flight would put
+ * the scribble in the file. */
+static void testRingFailure(const char *path) {
+    char *buf = malloc(RING_BIG), *want = malloc(RING_BIG);
+    for (int i = 0; i < RING_BIG; i++)
+        want[i] = 'a' + rnd(26);
+    /* The first round fails none, counting the calls there are to fail. */
+    int calls = 0;
+    for (int k = 0; k <= calls; k++) {
+        memcpy(buf, want, RING_BIG);
+        failAt = k;
+        enters = 0;
+#ifdef PLATFORM_IO_URING
+        platformRingBroken = 0;
+#endif
+        struct platformFile *f = platformCreateReplacement(path);
+        struct platformIov iov = { buf, RING_BIG };
+        int res = platformWriteFile(f, &iov, 1);
+        memset(buf, 'Z', RING_BIG);
+        CHECK(res == 0 && platformCommitFile(f) == 0, "write with enter %d failing: %s", k, strerror(errno));
+        CHECK(sameFile(path, want, RING_BIG), "file with enter %d failing", k);
+        if (k == 0)
+            calls = enters;
+    }
+    failAt = 0;
+#ifdef PLATFORM_IO_URING
+    platformRingBroken = 0;
+#endif
+    printf("savefuzz: %d io_uring_enter() calls a write, %d made to fail\n", calls, failed);
+    free(buf);
+    free(want);
+}
+
+/* One random edit, near the end three times in four. */
+static void edit(struct editorConfig *E) {
+    if (E->numrows == 0) {
+        editorInsertRow(E, 0, "seed", 4);
+        return;
+    }
+    int back = rnd(E->numrows < 20 ? E->numrows : 20);
+    int at = rnd(4) ? E->numrows - 1 - back : (int)rnd(E->numrows), r = rnd(100);
+    erow *row = editorRow(E, at);
+    if (r < 35) {
+        editorRowInsertChar(E, row, rnd(row->size + 1), 'a' + rnd(26));
+    } else if (r < 50) {
+        editorRowDelChar(E, row, rnd(row->size));
+    } else if (r < 65) {
+        editorInsertRow(E, rnd(2) ? E->numrows : at, "new line", 8);
+    } else if (r < 75) {
+        editorDelRow(E, at);
+    } else if (r < 85) {
+        E->cy = at;
+        E->cx = rnd(row->size + 1);
+        editorInsertNewline(E);
+    } else if (r < 92) {
+        E->cy = at;
+        E->cx = 0;
+        editorDelChar(E);
+    } else {
+        editorRowAppendString(E, row, "XYZ", 3);
+    }
+}
+
+static void testEdits(const char *path, int rounds) {
+    static struct editorConfig E2;
+    FILE *fp = fopen(path, "w");
+    for (int i = 0; ftell(fp) < BIG; i++)
+        fprintf(fp, "line %d %.*s\n", i, (int)rnd(120), "abcdefghijklmnopqrstuvwxyz0123456789"
+            "abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnop");
+    fclose(fp);
+    initEditor(&E);
+    editorOpen(&E, (char *)path);
+    editorIndexFinish(&E);
+
+    int inplace = 0, whole = 0;
+    for (int round = 0; round < rounds && fails < 10; round++) {
+        for (int n = rnd(6); n > 0; n--)
+            edit(&E);
+        size_t len;
+        char *want = testContents(&E, &len);
+        struct stat a, b;
+        stat(path, &a);
+        failAt = rnd(3) == 0 ? 1 + rnd(6) : 0;
+#ifdef PLATFORM_IO_URING
+        platformRingBroken = 0;
+#endif
+        editorSave(&E);
+        /* Edits made while the save runs go in the next one. */
+        int during = rnd(3) == 0;
+        for (int n = during ? 3 : 0; n > 0; n--)
+            edit(&E);
+        editorSaveWait(&E);
+        stat(path, &b);
+        inplace += a.st_ino == b.st_ino;
+        whole += a.st_ino != b.st_ino;
+        CHECK(strstr(E.statusmsg, "bytes written") != NULL, "round %d: %s", round, E.statusmsg);
+        CHECK(sameFile(path, want, len), "round %d: the file after the save", round);
+        if (!during) {
+            size_t now;
+            char *after = testContents(&E, &now);
+            CHECK(now == len && memcmp(after, want, len) == 0, "round %d: the buffer after the save", round);
+            free(after);
+        }
+        free(want);
+
+        if (rnd(8) == 0) {
+            jnFlush(&E.journal);
+            initEditor(&E2);
+            editorOpen(&E2, (char *)path);
+            editorIndexFinish(&E2);
+            CHECK(testSameRows(&E, &E2), "round %d: the file reopened with its journal", round);
+            editorFreeRows(&E2);
+        }
+    }
+    failAt = 0;
+    printf("savefuzz: %d saves in place, %d whole, %d failures\n", inplace, whole, fails);
+    jnRemove(&E.journal);
+    editorFreeRows(&E);
+}
+
+int main(int argc, char **argv) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/save.txt", argc > 1 ? argv[1] : ".");
+    testRingFailure(path);
+    testEdits(path, 150);
+    remove(path);
+    return fails != 0;
+}
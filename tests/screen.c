@@ -0,0 +1,417 @@
+/* What scrFlush() writes, played on a small VT100 emulator: after every
+ * frame the emulated terminal must show the back grid, with the cursor
+ * where it was asked to be and visible. Random frames scroll, edit and
+ * move the cursor over rows with and without multibyte characters, with
+ * each way of scrolling; then a moved cursor, a typed key and a scrolled
+ * screen must cost only the bytes they need. */
+#include "kilotest.h"
+
+#define ROWS 12
+#define COLS 40
+#define TEXT (ROWS - 2) /* Rows of text, then a status bar and a message. */
+
+/* A cell of the emulated terminal holds a character, in up to 4 bytes of
+ * UTF-8. */
+struct vtCell {
+    char ch[4];
+    unsigned char n, attr;
+};
+
+static struct vt {
+    struct vtCell g[ROWS][COLS];
+    struct vtCell *last; /* Where continuation bytes go. */
+    int y, x, wrap; /* wrap: the last column was written. */
+    int top, bottom; /* Scroll margins, inclusive. */
+    int attr, visible;
+} vt;
+
+static const struct vtCell vtBlank = { " ", 1, 0 };
+
+static void vtReset(void) {
+    for (int y = 0; y < ROWS; y++)
+        for (int x = 0; x < COLS; x++)
+            vt.g[y][x] = vtBlank;
+    vt.last = NULL;
+    vt.y = vt.x = vt.wrap = vt.attr = 0;
+    vt.top = 0;
+    vt.bottom = ROWS - 1;
+    vt.visible = 1;
+}
+
+/* Scroll the margins up 'n' rows, or down if 'n' is negative. */
+static void vtScroll(int n) {
+    size_t row = sizeof(vt.g[0]);
+    for (; n > 0; n--) {
+        memmove(vt.g[vt.top], vt.g[vt.top + 1], row * (vt.bottom - vt.top));
+        for (int x = 0; x < COLS; x++)
+            vt.g[vt.bottom][x] = vtBlank;
+    }
+    for (; n < 0; n++) {
+        memmove(vt.g[vt.top + 1], vt.g[vt.top], row * (vt.bottom - vt.top));
+        for (int x = 0; x < COLS; x++)
+            vt.g[vt.top][x] = vtBlank;
+    }
+}
+
+static void vtLineFeed(void) {
+    if (vt.y == vt.bottom)
+        vtScroll(1);
+    else if (vt.y < ROWS - 1)
+        vt.y++;
+}
+
+static void vtPut(unsigned char c) {
+    /* A continuation byte adds to the character before it. */
+    if (c >= 0x80 && c < 0xc0) {
+        CHECK(vt.last && vt.last->n < 4, "a stray continuation byte");
+        if (vt.last && vt.last->n < 4)
+            vt.last->ch[vt.last->n++] = c;
+        return;
+    }
+    if (vt.wrap) {
+        vt.x = 0;
+        vt.wrap = 0;
+        vtLineFeed();
+    }
+    struct vtCell *cell = &vt.g[vt.y][vt.x];
+    cell->ch[0] = c;
+    cell->n = 1;
+    cell->attr = vt.attr;
+    vt.last = cell;
+    if (vt.x == COLS - 1)
+        vt.wrap = 1;
+    else
+        vt.x++;
+}
+
+static void vtSGR(int *p, int n) {
+    if (n == 0)
+        vt.attr = 0;
+    for (int i = 0; i < n; i++) {
+        if (p[i] == 0)
+            vt.attr = 0;
+        else if (p[i] == 1)
+            vt.attr |= SCR_BOLD;
+        else if (p[i] == 7)
+            vt.attr |= SCR_INVERSE;
+        else if (p[i] >= 30 && p[i] <= 37)
+            vt.attr = (vt.attr & ~SCR_COLOR) | (p[i] - 29);
+        else if (p[i] == 39)
+            vt.attr &= ~SCR_COLOR;
+        else
+            CHECK(0, "SGR %d", p[i]);
+    }
+}
+
+/* Play 'len' bytes of output on the terminal. */
+static void vtFeed(const char *out, size_t len) {
+    const unsigned char *s = (const unsigned char *)out, *end = s + len;
+    while (s < end) {
+        unsigned char c = *s++;
+        if (c == '\r') {
+            vt.x = vt.wrap = 0;
+        } else if (c == '\n') {
+            vtLineFeed();
+            vt.wrap = 0;
+        } else if (c >= ' ') {
+            vtPut(c);
+        } else if (c == '\x1b' && s < end && *s == 'M') {
+            s++;
+            vt.wrap = 0;
+            if (vt.y == vt.top)
+                vtScroll(-1);
+            else if (vt.y > 0)
+                vt.y--;
+        } else if (c == '\x1b' && s < end && *s == '[') {
+            int p[8] = { 0 }, n = 0, private = 0;
+            s++;
+            if (s < end && *s == '?') {
+                private = 1;
+                s++;
+            }
+            while (s < end && ((*s >= '0' && *s <= '9') || *s == ';')) {
+                if (*s == ';')
+                    n++;
+                else if (n < 8)
+                    p[n] = p[n] * 10 + *s - '0';
+                s++;
+            }
+            if (s[-1] != '[' && s[-1] != '?')
+                n++;
+            if (s == end) {
+                CHECK(0, "a control sequence cut short");
+                return;
+            }
+            int a = n > 0 && p[0] ? p[0] : 1, b = n > 1 && p[1] ? p[1] : 1;
+            switch (private ? -*s : *s) {
+            case -'l':
+            case -'h':
+                CHECK(n == 1 && p[0] == 25, "private mode %d", p[0]);
+                vt.visible = *s == 'h';
+                break;
+            case 'H':
+                vt.y = a - 1 < ROWS ? a - 1 : ROWS - 1;
+                vt.x = b - 1 < COLS ? b - 1 : COLS - 1;
+                vt.wrap = 0;
+                break;
+            case 'C':
+                vt.x = vt.x + a < COLS ? vt.x + a : COLS - 1;
+                vt.wrap = 0;
+                break;
+            case 'D':
+                vt.x = vt.x - a > 0 ? vt.x - a : 0;
+                vt.wrap = 0;
+                break;
+            case 'K':
+                CHECK(n == 0, "EL %d", p[0]);
+                for (int x = vt.x; x < COLS; x++)
+                    vt.g[vt.y][x] = vtBlank;
+                break;
+            case 'J':
+                CHECK(n == 1 && p[0] == 2, "ED %d", p[0]);
+                for (int y = 0; y < ROWS; y++)
+                    for (int x = 0; x < COLS; x++)
+                        vt.g[y][x] = vtBlank;
+                break;
+            case 'm':
+                vtSGR(p, n);
+                break;
+            case 'r':
+                vt.top = n > 0 && p[0] ? p[0] - 1 : 0;
+                vt.bottom = n > 1 && p[1] ? p[1] - 1 : ROWS - 1;
+                vt.y = vt.x = vt.wrap = 0;
+                break;
+            case 'S':
+                vtScroll(a);
+                break;
+            case 'T':
+                vtScroll(-a);
+                break;
+            default:
+                CHECK(0, "unknown sequence ending in '%c'", *s);
+            }
+            s++;
+        } else {
+            CHECK(0, "control byte %d", c);
+        }
+    }
+}
+
+/* The terminal shows the back grid, character for character, and the
+ * cursor is at row 'cy', column 'cx'. */
+static int vtShows(struct screen *scr, int cy, int cx) {
+    for (int y = 0; y < ROWS; y++) {
+        struct scrCell *c = &scr->back[y * COLS];
+        int x = 0, col = 0;
+        while (x < COLS) {
+            int n = 1;
+            while (x + n < COLS && c[x + n].ch >= 0x80 && c[x + n].ch < 0xc0)
+                n++;
+            struct vtCell *v = &vt.g[y][col++];
+            if (v->n != n || v->attr != c[x].attr)
+                return 0;
+            for (int i = 0; i < n; i++)
+                if ((unsigned char)v->ch[i] != c[x + i].ch)
+                    return 0;
+            x += n;
+        }
+        for (; col < COLS; col++)
+            if (vt.g[y][col].n != 1 || vt.g[y][col].ch[0] != ' ' || vt.g[y][col].attr)
+                return 0;
+    }
+    return vt.visible && vt.y == cy && vt.x == cx && !vt.wrap;
+}
+
+/* Flush a frame, play it and check it. Returns the bytes it took. */
+static size_t frame(struct screen *scr, int cy, int cx, const char *what) {
+    size_t len = scrFlush(scr, cy, cx);
+    vtFeed(scr->out, len);
+    CHECK(vtShows(scr, cy, cx), "%s: the terminal shows another frame", what);
+    return len;
+}
+
+static unsigned long long seed = 88172645463325252ULL;
+
+static unsigned rnd(unsigned n) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return seed % n;
+}
+
+/* A document of lines of text with attributes, some with multibyte
+ * characters, none longer than the screen is wide. */
+#define DOC 300
+
+static struct {
+    char text[COLS];
+    unsigned char attr[COLS];
+    int len;
+} doc[DOC];
+
+static void docLine(int i, int wide) {
+    static const char *chars[] = { "a", "b", " ", "x", "\xc3\xa9", "\xe2\x82\xac" };
+    int len = 0, attr = 0, want = rnd(COLS + 1);
+    while (len < want) {
+        const char *c = chars[rnd(wide ? 6 : 4)];
+        int n = strlen(c);
+        if (len + n > want)
+            break;
+        if (rnd(6) == 0)
+            attr = rnd(9) | (rnd(3) ? 0 : rnd(4) << 4);
+        memcpy(&doc[i].text[len], c, n);
+        memset(&doc[i].attr[len], attr, n);
+        len += n;
+    }
+    doc[i].len = len;
+}
+
+/* Draw the document from line 'off' on, with a status bar and a message. */
+static void draw(struct screen *scr, int off, const char *msg) {
+    scrClear(scr);
+    for (int y = 0; y < TEXT && off + y < DOC; y++) {
+        int x = 0;
+        for (int i = 0; i < doc[off + y].len; i++)
+            x = scrPut(scr, y, x, &doc[off + y].text[i], 1, doc[off + y].attr[i]);
+    }
+    char status[64];
+    int n = snprintf(status, sizeof(status), "doc - %d lines", DOC);
+    int x = scrPut(scr, TEXT, 0, status, n, SCR_INVERSE);
+    scrFill(scr, TEXT, x, COLS - x, SCR_INVERSE);
+    scrPut(scr, TEXT + 1, 0, msg, strlen(msg), 0);
+}
+
+static void testRandom(int scroll, int wide) {
+    struct screen scr = { 0 };
+    scrResize(&scr, ROWS, COLS);
+    scr.scroll = scroll;
+    vtReset();
+    for (int i = 0; i < DOC; i++)
+        docLine(i, wide);
+    int off = 0, cy = 0, cx = 0;
+    char what[64];
+    for (int f = 0; f < 400 && fails < 10; f++) {
+        int r = rnd(10);
+        if (r < 3) {
+            int n = (int)rnd(2 * TEXT + 1) - TEXT;
+            n = off + n < 0 ? -off : off + n > DOC - TEXT ? DOC - TEXT - off : n;
+            off += n;
+            scrScroll(&scr, 0, TEXT, n);
+        } else if (r < 6) {
+            docLine(off + rnd(TEXT), wide);
+        } else if (r == 6) {
+            scr.valid = 0;
+        }
+        cy = rnd(ROWS);
+        cx = rnd(COLS);
+        snprintf(what, sizeof(what), "frame %d, scrolling %d, %s", f, scroll, wide ? "multibyte" : "ascii");
+        draw(&scr, off, r == 7 ? "a message" : "");
+        frame(&scr, cy, cx, what);
+    }
+    scrFree(&scr);
+}
+
+/* Each way of moving the cursor, chosen where it is shortest. */
+static void testCursor(void) {
+    struct screen scr = { 0 };
+    scrResize(&scr, ROWS, COLS);
+    vtReset();
+    for (int i = 0; i < DOC; i++)
+        docLine(i, 0);
+    draw(&scr, 0, "");
+    frame(&scr, 3, 5, "the first frame");
+    static const struct {
+        int y, x;
+        const char *out;
+    } moves[] = {
+        { 3, 6, "\x1b[C" },
+        { 3, 2, "\x1b[4D" },
+        { 4, 0, "\r\n" },
+        { 5, 3, "\x1b[6;4H" },
+        { 5, 0, "\r" },
+        { 10, 20, "\x1b[11;21H" },
+        { 0, 0, "\x1b[H" },
+    };
+    for (size_t i = 0; i < sizeof(moves) / sizeof(moves[0]); i++) {
+        draw(&scr, 0, "");
+        size_t len = frame(&scr, moves[i].y, moves[i].x, "a cursor move");
+        CHECK(len == strlen(moves[i].out) && memcmp(scr.out, moves[i].out, len) == 0,
+            "moving to %d,%d took %zu bytes", moves[i].y, moves[i].x, len);
+    }
+    scrFree(&scr);
+}
+
+/* A key typed costs the cells it changes, and a row scrolled in costs a
+ * row, where the terminal can scroll. */
+static void testCosts(void) {
+    for (int scroll = SCR_SCROLL_NONE; scroll <= SCR_SCROLL_SU; scroll++) {
+        struct screen scr = { 0 };
+        scrResize(&scr, ROWS, COLS);
+        scr.scroll = scroll;
+        vtReset();
+        for (int i = 0; i < DOC; i++) {
+            memset(doc[i].text, 'a' + i % 26, COLS - 8);
+            memset(doc[i].attr, 0, COLS);
+            doc[i].len = COLS - 8;
+        }
+        draw(&scr, 0, "");
+        frame(&scr, 0, 0, "the first frame");
+
+        /* Overwrite the last character of row 3, as typing it would. */
+        doc[3].text[COLS - 9] = 'X';
+        draw(&scr, 0, "");
+        size_t len = frame(&scr, 3, COLS - 8, "a key typed");
+        CHECK(len <= 20, "a key typed took %zu bytes", len);
+
+        draw(&scr, 1, "");
+        scrScroll(&scr, 0, TEXT, 1);
+        len = frame(&scr, TEXT - 1, 0, "a row scrolled");
+        if (scroll == SCR_SCROLL_NONE)
+            CHECK(len >= (size_t)(TEXT - 1) * (COLS - 8), "%zu bytes scrolled without scrolling", len);
+        else
+            CHECK(len <= (size_t)COLS + 40, "a row scrolled took %zu bytes with scrolling %d", len, scroll);
+
+        draw(&scr, 0, "");
+        scrScroll(&scr, 0, TEXT, -1);
+        len = frame(&scr, 0, 0, "a row scrolled back");
+        if (scroll != SCR_SCROLL_NONE)
+            CHECK(len <= (size_t)COLS + 40, "a row scrolled back took %zu bytes with scrolling %d", len,
+                scroll);
+        scrFree(&scr);
+    }
+}
+
+/* A row with multibyte characters takes fewer columns than cells, so a
+ * change after one rewrites the row rather than moving to a cell. */
+static void testMultibyte(void) {
+    struct screen scr = { 0 };
+    scrResize(&scr, ROWS, COLS);
+    vtReset();
+    const char *row = "caf\xc3\xa9 au lait, \xe2\x82\xac" "3";
+    draw(&scr, 0, "");
+    scrPut(&scr, 2, 0, row, strlen(row), 0);
+    frame(&scr, 0, 0, "a multibyte row");
+    draw(&scr, 0, "");
+    scrPut(&scr, 2, 0, row, strlen(row), 0);
+    scrPut(&scr, 2, 10, "X", 1, 0);
+    size_t len = frame(&scr, 0, 0, "a change after a multibyte character");
+    CHECK(len >= strlen(row) && memmem(scr.out, len, "\x1b[K", 3), "the row not rewritten, %zu bytes", len);
+
+    /* Back to plain text, what the row left past its end is cleared. */
+    draw(&scr, 0, "");
+    scrPut(&scr, 2, 0, "cafe", 4, 0);
+    frame(&scr, 0, 0, "a multibyte row replaced");
+    scrFree(&scr);
+}
+
+int main(int argc, char **argv) {
+    for (int scroll = SCR_SCROLL_NONE; scroll <= SCR_SCROLL_SU; scroll++) {
+        testRandom(scroll, 0);
+        testRandom(scroll, 1);
+    }
+    testCursor();
+    testCosts();
+    testMultibyte();
+    printf("screen: %d failures\n", fails);
+    return fails != 0;
+}
@@ -0,0 +1,159 @@
+/* Buffers read from a stream, as kilo - reads standard input: lines show
+ * as they arrive, a last line without a newline once the stream ends, and
+ * however much arrives the rows cost no memory until looked at. A stream
+ * that fails keeps what arrived, and closing one while its writer is still
+ * going does not wait for the writer to finish. */
+#include "kilotest.h"
+
+#include <fcntl.h>
+
+/* A stream on the read end of a pipe, as platformOpenStdin() makes of
+ * standard input once keys come from the terminal. */
+static struct platformStream *pipeStream(int *writer) {
+    int fds[2];
+    if (pipe(fds) == -1)
+        return NULL;
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    struct platformStream *s = malloc(sizeof(*s));
+    s->fd = fds[0];
+    s->feed = NULL;
+    *writer = fds[1];
+    return s;
+}
+
+static void put(int fd, const char *s) {
+    CHECK(write(fd, s, strlen(s)) == (ssize_t)strlen(s), "write: %s", strerror(errno));
+}
+
+/* Poll until the stream ends, or 'rows' rows are there, for a minute at
+ * most. Returns the most bytes one poll took. */
+static size_t drain(int rows) {
+    size_t most = 0;
+    long long start = platformClock();
+    while (E.stream && E.numrows < rows && platformClock() - start < 60000) {
+        size_t before = E.maplen;
+        if (!editorStreamPoll(&E))
+            platformStreamWait(E.stream, 10);
+        most = E.maplen - before > most ? E.maplen - before : most;
+    }
+    return most;
+}
+
+static void testPipe(const char *dir) {
+    int w;
+    initEditor(&E);
+    editorOpenStream(&E, pipeStream(&w));
+    CHECK(E.numrows == 0 && E.stream && !editorStreamPoll(&E), "rows before any input");
+
+    put(w, "first\nsec");
+    editorStreamPoll(&E);
+    CHECK(E.numrows == 1 && testRowIs(&E, 0, "first", 5), "%d rows after a line and a half", E.numrows);
+    put(w, "ond\nthird");
+    editorStreamPoll(&E);
+    CHECK(E.numrows == 2 && testRowIs(&E, 1, "second", 6) && E.stream, "%d rows after the second line",
+        E.numrows);
+
+    /* An edit while the stream goes on stays put as more rows arrive. */
+    editorRowInsertChar(&E, editorRow(&E, 0), 0, '>');
+    put(w, "\nfourth\nlast");
+    close(w);
+    drain(INT_MAX);
+    CHECK(!E.stream && E.numrows == 5 && testRowIs(&E, 4, "last", 4), "%d rows at the end of input",
+        E.numrows);
+    CHECK(testRowIs(&E, 0, ">first", 6) && testRowIs(&E, 3, "fourth", 6), "rows after the edit");
+    CHECK(E.filename == NULL && E.dirty == 1, "a stream has no file, %d edits", E.dirty);
+
+    /* It is saved once named. */
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/stream.txt", dir);
+    E.filename = strdup(path);
+    CHECK(testSave(&E) == 32 && testMatchesFile(&E, path), "the stream saved: %s", E.statusmsg);
+    jnRemove(&E.journal);
+    editorFreeRows(&E);
+    remove(path);
+}
+
+/* Standard input that is empty, or ends in a newline. */
+static void testEnds(void) {
+    int w;
+    initEditor(&E);
+    editorOpenStream(&E, pipeStream(&w));
+    close(w);
+    drain(INT_MAX);
+    CHECK(!E.stream && E.numrows == 0 && E.maplen == 0, "%d rows of empty input", E.numrows);
+    editorFreeRows(&E);
+
+    initEditor(&E);
+    editorOpenStream(&E, pipeStream(&w));
+    put(w, "one\n\n");
+    close(w);
+    drain(INT_MAX);
+    CHECK(!E.stream && E.numrows == 2 && testRowIs(&E, 1, "", 0), "%d rows of input ending in a blank line",
+        E.numrows);
+    editorFreeRows(&E);
+}
+
+#define BIG_LINES 3000000
+
+static int produceBig(struct platformFeed *f, void *arg) {
+    char line[64];
+    for (int i = 0; i < BIG_LINES; i++) {
+        int n = snprintf(line, sizeof(line), "line %d of a large stream of input text\n", i);
+        if (platformFeedWrite(f, line, n) == -1)
+            return errno;
+    }
+    return 0;
+}
+
+/* 130 MB arrive a chunk between keys at most, and cost the line index. */
+static void testBig(void) {
+    initEditor(&E);
+    editorOpenStream(&E, platformStartStream(produceBig, NULL));
+    size_t most = drain(INT_MAX);
+    CHECK(E.stream == NULL && E.numrows == BIG_LINES, "%d rows of %d", E.numrows, BIG_LINES);
+    CHECK(most <= KILO_STREAM_CHUNK + KILO_STREAM_READ, "%zu bytes taken between keys", most);
+    CHECK(testRowIs(&E, BIG_LINES - 1, "line 2999999 of a large stream of input text", 44), "the last row");
+    CHECK(E.mem.live < (1 << 20), "%zu bytes of rows for %zu bytes of input", E.mem.live, E.maplen);
+    editorFreeRows(&E);
+}
+
+static int produceFailing(struct platformFeed *f, void *arg) {
+    platformFeedWrite(f, "some\ninput cut", 14);
+    return EIO;
+}
+
+static int produceForever(struct platformFeed *f, void *arg) {
+    static char block[65536];
+    memset(block, 'x', sizeof(block));
+    block[sizeof(block) - 1] = '\n';
+    while (platformFeedWrite(f, block, sizeof(block)) == 0)
+        ;
+    return errno;
+}
+
+static void testStop(void) {
+    initEditor(&E);
+    editorOpenStream(&E, platformStartStream(produceFailing, NULL));
+    drain(INT_MAX);
+    CHECK(!E.stream && E.numrows == 2 && testRowIs(&E, 1, "input cut", 9), "%d rows of failed input",
+        E.numrows);
+    CHECK(strstr(E.statusmsg, "Stopped reading input") != NULL, "no word of the failure: %s", E.statusmsg);
+    editorFreeRows(&E);
+
+    /* Quitting while input goes on: the writer sees EPIPE and returns. */
+    initEditor(&E);
+    editorOpenStream(&E, platformStartStream(produceForever, NULL));
+    drain(1000);
+    CHECK(E.stream && E.numrows > 0, "%d rows of endless input", E.numrows);
+    editorFreeRows(&E);
+    CHECK(E.stream == NULL, "the stream left open");
+}
+
+int main(int argc, char **argv) {
+    testPipe(argc > 1 ? argv[1] : ".");
+    testEnds();
+    testBig();
+    testStop();
+    printf("stream: %d failures\n", fails);
+    return fails != 0;
+}